@@ -0,0 +1,257 @@
+/*                                                *
+ *   Microbenchmarks of the cSAT.c rhs kernels    *
+ *                                                *
+ *  to compile use (from this directory):         *
+ *  cc -std=c99 -O2 -o bench_kernels              *
+ *     bench_kernels.c ../c_libs/cSAT.c -lm       *
+ *  add -fopenmp to time the threaded kernels     *
+ *                                                *
+ *  usage: bench_kernels [-s seconds] [-t threads]*
+ *         file.cnf ...                           *
+ *  writes one JSON document to stdout            *
+ *                                                */
+
+#if !defined(_POSIX_C_SOURCE) && (defined(__unix__) || defined(__APPLE__))
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//Declarations of the cSAT.c functions that are timed
+
+#define RHS_TYPE_ONE 1
+#define RHS_TYPE_TWO 2
+#define RHS_TYPE_THREE 3
+#define RHS_LOG_AUX 16
+#define RHS_MIXED_PRECISION 32
+
+#define SIMD_SCALAR 0
+#define SIMD_AVX512 2
+
+typedef struct sat_problem sat_problem;
+
+sat_problem *sat_problem_read_dimacs(const char *path);
+void sat_problem_destroy(sat_problem *problem);
+int sat_problem_variables(sat_problem *problem);
+int sat_problem_clauses(sat_problem *problem);
+int sat_problem_literals(sat_problem *problem);
+void sat_problem_export(sat_problem *problem, int clause_offsets[], int literal_variables[], int literal_signs[]);
+int sat_problem_set_simd(sat_problem *problem, int simd);
+int sat_problem_set_threads(sat_problem *problem, int threads);
+void sat_problem_rhs(sat_problem *problem, int rhs_type, double y[], double result[]);
+int sat_problem_jacobian_nnz(sat_problem *problem);
+int sat_problem_jacobian_sparse(sat_problem *problem, int rhs_type, double y[], double values[]);
+void sat_problem_jvp(sat_problem *problem, int rhs_type, double y[], double v[], double result[]);
+void rhs1(int N, int M, int c[], double y[], double result[]);
+void rhs2(int N, int M, int c[], double y[], double result[]);
+void rhs1_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], double y[], double result[]);
+void rhs2_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], double y[], double result[]);
+void jacobian1(int N, int M, int c[], double y[], double result[]);
+
+//Largest dense clause matrix (N*M) and dense jacobian ((N+M)^2) that are still timed
+#define DENSE_LIMIT 4000000
+
+#define RUNS 5
+
+typedef struct bench_context {
+    sat_problem *problem;
+    int N;
+    int M;
+    int *clause_offsets;
+    int *literal_variables;
+    int *literal_signs;
+    int *dense;             //M x N clause matrix of the dense kernels, NULL if too large
+    double *y;              //plain state
+    double *y_log;          //the same state with ln a_m
+    double *v;              //direction of the jacobian vector products
+    double *result;         //max(N+M, nnz, (N+M)^2 if dense) values
+    int rhs_type;
+} bench_context;
+
+typedef void (*bench_function)(bench_context *context);
+
+static double seconds(void){
+#if defined(__unix__) || defined(__APPLE__)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void bench_rhs1(bench_context *c) { rhs1(c->N, c->M, c->dense, c->y, c->result); }
+static void bench_rhs2(bench_context *c) { rhs2(c->N, c->M, c->dense, c->y, c->result); }
+static void bench_jacobian1(bench_context *c) { jacobian1(c->N, c->M, c->dense, c->y, c->result); }
+static void bench_rhs1_sparse(bench_context *c) { rhs1_sparse(c->N, c->M, c->clause_offsets, c->literal_variables, c->literal_signs, c->y, c->result); }
+static void bench_rhs2_sparse(bench_context *c) { rhs2_sparse(c->N, c->M, c->clause_offsets, c->literal_variables, c->literal_signs, c->y, c->result); }
+static void bench_problem_rhs(bench_context *c) { sat_problem_rhs(c->problem, c->rhs_type, c->rhs_type & RHS_LOG_AUX ? c->y_log : c->y, c->result); }
+static void bench_jacobian_sparse(bench_context *c) { sat_problem_jacobian_sparse(c->problem, c->rhs_type, c->y, c->result); }
+static void bench_jvp(bench_context *c) { sat_problem_jvp(c->problem, c->rhs_type, c->y, c->v, c->result); }
+
+//Nanoseconds per call: the repetitions are calibrated to about budget/RUNS seconds per run and the
+//fastest of RUNS runs is reported
+static double time_calls(bench_function function, bench_context *context, double budget){
+    long long repetitions = 1;
+    for (;;)
+    {
+        double start = seconds();
+        for (long long r = 0; r < repetitions; r++)
+        {
+            function(context);
+        }
+        double elapsed = seconds() - start;
+        if (elapsed >= budget / (4 * RUNS) || repetitions >= (1LL << 40)){
+            repetitions = elapsed > 0 ? (long long)(repetitions * (budget / RUNS) / elapsed) + 1 : repetitions * 2;
+            break;
+        }
+        repetitions *= 2;
+    }
+    double best = -1.0;
+    for (int run = 0; run < RUNS; run++)
+    {
+        double start = seconds();
+        for (long long r = 0; r < repetitions; r++)
+        {
+            function(context);
+        }
+        double per_call = (seconds() - start) / repetitions;
+        if (best < 0 || per_call < best) { best = per_call; }
+    }
+    return 1e9 * best;
+}
+
+static void print_result(int *first, const char *name, double ns, int literals){
+    printf("%s\n        \"%s\": {\"ns_per_call\": %.1f, \"ns_per_literal\": %.3f}", *first ? "" : ",", name, ns, literals > 0 ? ns / literals : 0.0);
+    *first = 0;
+}
+
+static void json_string(const char *text){
+    putchar('"');
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\') { putchar('\\'); }
+        putchar(*text);
+    }
+    putchar('"');
+}
+
+//Times every kernel on one instance, returns 0 on success
+static int bench_file(const char *path, double budget, int threads, int *first_file){
+    sat_problem *problem = sat_problem_read_dimacs(path);
+    if (!problem) { return -1; }
+    bench_context c;
+    memset(&c, 0, sizeof(bench_context));
+    c.problem = problem;
+    c.N = sat_problem_variables(problem);
+    c.M = sat_problem_clauses(problem);
+    int L = sat_problem_literals(problem);
+    int n = c.N + c.M;
+    int nnz = sat_problem_jacobian_nnz(problem);
+    int dense = (double)c.N * c.M <= DENSE_LIMIT && (double)n * n <= DENSE_LIMIT;
+    size_t result_size = (size_t)(n > nnz ? n : nnz);
+    if (dense && (size_t)n * n > result_size) { result_size = (size_t)n * n; }
+    c.clause_offsets = malloc((c.M + 1) * sizeof(int));
+    c.literal_variables = malloc((L > 0 ? L : 1) * sizeof(int));
+    c.literal_signs = malloc((L > 0 ? L : 1) * sizeof(int));
+    c.dense = dense ? calloc((size_t)c.N * c.M > 0 ? (size_t)c.N * c.M : 1, sizeof(int)) : NULL;
+    c.y = malloc((n > 0 ? n : 1) * sizeof(double));
+    c.y_log = malloc((n > 0 ? n : 1) * sizeof(double));
+    c.v = malloc((n > 0 ? n : 1) * sizeof(double));
+    c.result = malloc((result_size > 0 ? result_size : 1) * sizeof(double));
+    if (!c.clause_offsets || !c.literal_variables || !c.literal_signs || (dense && !c.dense) || !c.y || !c.y_log || !c.v || !c.result || nnz < 0){
+        fprintf(stderr, "bench_kernels: out of memory for %s\n", path);
+        exit(1);
+    }
+    sat_problem_export(problem, c.clause_offsets, c.literal_variables, c.literal_signs);
+    if (dense){
+        for (int m = 0; m < c.M; m++)
+        {
+            for (int l = c.clause_offsets[m]; l < c.clause_offsets[m+1]; l++)
+            {
+                c.dense[(size_t)m * c.N + c.literal_variables[l]] = c.literal_signs[l];
+            }
+        }
+    }
+    //fixed pseudo random state: spins in (-1, 1), aux variables in [1, 2)
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < n; i++)
+    {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        double uniform = (random >> 11) * (1.0 / 9007199254740992.0);
+        c.y[i] = i < c.N ? 2.0 * uniform - 1.0 : 1.0 + uniform;
+        c.y_log[i] = i < c.N ? c.y[i] : log(c.y[i]);
+        c.v[i] = uniform - 0.5;
+    }
+    int used_threads = sat_problem_set_threads(problem, threads);
+
+    printf("%s\n    {\"file\": ", *first_file ? "" : ",");
+    json_string(path);
+    printf(", \"N\": %d, \"M\": %d, \"literals\": %d, \"alpha\": %.6f, \"threads\": %d, \"kernels\": {", c.N, c.M, L, c.N > 0 ? (double)c.M / c.N : 0.0, used_threads);
+    *first_file = 0;
+    int first = 1;
+    if (dense){
+        print_result(&first, "rhs1", time_calls(bench_rhs1, &c, budget), L);
+        print_result(&first, "rhs2", time_calls(bench_rhs2, &c, budget), L);
+        print_result(&first, "jacobian1", time_calls(bench_jacobian1, &c, budget), L);
+    }
+    print_result(&first, "rhs1_sparse", time_calls(bench_rhs1_sparse, &c, budget), L);
+    print_result(&first, "rhs2_sparse", time_calls(bench_rhs2_sparse, &c, budget), L);
+    static const char *simd_names[3] = {"scalar", "avx2", "avx512"};
+    static const struct { const char *name; int rhs_type; } variants[] = {
+        {"type1", RHS_TYPE_ONE}, {"type2", RHS_TYPE_TWO}, {"type3", RHS_TYPE_THREE},
+        {"type1_log_aux", RHS_TYPE_ONE | RHS_LOG_AUX}, {"type1_mixed", RHS_TYPE_ONE | RHS_MIXED_PRECISION}};
+    for (int simd = SIMD_SCALAR; simd <= SIMD_AVX512; simd++)
+    {
+        if (sat_problem_set_simd(problem, simd) != simd) { continue; }
+        for (size_t variant = 0; variant < sizeof(variants) / sizeof(variants[0]); variant++)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "problem_rhs_%s_%s", variants[variant].name, simd_names[simd]);
+            c.rhs_type = variants[variant].rhs_type;
+            print_result(&first, name, time_calls(bench_problem_rhs, &c, budget), L);
+        }
+    }
+    sat_problem_set_simd(problem, SIMD_AVX512);
+    c.rhs_type = RHS_TYPE_ONE;
+    print_result(&first, "jacobian_sparse_type1", time_calls(bench_jacobian_sparse, &c, budget), L);
+    print_result(&first, "jvp_type1", time_calls(bench_jvp, &c, budget), L);
+    printf("\n    }}");
+
+    free(c.clause_offsets);
+    free(c.literal_variables);
+    free(c.literal_signs);
+    free(c.dense);
+    free(c.y);
+    free(c.y_log);
+    free(c.v);
+    free(c.result);
+    sat_problem_destroy(problem);
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+    double budget = 0.5;    //seconds per kernel
+    int threads = 1;
+    int first_file = 1;
+    int status = 0;
+    printf("{\"benchmark\": \"kernels\", \"instances\": [");
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-s") && arg + 1 < argc) { budget = atof(argv[++arg]); continue; }
+        if (!strcmp(argv[arg], "-t") && arg + 1 < argc) { threads = atoi(argv[++arg]); continue; }
+        if (bench_file(argv[arg], budget, threads, &first_file)){
+            fprintf(stderr, "bench_kernels: could not read %s\n", argv[arg]);
+            status = 1;
+        }
+    }
+    printf("\n]}\n");
+    return status;
+}
@@ -0,0 +1,438 @@
+/*                                                *
+ *   Regression checks of the cSAT.c library      *
+ *                                                *
+ *  to compile use (from this directory):         *
+ *  cc -std=c99 -O2 -o check_native               *
+ *     check_native.c ../c_libs/cSAT.c -lm        *
+ *                                                *
+ *  usage: check_native [seed]                    *
+ *  prints one line per check, the exit status is *
+ *  the number of failed checks                   *
+ *                                                */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Declarations of the cSAT.c functions that are checked
+
+typedef struct sat_problem sat_problem;
+typedef struct sat_reconstruction sat_reconstruction;
+
+typedef struct sat_preprocess_options {
+    int unit_propagation;
+    int pure_literals;
+    int subsumption;
+    int elimination;
+    int max_occurrences;
+    int max_resolvent_length;
+    int max_rounds;
+} sat_preprocess_options;
+
+typedef struct sat_preprocess_stats {
+    int status;
+    int variables;
+    int clauses;
+    int units;
+    int pure_literals;
+    int subsumed;
+    int eliminated;
+    int resolvents;
+    int rounds;
+} sat_preprocess_stats;
+
+#define PREPROCESS_DONE 0
+#define PREPROCESS_UNSATISFIABLE 1
+
+#define RHS_TYPE_ONE 1
+#define RHS_TYPE_THREE 3
+#define RHS_LOG_AUX 16
+
+#define NO_EXIT 1 //any other exit type runs until t_max
+
+#define SOLVER_EULER 0
+#define SOLVER_RK4 1
+#define SOLVER_CASH_KARP 2
+#define SOLVER_DORMAND_PRINCE 3
+
+#define SOLVE_MAX_STEPS -2
+
+typedef int (*sat_output_callback)(void *data, double t, const double row[], int width);
+
+typedef struct sat_solve_options {
+    int rhs_type;
+    int method;
+    int exit_type;
+    double t_max;
+    double h;
+    double atol;
+    double rtol;
+    double h_min;
+    long long max_steps;
+    double aux_limit;
+    int timing;
+    int trace_interval;
+    const char *trace_path;
+    int output_interval;
+    int output_mode;
+    int output_spins;
+    long long output_capacity;
+    double *output;
+    const char *output_path;
+    sat_output_callback output_callback;
+    void *output_data;
+    double checkpoint_interval;
+    const char *checkpoint_path;
+    const char *resume_path;
+    unsigned long long seed;
+    int finish_threshold;
+    long long finish_flips;
+    double finish_noise;
+} sat_solve_options;
+
+typedef struct sat_solve_stats {
+    int status;
+    double t;
+    long long accepted_steps;
+    long long rejected_steps;
+    long long rhs_evaluations;
+    double h_min;
+    double h_max;
+    double h_last;
+    long long renormalisations;
+    long long flips;
+    long long rhs_cycles;
+    long long exit_cycles;
+    long long cycles;
+    long long output_rows;
+    long long output_first;
+    long long output_stride;
+    long long checkpoints;
+    long long searches;
+    long long search_flips;
+    int search_unsatisfied;
+    int search_solved;
+} sat_solve_stats;
+
+sat_problem *sat_problem_create(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[]);
+void sat_problem_destroy(sat_problem *problem);
+int sat_problem_variables(sat_problem *problem);
+int sat_problem_clauses(sat_problem *problem);
+int sat_problem_literals(sat_problem *problem);
+void sat_problem_export(sat_problem *problem, int clause_offsets[], int literal_variables[], int literal_signs[]);
+sat_problem *sat_problem_preprocess(const sat_problem *problem, const sat_preprocess_options *options,
+                                    sat_reconstruction **reconstruction, sat_preprocess_stats *stats);
+void sat_reconstruct(const sat_reconstruction *reconstruction, const double s[], double full[]);
+void sat_reconstruction_destroy(sat_reconstruction *reconstruction);
+int sat_problem_set_threads(sat_problem *problem, int threads);
+long long sat_problem_check_packed(sat_problem *problem, long long count, const uint64_t assignments[], uint64_t satisfied[]);
+int sat_solve(sat_problem *problem, const sat_solve_options *options, double y[], sat_solve_stats *stats);
+int sat_checkpoint_info(sat_problem *problem, const char *path, unsigned long long *seed, sat_solve_stats *stats);
+long long sat_problem_enumerate(sat_problem *problem, uint64_t first, uint64_t last, uint64_t solutions[], long long capacity, uint64_t *next);
+
+//Largest number of variables of the random instances (their models are found by brute force)
+#define CHECK_MAX_N 12
+#define CHECK_MAX_LITERALS 1024
+
+typedef struct check_instance {
+    int N;
+    int M;
+    int clause_offsets[CHECK_MAX_LITERALS + 1];
+    int literal_variables[CHECK_MAX_LITERALS];
+    int literal_signs[CHECK_MAX_LITERALS];
+} check_instance;
+
+static uint64_t check_state;
+
+static uint64_t check_random(void){
+    check_state ^= check_state << 13;
+    check_state ^= check_state >> 7;
+    check_state ^= check_state << 17;
+    return check_state;
+}
+
+static int check_below(int bound){
+    return (int)(check_random() % (uint64_t)bound);
+}
+
+//Random clauses of 1 to 5 literals, variables may repeat inside a clause
+static void random_instance(check_instance *instance){
+    static const int ratios[4] = {1, 2, 4, 6};
+    int N = 1 + check_below(CHECK_MAX_N - 1);
+    int M = check_below(ratios[check_below(4)] * N + 1);
+    int l = 0;
+    instance->M = 0;
+    instance->clause_offsets[0] = 0;
+    for (int m = 0; m < M && l + 5 <= CHECK_MAX_LITERALS; m++)
+    {
+        int width = 1 + check_below(5);
+        for (int p = 0; p < width; p++)
+        {
+            instance->literal_variables[l] = check_below(N);
+            instance->literal_signs[l++] = check_random() & 1 ? 1 : -1;
+        }
+        instance->clause_offsets[++instance->M] = l;
+    }
+    instance->N = N;
+}
+
+//Whether the signs of s (s_i > 0 is true) satisfy every clause
+static int satisfies(const check_instance *instance, const double s[]){
+    for (int m = 0; m < instance->M; m++)
+    {
+        int satisfied = 0;
+        for (int l = instance->clause_offsets[m]; l < instance->clause_offsets[m+1] && !satisfied; l++)
+        {
+            satisfied = (s[instance->literal_variables[l]] > 0) == (instance->literal_signs[l] > 0);
+        }
+        if (!satisfied) { return 0; }
+    }
+    return 1;
+}
+
+static void assignment_of(int N, uint64_t bits, double s[]){
+    for (int i = 0; i < N; i++)
+    {
+        s[i] = bits >> i & 1 ? 1.0 : -1.0;
+    }
+}
+
+static int has_model(const check_instance *instance){
+    double s[CHECK_MAX_N];
+    for (uint64_t bits = 0; bits < (uint64_t)1 << instance->N; bits++)
+    {
+        assignment_of(instance->N, bits, s);
+        if (satisfies(instance, s)) { return 1; }
+    }
+    return 0;
+}
+
+//Preprocessing soundness: the simplified problem is satisfiable exactly if the original one is, and
+//every model of it is reconstructed to a model of the original, for every combination of the options
+static int check_preprocess(int instances){
+    int failures = 0;
+    int checked = 0;
+    for (int trial = 0; trial < instances; trial++)
+    {
+        check_instance instance = {0};
+        random_instance(&instance);
+        sat_problem *problem = sat_problem_create(instance.N, instance.M, instance.clause_offsets, instance.literal_variables, instance.literal_signs);
+        if (!problem) { return failures + 1; }
+        int satisfiable = has_model(&instance);
+        for (int flags = 0; flags < 16; flags++)
+        {
+            sat_preprocess_options options = {flags & 1, flags >> 1 & 1, flags >> 2 & 1, flags >> 3 & 1, 4 + check_below(16), check_below(4), check_below(3)};
+            sat_reconstruction *reconstruction = NULL;
+            sat_preprocess_stats stats;
+            sat_problem *simplified = sat_problem_preprocess(problem, &options, &reconstruction, &stats);
+            checked++;
+            if (!simplified){
+                failures += stats.status != PREPROCESS_UNSATISFIABLE || satisfiable;
+                continue;
+            }
+            check_instance reduced = {0};
+            reduced.N = sat_problem_variables(simplified);
+            reduced.M = sat_problem_clauses(simplified);
+            if (reduced.M > CHECK_MAX_LITERALS || sat_problem_literals(simplified) > CHECK_MAX_LITERALS){
+                failures++;
+                sat_reconstruction_destroy(reconstruction);
+                sat_problem_destroy(simplified);
+                continue;
+            }
+            sat_problem_export(simplified, reduced.clause_offsets, reduced.literal_variables, reduced.literal_signs);
+            int found = 0;
+            double s[CHECK_MAX_N];
+            double full[CHECK_MAX_N];
+            for (uint64_t bits = 0; bits < (uint64_t)1 << reduced.N; bits++)
+            {
+                assignment_of(reduced.N, bits, s);
+                if (!satisfies(&reduced, s)) { continue; }
+                found = 1;
+                sat_reconstruct(reconstruction, s, full);
+                if (!satisfies(&instance, full)){
+                    failures++;
+                    break;
+                }
+            }
+            failures += stats.status != PREPROCESS_DONE || found != satisfiable;
+            sat_reconstruction_destroy(reconstruction);
+            sat_problem_destroy(simplified);
+        }
+        sat_problem_destroy(problem);
+    }
+    printf("preprocess: %d preprocessed instances, %d failures\n", checked, failures);
+    return failures;
+}
+
+//Enumeration order and bounds: sat_problem_enumerate returns exactly the models numbered in [first, last)
+//in ascending order (bit N-1-i is variable i), resumes at *next when the capacity runs out, and the packed
+//checker agrees with the models bit for bit
+static int check_enumeration(int instances){
+    int failures = 0;
+    uint64_t models[(size_t)1 << CHECK_MAX_N];
+    uint64_t solutions[(size_t)1 << CHECK_MAX_N];
+    uint64_t assignments[CHECK_MAX_N * ((1 << CHECK_MAX_N) / 64)];
+    uint64_t satisfied[(1 << CHECK_MAX_N) / 64];
+    for (int trial = 0; trial < instances; trial++)
+    {
+        check_instance instance = {0};
+        random_instance(&instance);
+        int N = instance.N;
+        uint64_t total = (uint64_t)1 << N;
+        sat_problem *problem = sat_problem_create(N, instance.M, instance.clause_offsets, instance.literal_variables, instance.literal_signs);
+        if (!problem) { return failures + 1; }
+        sat_problem_set_threads(problem, 1 + trial % 3);
+        long long count = 0;
+        double s[CHECK_MAX_N];
+        for (uint64_t number = 0; number < total; number++)
+        {
+            for (int i = 0; i < N; i++)
+            {
+                s[i] = number >> (N-1-i) & 1 ? 1.0 : -1.0;
+            }
+            if (satisfies(&instance, s)) { models[count++] = number; }
+        }
+        uint64_t first = check_random() % (total + 1);
+        uint64_t last = first + check_random() % (total + 2 - first);   //up to total + 1, beyond the range
+        long long capacity = 1 + check_below(8);
+        long long expected = 0;
+        long long found = 0;
+        for (long long k = 0; k < count; k++)
+        {
+            expected += models[k] >= first && models[k] < last;
+        }
+        uint64_t next = first;
+        for (int chunks = 0; chunks <= (int)total + 1; chunks++)
+        {
+            long long written = sat_problem_enumerate(problem, next, last, solutions + found, capacity, &next);
+            if (written < 0 || written > capacity) { break; }
+            found += written;
+            if (written < capacity) { break; }
+        }
+        int wrong = found != expected || next != (last < total ? last : total);
+        for (long long k = 0, j = 0; k < count && !wrong; k++)
+        {
+            if (models[k] >= first && models[k] < last) { wrong = solutions[j++] != models[k]; }
+        }
+        //assignment a of the packed checker is number a, variable i is bit N-1-i
+        size_t words = (size_t)(total + 63) / 64;
+        memset(assignments, 0, (size_t)N * words * sizeof(uint64_t));
+        for (uint64_t number = 0; number < total; number++)
+        {
+            for (int i = 0; i < N; i++)
+            {
+                assignments[i * words + number / 64] |= (number >> (N-1-i) & 1) << (number % 64);
+            }
+        }
+        long long checked = sat_problem_check_packed(problem, (long long)total, assignments, satisfied);
+        wrong |= checked != count;
+        for (long long k = 0; k < count && !wrong; k++)
+        {
+            wrong = !(satisfied[models[k] / 64] >> (models[k] % 64) & 1);
+        }
+        failures += wrong;
+        sat_problem_destroy(problem);
+    }
+    printf("enumeration: %d instances, %d failures\n", instances, failures);
+    return failures;
+}
+
+#define CHECK_CHECKPOINT "check_native.ckp"
+
+//Checkpoint round trip: a solve stopped at max_steps (which writes the final checkpoint) and resumed from
+//the file ends in the same state and step counts, bit for bit, as one uninterrupted solve, for every method
+//with plain and log-domain aux variables, aux renormalisation and the local search finishing stage
+static int check_checkpoint(void){
+    enum { N = 60, M = 250 };
+    check_instance instance = {0};
+    double planted[N];
+    for (int i = 0; i < N; i++)
+    {
+        planted[i] = check_random() & 1 ? 1.0 : -1.0;
+    }
+    instance.N = N;
+    while (instance.M < M)
+    {
+        int l = instance.clause_offsets[instance.M];
+        for (int p = 0; p < 3; p++)
+        {
+            instance.literal_variables[l + p] = check_below(N);
+            instance.literal_signs[l + p] = check_random() & 1 ? 1 : -1;
+        }
+        instance.clause_offsets[instance.M + 1] = l + 3;
+        instance.M++;
+        if (!satisfies(&instance, planted)) { instance.M--; }
+    }
+    sat_problem *problem = sat_problem_create(N, M, instance.clause_offsets, instance.literal_variables, instance.literal_signs);
+    if (!problem) { return 1; }
+    double initial[N + M];
+    double whole[N + M];
+    double resumed[N + M];
+    int failures = 0;
+    int runs = 0;
+    for (int method = SOLVER_EULER; method <= SOLVER_DORMAND_PRINCE; method++)
+    {
+        for (int variant = 0; variant < 4; variant++)
+        {
+            sat_solve_options options = {0};
+            options.rhs_type = variant & 1 ? RHS_TYPE_ONE | RHS_LOG_AUX : variant & 2 ? RHS_TYPE_THREE : RHS_TYPE_ONE;
+            options.method = method;
+            options.exit_type = variant == 2 ? NO_EXIT : 0;
+            options.t_max = 1e9;
+            options.h = method <= SOLVER_RK4 ? 0.02 : 0.0;
+            options.atol = 1e-6;
+            options.rtol = 1e-3;
+            options.h_min = 1e-12;
+            options.aux_limit = variant == 2 ? 4.0 : 0.0;
+            options.finish_threshold = variant == 3 ? 4 : 0;
+            options.finish_flips = 200;
+            options.finish_noise = 0.5;
+            options.seed = 12345 + (unsigned long long)variant;
+            for (int i = 0; i < N + M; i++)
+            {
+                initial[i] = i < N ? 2.0 * (double)(check_random() >> 11) / 9007199254740992.0 - 1.0 : variant & 1 ? 0.0 : 1.0;
+            }
+            sat_solve_stats first, second, reference;
+            memcpy(whole, initial, sizeof(whole));
+            options.max_steps = 1500;
+            sat_solve(problem, &options, whole, &reference);
+            memcpy(resumed, initial, sizeof(resumed));
+            options.max_steps = 1 + reference.accepted_steps / 2;
+            options.checkpoint_path = CHECK_CHECKPOINT;
+            sat_solve(problem, &options, resumed, &first);
+            unsigned long long seed = 0;
+            sat_solve_stats saved;
+            int info = sat_checkpoint_info(problem, CHECK_CHECKPOINT, &seed, &saved);
+            options.max_steps = 1500;
+            options.checkpoint_path = NULL;
+            options.resume_path = CHECK_CHECKPOINT;
+            memset(resumed, 0, sizeof(resumed));
+            sat_solve(problem, &options, resumed, &second);
+            remove(CHECK_CHECKPOINT);
+            runs++;
+            //the first half has to stop early, otherwise nothing is resumed
+            if (first.status != SOLVE_MAX_STEPS || info != 0 || seed != options.seed || saved.accepted_steps != first.accepted_steps
+                || second.status != reference.status || second.t != reference.t || second.accepted_steps != reference.accepted_steps
+                || second.rejected_steps != reference.rejected_steps || second.rhs_evaluations != reference.rhs_evaluations
+                || second.renormalisations != reference.renormalisations || second.flips != reference.flips
+                || second.searches != reference.searches || memcmp(resumed, whole, sizeof(whole))){
+                printf("checkpoint: method %d variant %d differs after resuming at step %lld\n", method, variant, first.accepted_steps);
+                failures++;
+            }
+        }
+    }
+    sat_problem_destroy(problem);
+    printf("checkpoint: %d resumed solves, %d failures\n", runs, failures);
+    return failures;
+}
+
+int main(int argc, char *argv[]){
+    check_state = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+    if (!check_state) { check_state = 1; }
+    int failures = 0;
+    failures += check_preprocess(300) > 0;
+    failures += check_enumeration(300) > 0;
+    failures += check_checkpoint() > 0;
+    return failures;
+}
@@ -0,0 +1,42 @@
+#########################################
+#                                       #
+# Boolean satisfiability problem solver #
+#   mixed precision parity benchmark    #
+#                                       #
+#########################################
+
+# Runs the same random restarts of planted random 3-SAT problems with the double and the mixed precision
+# (RHS_MIXED_PRECISION) native kernels and compares the fraction of solved trajectories, the median
+# solution time and the wall time of the batch. Run from the repository root after building c_libs/cSAT.so:
+#     python3 benchmarks/precision_parity.py [so_file_name]
+
+import sys
+import time
+sys.path.insert(0, '.')
+
+import numpy as np
+from pySAT import SAT, CTD, RHS_TYPE_ONE, RHS_TYPE_THREE, RHS_LOG_AUX, ORTANT
+
+so_file_name = sys.argv[1] if len(sys.argv) > 1 else 'c_libs/cSAT.so'
+restarts = 64
+t_max = 60
+
+print('%6s %5s %11s | %-28s | %-28s' % ('N', 'alpha', 'rhs type', 'double: solved, t_50, wall', 'mixed: solved, t_50, wall'))
+for n, alpha in ((50, 4.0), (100, 4.1), (200, 4.1), (500, 4.0)):
+    for rhs_type in (RHS_TYPE_ONE, RHS_TYPE_THREE, RHS_TYPE_ONE | RHS_LOG_AUX):
+        problem = SAT(None, so_file_name, n=n, alpha=alpha, rhs_type=rhs_type, seed=n, planted=True)
+        N, M = problem.number_of_variables, problem.number_of_clauses
+        generator = np.random.default_rng(1)
+        initial_states = np.empty((restarts, N+M))
+        initial_states[:, :N] = generator.uniform(-1, 1, (restarts, N))
+        initial_states[:, N:] = 0.0 if rhs_type & RHS_LOG_AUX else 1.0
+        solver = CTD(problem)
+        columns = []
+        for mixed_precision in (False, True):
+            start = time.perf_counter()
+            times, _ = solver.batch_solve(initial_states, t_max, exit_type=ORTANT, solver_type='native_RK45', mixed_precision=mixed_precision)
+            wall = time.perf_counter() - start
+            solved = np.isfinite(times)
+            median = np.median(times[solved]) if solved.any() else np.nan
+            columns.append('%3d/%-3d %8.2f %8.2fs' % (solved.sum(), restarts, median, wall))
+        print('%6d %5.2f %11d | %-28s | %-28s' % (N, alpha, rhs_type, columns[0], columns[1]))
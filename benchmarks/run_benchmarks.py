@@ -0,0 +1,144 @@
+#########################################
+#                                       #
+# Boolean satisfiability problem solver #
+#        benchmark driver               #
+#                                       #
+#########################################
+
+# Runs the kernel microbenchmarks (bench_kernels, see bench_kernels.c) and an end-to-end benchmark of the native
+# solver over the cnf files of a directory, grouped by N and alpha, and writes the results as JSON.
+# Run from the repository root after building c_libs/cSAT.so (and benchmarks/bench_kernels for the kernel part):
+#     python3 benchmarks/run_benchmarks.py --output benchmark.json
+# Reported per group: ns per rhs evaluation (kernels and end-to-end), steps per second, rhs evaluations per solve
+# and percentiles of the time to solution (analog and wall clock) of the solved restarts.
+
+import argparse
+import json
+import os
+import platform
+import subprocess
+import sys
+import time
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import numpy as np
+from pySAT import SAT, CTD, NATIVE_SOLVERS, ORTANT, SOLVE_EXIT
+
+PERCENTILES = (10, 25, 50, 75, 90)
+
+def cnf_header(path):
+    """Number of variables and clauses from the problem line of a DIMACS file, None if there is none"""
+    with open(path) as cnf_file:
+        for line in cnf_file:
+            fields = line.split()
+            if fields and fields[0] == 'p' and len(fields) >= 4:
+                return int(fields[2]), int(fields[3])
+    return None
+
+def percentiles(values):
+    if len(values) == 0:
+        return None
+    return {'p' + str(q): float(elem) for q, elem in zip(PERCENTILES, np.percentile(values, PERCENTILES))}
+
+def kernel_benchmarks(files, arguments):
+    """ns per call of every kernel per file (bench_kernels output), empty if the binary is not built"""
+    if not os.path.isfile(arguments.bench_kernels):
+        print('no ' + arguments.bench_kernels + ', skipping the kernel benchmarks', file=sys.stderr)
+        return {}
+    command = [arguments.bench_kernels, '-s', str(arguments.kernel_seconds), '-t', str(arguments.threads)] + files
+    output = subprocess.run(command, stdout=subprocess.PIPE, check=False, universal_newlines=True).stdout
+    return {elem['file']: elem['kernels'] for elem in json.loads(output)['instances']}
+
+def solve_benchmark(path, arguments, generator):
+    """One native solve per restart from random spins, returns a record per trajectory"""
+    problem = SAT(path, arguments.so_file_name, rhs_type=arguments.rhs_type)
+    if arguments.threads > 1:
+        problem.set_threads(arguments.threads)
+    records = []
+    for _ in range(arguments.restarts):
+        solver = CTD(problem, initial_s=generator.uniform(-1, 1, problem.number_of_variables))
+        start = time.perf_counter()
+        solver.native_solve(arguments.t_max, ORTANT, NATIVE_SOLVERS[arguments.solver], arguments.atol, arguments.rtol,
+                            max_steps=arguments.max_steps, mixed_precision=arguments.mixed_precision, timing=True,
+                            finish_threshold=arguments.finish_threshold)
+        wall = time.perf_counter() - start
+        stats = solver.stats
+        records.append({'solved': stats['status'] == SOLVE_EXIT, 't': stats['t'], 'wall': wall, 'accepted_steps': stats['accepted_steps'],
+                        'rejected_steps': stats['rejected_steps'], 'rhs_evaluations': stats['rhs_evaluations'],
+                        'rhs_seconds': stats['rhs_seconds'], 'exit_check_seconds': stats['exit_check_seconds'],
+                        'search_solved': bool(stats['search_solved'])})
+    problem.destroy_problem_handle()
+    return records
+
+def summarise(instances, kernels):
+    records = [elem for instance in instances for elem in instance['trajectories']]
+    solved = [elem for elem in records if elem['solved']]
+    wall = sum(elem['wall'] for elem in records)
+    evaluations = sum(elem['rhs_evaluations'] for elem in records)
+    steps = sum(elem['accepted_steps'] for elem in records)
+    summary = {'instances': len(instances),
+               'trajectories': len(records),
+               'solved_fraction': len(solved) / len(records) if records else None,
+               'solved_by_search_fraction': sum(elem['search_solved'] for elem in solved) / len(solved) if solved else None,
+               'steps_per_second': steps / wall if wall > 0 else None,
+               'ns_per_rhs_evaluation': 1e9 * wall / evaluations if evaluations else None,
+               'rhs_evaluations_per_solve': float(np.mean([elem['rhs_evaluations'] for elem in solved])) if solved else None,
+               'rhs_time_fraction': sum(elem['rhs_seconds'] for elem in records) / wall if wall > 0 else None,
+               'exit_check_time_fraction': sum(elem['exit_check_seconds'] for elem in records) / wall if wall > 0 else None,
+               'rejection_rate': sum(elem['rejected_steps'] for elem in records) / max(1, steps + sum(elem['rejected_steps'] for elem in records)),
+               'time_to_solution': percentiles([elem['t'] for elem in solved]),
+               'wall_time_to_solution': percentiles([elem['wall'] for elem in solved])}
+    timed = [kernels[instance['file']] for instance in instances if instance['file'] in kernels]
+    if timed:
+        names = sorted(set(name for elem in timed for name in elem))
+        summary['kernels_ns_per_call'] = {name: float(np.mean([elem[name]['ns_per_call'] for elem in timed if name in elem])) for name in names}
+    return summary
+
+def main():
+    parser = argparse.ArgumentParser(description='rhs throughput and time-to-solution benchmarks of pySAT')
+    parser.add_argument('--problems', default='SAT_problems', help='directory of the cnf files')
+    parser.add_argument('--so-file-name', dest='so_file_name', default=os.path.join('c_libs', 'cSAT.so'))
+    parser.add_argument('--bench-kernels', dest='bench_kernels', default=os.path.join('benchmarks', 'bench_kernels'))
+    parser.add_argument('--output', default='benchmark.json')
+    parser.add_argument('--restarts', type=int, default=16, help='random restarts per instance')
+    parser.add_argument('--t-max', dest='t_max', type=float, default=50.0)
+    parser.add_argument('--max-steps', dest='max_steps', type=int, default=0)
+    parser.add_argument('--solver', default='native_RK45', choices=sorted(NATIVE_SOLVERS))
+    parser.add_argument('--atol', type=float, default=0.000001)
+    parser.add_argument('--rtol', type=float, default=0.001)
+    parser.add_argument('--rhs-type', dest='rhs_type', type=int, default=1)
+    parser.add_argument('--mixed-precision', dest='mixed_precision', action='store_true')
+    parser.add_argument('--finish-threshold', dest='finish_threshold', type=int, default=0,
+                        help='unsatisfied clauses below which the local search finishing stage runs (0: off)')
+    parser.add_argument('--threads', type=int, default=1)
+    parser.add_argument('--kernel-seconds', dest='kernel_seconds', type=float, default=0.2, help='time budget per kernel and file')
+    parser.add_argument('--seed', type=int, default=1)
+    arguments = parser.parse_args()
+
+    files = []
+    for name in sorted(os.listdir(arguments.problems)):
+        path = os.path.join(arguments.problems, name)
+        if name.endswith('.cnf') and os.path.isfile(path) and cnf_header(path):
+            files.append(path)
+    kernels = kernel_benchmarks(files, arguments)
+    generator = np.random.default_rng(arguments.seed)
+    groups = {}
+    for path in files:
+        N, M = cnf_header(path)
+        groups.setdefault((N, round(M / N, 2)), []).append({'file': path, 'trajectories': solve_benchmark(path, arguments, generator)})
+
+    results = {'benchmark': 'pySAT',
+               'settings': vars(arguments),
+               'machine': {'platform': platform.platform(), 'processor': platform.processor(), 'python': platform.python_version()},
+               'groups': [dict({'N': N, 'alpha': alpha}, **summarise(groups[(N, alpha)], kernels)) for N, alpha in sorted(groups)],
+               'instances': [dict(instance, kernels=kernels.get(instance['file'])) for key in sorted(groups) for instance in groups[key]]}
+    with open(arguments.output, 'w') as output:
+        json.dump(results, output, indent=1)
+    print('%6s %7s %9s %7s %14s %12s %10s' % ('N', 'alpha', 'instances', 'solved', 'ns/rhs (e2e)', 'steps/s', 't_50'))
+    for group in results['groups']:
+        median = group['time_to_solution']['p50'] if group['time_to_solution'] else float('nan')
+        print('%6d %7.2f %9d %7.2f %14.0f %12.0f %10.2f' % (group['N'], group['alpha'], group['instances'], group['solved_fraction'],
+              group['ns_per_rhs_evaluation'] or float('nan'), group['steps_per_second'] or float('nan'), median))
+
+if __name__ == '__main__':
+    main()
@@ -6,11 +6,62 @@
  *                                                *
  *  to compile use:                               *
  *  cc -std=c99 -fPIC -shared -o cSAT.so cSAT.c   *
+ *     -lm                                        *
+ *  add -fopenmp for the multi-threaded kernels   *
  *                                                */
 
+#if !defined(_POSIX_C_SOURCE) && (defined(__unix__) || defined(__APPLE__))
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SAT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//Constants (same values as in pySAT.py)
+
+#define RHS_TYPE_ONE 1
+#define RHS_TYPE_TWO 2
+#define RHS_TYPE_THREE 3
+#define RHS_TYPE_FOUR 4
+#define RHS_TYPE_FIVE 5
+#define RHS_LOG_AUX 16      //flag added to the rhs type: the aux part of the state is ln a_m instead of a_m
+#define RHS_MIXED_PRECISION 32  //flag added to the rhs type: spins and clause factors in float, aux and sums in double
+
 
 //Helper functions (not to be called from outside)
 
+//Number of literals k_m of clause m
+int clause_width(int m, int c[], int number_of_variables){
+    int literals = 0;
+    for (int j = 0; j < number_of_variables; j++)
+    {
+        literals += c[m*number_of_variables + j] != 0;
+    }
+    return literals;
+}
+
 double k_mi(int m, int i, double s[], int c[], int number_of_variables){
     double productum = 1.0;
     for (int j = 0; j < number_of_variables; j++)
@@ -19,7 +70,7 @@ double k_mi(int m, int i, double s[], int c[], int number_of_variables){
             productum *= (1 - c[m*number_of_variables + j] * s[j]);
         }
     }    
-    return 0.125 * productum; // only for 3SAT 0.125 = 2^-3
+    return ldexp(productum, -clause_width(m, c, number_of_variables)); // 2^-k_m
 }
 
 double k_mi_K_m(int m, int i, double s[], int c[], int number_of_variables){
@@ -33,7 +84,7 @@ double K_m(int m, double s[], int c[], int number_of_variables){
     {   
             productum *= (1 - c[m*number_of_variables + j] * s[j]);
     }    
-    return 0.125 * productum; // only for 3SAT 0.125 = 2^-3
+    return ldexp(productum, -clause_width(m, c, number_of_variables)); // 2^-k_m
 }
 
 double gradV_i(int i, double s[], double a[], int c[], int number_of_variables, int number_of_clauses){
@@ -51,7 +102,126 @@ double K_m_squared(int m, double s[], int c[], int number_of_variables){
     {   
             productum *= (1 - c[m*number_of_variables + j] * s[j]);
     }    
-    return 0.125 * 0.125 * productum*productum;
+    double weight = ldexp(1.0, -clause_width(m, c, number_of_variables));
+    return weight * weight * productum*productum;
+}
+
+//Fused clause kernels (not to be called from outside)
+//Both kernels visit every clause once: the factors (1 - c_mi s_i) are multiplied into K_m, the
+//leave-one-out products are recovered as k_mi = K_m / (1 - c_mi s_i), and the gradient terms
+//2 a_m c_mi (1 - c_mi s_i) k_mi^2 = 2 a_m c_mi K_m k_mi are scattered into ds. If any factor
+//of a clause is exactly zero then K_m and every gradient term of the clause vanish, so the
+//division is never needed in that case. K_m is written to K[m].
+
+void clause_terms_dense(int N, int M, int c[], double s[], double a[], double ds[], double K[]){
+    for (int i = 0; i < N; i++)
+    {
+        ds[i] = 0.0;
+    }
+    for (int m = 0; m < M; m++)
+    {
+        int *row = c + m*N;
+        double productum = 1.0;
+        int literals = 0;
+        for (int j = 0; j < N; j++)
+        {
+            productum *= (1 - row[j] * s[j]);
+            literals += row[j] != 0;
+        }
+        K[m] = ldexp(productum, -literals); // 2^-k_m
+        if (productum == 0.0) { continue; }
+        for (int j = 0; j < N; j++)
+        {
+            if (row[j] != 0){
+                ds[j] += 2*a[m]*row[j]*K[m]*K[m] / (1 - row[j] * s[j]);
+            }
+        }
+    }
+}
+
+//Sparse clause representation
+//Clause m owns the literals clause_offsets[m] ... clause_offsets[m+1]-1,
+//literal l refers to variable literal_variables[l] (0-based) with sign literal_signs[l] (+1 or -1)
+
+//Adds the gradient terms of the clauses m_begin ... m_end-1 to ds
+void clause_range_sparse(int m_begin, int m_end, int clause_offsets[], int literal_variables[], int literal_signs[], double s[], double a[], double ds[], double K[]){
+    for (int m = m_begin; m < m_end; m++)
+    {
+        double productum = 1.0;
+        for (int l = clause_offsets[m]; l < clause_offsets[m+1]; l++)
+        {
+            productum *= (1 - literal_signs[l] * s[literal_variables[l]]);
+        }
+        K[m] = ldexp(productum, clause_offsets[m] - clause_offsets[m+1]); // 2^-k_m
+        if (productum == 0.0) { continue; }
+        for (int l = clause_offsets[m]; l < clause_offsets[m+1]; l++)
+        {
+            int i = literal_variables[l];
+            ds[i] += 2*a[m]*literal_signs[l]*K[m]*K[m] / (1 - literal_signs[l] * s[i]);
+        }
+    }
+}
+
+//Adds the gradient terms of the clauses clause_list[begin] ... clause_list[end-1] to ds
+void clause_list_sparse(const int clause_list[], int begin, int end, int clause_offsets[], int literal_variables[], int literal_signs[], double s[], double a[], double ds[], double K[]){
+    for (int index = begin; index < end; index++)
+    {
+        int m = clause_list[index];
+        clause_range_sparse(m, m+1, clause_offsets, literal_variables, literal_signs, s, a, ds, K);
+    }
+}
+
+void clause_terms_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], double s[], double a[], double ds[], double K[]){
+    for (int i = 0; i < N; i++)
+    {
+        ds[i] = 0.0;
+    }
+    clause_range_sparse(0, M, clause_offsets, literal_variables, literal_signs, s, a, ds, K);
+}
+
+//Spin bias term of rhs types three to five: 0.5*pi*b*alpha*<a>*sin(pi*s_i), with b = 0.0725
+void add_sin_bias(int N, int M, double s[], double a[], double ds[]){
+    if (M == 0) { return; }
+    double b = 0.0725;
+    double a_mean = 0.0;
+    for (int m = 0; m < M; m++)
+    {
+        a_mean += a[m];
+    }
+    a_mean /= M;
+    double constant = 0.5*M_PI*b*((double)M/N)*a_mean;
+    for (int i = 0; i < N; i++)
+    {
+        ds[i] += constant*sin(M_PI*s[i]);
+    }
+}
+
+//Turns the clause terms (gradient in result[0:N], K_m in result[N:N+M]) into the rhs of the given type.
+//With RHS_LOG_AUX the aux part is d ln a_m/dt = (da_m/dt)/a_m, a still holds the aux variables themselves
+void finish_rhs(int N, int M, int rhs_type, double s[], double a[], double result[]){
+    int log_aux = rhs_type & RHS_LOG_AUX;
+    rhs_type &= ~(RHS_LOG_AUX | RHS_MIXED_PRECISION);
+    if (rhs_type == RHS_TYPE_THREE || rhs_type == RHS_TYPE_FOUR || rhs_type == RHS_TYPE_FIVE){
+        add_sin_bias(N, M, s, a, result);
+    }
+    if (rhs_type == RHS_TYPE_TWO || rhs_type == RHS_TYPE_THREE){
+        for (int m = 0; m < M; m++)
+        {
+            result[N+m] *= (log_aux ? 1.0 : a[m]) * result[N+m];
+        }
+    }
+    else if (!log_aux){
+        for (int m = 0; m < M; m++)
+        {
+            result[N+m] *= a[m];
+        }
+    }
+    if (rhs_type == RHS_TYPE_FIVE){
+        for (int i = 0; i < N+M; i++)
+        {
+            result[i] = -result[i];
+        }
+    }
 }
 
 //To be called from python
@@ -59,144 +229,4620 @@ double K_m_squared(int m, double s[], int c[], int number_of_variables){
 void rhs1(int N, int M, int c[], double y[], double result[]){
     double *s = y;
     double *a = y + N;
-    for (int i = 0; i < N; i++)
+    clause_terms_dense(N, M, c, s, a, result, result + N);
+    for (int m = 0; m < M; m++)
     {
-        result[i] = gradV_i(i, s, a, c, N, M);
+        result[N+m] *= a[m];
     }
-    for (int i = N; i < N+M; i++)
+}
+
+void rhs2(int N, int M, int c[], double y[], double result[]){
+    double *s = y;
+    double *a = y + N;
+    clause_terms_dense(N, M, c, s, a, result, result + N);
+    for (int m = 0; m < M; m++)
     {
-        result[i] = y[i] * K_m(i-N, s, c, N);
+        result[N+m] *= a[m] * result[N+m];
     }
 }
 
-void rhs2(int N, int M, int c[], double y[], double result[]){
+void rhs3(int N, int M, int c[], double y[], double result[]){
     double *s = y;
     double *a = y + N;
-    for (int i = 0; i < N; i++)
+    clause_terms_dense(N, M, c, s, a, result, result + N);
+    add_sin_bias(N, M, s, a, result);
+    for (int m = 0; m < M; m++)
     {
-        result[i] = gradV_i(i, s, a, c, N, M);
+        result[N+m] *= a[m] * result[N+m];
     }
-    for (int i = N; i < N+M; i++)
+}
+
+void rhs4(int N, int M, int c[], double y[], double result[]){
+    double *s = y;
+    double *a = y + N;
+    clause_terms_dense(N, M, c, s, a, result, result + N);
+    add_sin_bias(N, M, s, a, result);
+    for (int m = 0; m < M; m++)
     {
-        result[i] = y[i] * K_m_squared(i-N, s, c, N);
+        result[N+m] *= a[m];
     }
 }
 
-void jacobian1(int N, int M, int c[], double y[], double result[]){
+void rhs5(int N, int M, int c[], double y[], double result[]){
+    rhs4(N, M, c, y, result);
+    for (int i = 0; i < N+M; i++)
+    {
+        result[i] = -result[i];
+    }
+}
+
+void rhs1_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], double y[], double result[]){
     double *s = y;
     double *a = y + N;
-    //J11
-    for (int i = 0; i < N; i++)
+    clause_terms_sparse(N, M, clause_offsets, literal_variables, literal_signs, s, a, result, result + N);
+    for (int m = 0; m < M; m++)
     {
-        for (int j = 0; j < N; j++)
+        result[N+m] *= a[m];
+    }
+}
+
+void rhs2_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], double y[], double result[]){
+    double *s = y;
+    double *a = y + N;
+    clause_terms_sparse(N, M, clause_offsets, literal_variables, literal_signs, s, a, result, result + N);
+    for (int m = 0; m < M; m++)
+    {
+        result[N+m] *= a[m] * result[N+m];
+    }
+}
+
+void rhs3_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], double y[], double result[]){
+    double *s = y;
+    double *a = y + N;
+    clause_terms_sparse(N, M, clause_offsets, literal_variables, literal_signs, s, a, result, result + N);
+    add_sin_bias(N, M, s, a, result);
+    for (int m = 0; m < M; m++)
+    {
+        result[N+m] *= a[m] * result[N+m];
+    }
+}
+
+void rhs4_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], double y[], double result[]){
+    double *s = y;
+    double *a = y + N;
+    clause_terms_sparse(N, M, clause_offsets, literal_variables, literal_signs, s, a, result, result + N);
+    add_sin_bias(N, M, s, a, result);
+    for (int m = 0; m < M; m++)
+    {
+        result[N+m] *= a[m];
+    }
+}
+
+void rhs5_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], double y[], double result[]){
+    rhs4_sparse(N, M, clause_offsets, literal_variables, literal_signs, y, result);
+    for (int i = 0; i < N+M; i++)
+    {
+        result[i] = -result[i];
+    }
+}
+
+//Fixed width clause groups
+//Clauses with 2 ... GROUP_MAX_WIDTH literals are sorted into one group per width, wider clauses
+//and unit clauses go to the generic kernel. The literals of the clauses of a group are stored as
+//structure of arrays: literal p of the t-th clause of the group is variables[p*count + t] with
+//sign signs[p*count + t]
+
+#define GROUP_MAX_WIDTH 7
+
+#define SIMD_SCALAR 0
+#define SIMD_AVX2 1
+#define SIMD_AVX512 2
+
+typedef struct clause_group {
+    int count;
+    int *clauses;           //clause index of every member
+    int *variables;
+    double *signs;
+    float *signs_single;    //the same signs for the mixed precision kernels
+} clause_group;
+
+struct sat_problem;
+typedef void (*group_kernel)(const clause_group *group, int begin, int end, double s[], double a[], double ds[], double K[]);
+typedef void (*mixed_kernel)(const clause_group *group, int begin, int end, const float s[], double a[], double ds[], double K[]);
+
+//Kernel for clauses with three literals: K_m = 2^-3 f0 f1 f2 and the gradient terms
+//2 a_m c_p K_m k_mp = 2^-5 a_m c_p f0 f1 f2 (f0 f1 f2 / f_p) use the products of the other two factors,
+//so no division and no special case for vanishing factors is needed
+static void triple_kernel_scalar(const clause_group *group, int begin, int end, double s[], double a[], double ds[], double K[]){
+    int T = group->count;
+    const int *v0 = group->variables, *v1 = v0 + T, *v2 = v1 + T;
+    const double *c0 = group->signs, *c1 = c0 + T, *c2 = c1 + T;
+    for (int t = begin; t < end; t++)
+    {
+        int m = group->clauses[t];
+        double f0 = 1.0 - c0[t] * s[v0[t]];
+        double f1 = 1.0 - c1[t] * s[v1[t]];
+        double f2 = 1.0 - c2[t] * s[v2[t]];
+        double f12 = f1 * f2;
+        double productum = f0 * f12;
+        double scale = 0.03125 * a[m] * productum; // 2*2^-6
+        K[m] = 0.125 * productum;
+        ds[v0[t]] += scale * c0[t] * f12;
+        ds[v1[t]] += scale * c1[t] * (f0 * f2);
+        ds[v2[t]] += scale * c2[t] * (f0 * f1);
+    }
+}
+
+//Vectorised versions (x86 with gcc or clang, selected at runtime): the spin values and aux values
+//are gathered for 4 or 8 clauses at once, the gradient terms are scattered with scalar adds since
+//the lanes may share variables. The arithmetic is the same as in the scalar kernel, so all three
+//give identical results.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SAT_X86_SIMD
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static void triple_kernel_avx2(const clause_group *group, int begin, int end, double s[], double a[], double ds[], double K[]){
+    int T = group->count;
+    const int *v0 = group->variables, *v1 = v0 + T, *v2 = v1 + T;
+    const double *c0 = group->signs, *c1 = c0 + T, *c2 = c1 + T;
+    const __m256d one = _mm256_set1_pd(1.0);
+    double g0[4], g1[4], g2[4], k[4];
+    int t = begin;
+    for (; t + 4 <= end; t += 4)
+    {
+        __m256d s0 = _mm256_i32gather_pd(s, _mm_loadu_si128((const __m128i *)(v0 + t)), 8);
+        __m256d s1 = _mm256_i32gather_pd(s, _mm_loadu_si128((const __m128i *)(v1 + t)), 8);
+        __m256d s2 = _mm256_i32gather_pd(s, _mm_loadu_si128((const __m128i *)(v2 + t)), 8);
+        __m256d am = _mm256_i32gather_pd(a, _mm_loadu_si128((const __m128i *)(group->clauses + t)), 8);
+        __m256d sign0 = _mm256_loadu_pd(c0 + t);
+        __m256d sign1 = _mm256_loadu_pd(c1 + t);
+        __m256d sign2 = _mm256_loadu_pd(c2 + t);
+        __m256d f0 = _mm256_sub_pd(one, _mm256_mul_pd(sign0, s0));
+        __m256d f1 = _mm256_sub_pd(one, _mm256_mul_pd(sign1, s1));
+        __m256d f2 = _mm256_sub_pd(one, _mm256_mul_pd(sign2, s2));
+        __m256d f12 = _mm256_mul_pd(f1, f2);
+        __m256d productum = _mm256_mul_pd(f0, f12);
+        __m256d scale = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(0.03125), am), productum);
+        _mm256_storeu_pd(k, _mm256_mul_pd(_mm256_set1_pd(0.125), productum));
+        _mm256_storeu_pd(g0, _mm256_mul_pd(_mm256_mul_pd(scale, sign0), f12));
+        _mm256_storeu_pd(g1, _mm256_mul_pd(_mm256_mul_pd(scale, sign1), _mm256_mul_pd(f0, f2)));
+        _mm256_storeu_pd(g2, _mm256_mul_pd(_mm256_mul_pd(scale, sign2), _mm256_mul_pd(f0, f1)));
+        for (int j = 0; j < 4; j++)
         {
-            double kronecker_ij = 0.0;
-            if (i == j) { kronecker_ij = 1.0; }
-            double summ = 0;
-            for (int m = 0; m < M; m++)
-            {
-                double prod = 1;
-                for (int l = 0; l < N; l++)
-                {
-                    if (l != i && l != j)
-                    {
-                        prod *= (1-c[m*N + l]*s[l]);
-                    }
-                }
-                //2*2^(-2k); for SAT3 only!!!
-                summ += 0.03125*a[m]*c[m*N + i]*(-c[m*N + j])*(1-c[m*N + j]*s[j])*(1-c[m*N + i]*s[i]) * (1+kronecker_ij) * prod;
-            }
-            
-            result[i*(N+M) + j] = summ;
+            K[group->clauses[t+j]] = k[j];
+            ds[v0[t+j]] += g0[j];
+            ds[v1[t+j]] += g1[j];
+            ds[v2[t+j]] += g2[j];
         }
     }
-    //J12
-    for (int i = 0; i < N; i++)
+    triple_kernel_scalar(group, t, end, s, a, ds, K);
+}
+
+__attribute__((target("avx512f")))
+static void triple_kernel_avx512(const clause_group *group, int begin, int end, double s[], double a[], double ds[], double K[]){
+    int T = group->count;
+    const int *v0 = group->variables, *v1 = v0 + T, *v2 = v1 + T;
+    const double *c0 = group->signs, *c1 = c0 + T, *c2 = c1 + T;
+    const __m512d one = _mm512_set1_pd(1.0);
+    double g0[8], g1[8], g2[8], k[8];
+    int t = begin;
+    for (; t + 8 <= end; t += 8)
     {
-        for (int j = N; j < N+M; j++)
+        __m512d s0 = _mm512_i32gather_pd(_mm256_loadu_si256((const __m256i *)(v0 + t)), s, 8);
+        __m512d s1 = _mm512_i32gather_pd(_mm256_loadu_si256((const __m256i *)(v1 + t)), s, 8);
+        __m512d s2 = _mm512_i32gather_pd(_mm256_loadu_si256((const __m256i *)(v2 + t)), s, 8);
+        __m512d am = _mm512_i32gather_pd(_mm256_loadu_si256((const __m256i *)(group->clauses + t)), a, 8);
+        __m512d sign0 = _mm512_loadu_pd(c0 + t);
+        __m512d sign1 = _mm512_loadu_pd(c1 + t);
+        __m512d sign2 = _mm512_loadu_pd(c2 + t);
+        __m512d f0 = _mm512_sub_pd(one, _mm512_mul_pd(sign0, s0));
+        __m512d f1 = _mm512_sub_pd(one, _mm512_mul_pd(sign1, s1));
+        __m512d f2 = _mm512_sub_pd(one, _mm512_mul_pd(sign2, s2));
+        __m512d f12 = _mm512_mul_pd(f1, f2);
+        __m512d productum = _mm512_mul_pd(f0, f12);
+        __m512d scale = _mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(0.03125), am), productum);
+        _mm512_storeu_pd(k, _mm512_mul_pd(_mm512_set1_pd(0.125), productum));
+        _mm512_storeu_pd(g0, _mm512_mul_pd(_mm512_mul_pd(scale, sign0), f12));
+        _mm512_storeu_pd(g1, _mm512_mul_pd(_mm512_mul_pd(scale, sign1), _mm512_mul_pd(f0, f2)));
+        _mm512_storeu_pd(g2, _mm512_mul_pd(_mm512_mul_pd(scale, sign2), _mm512_mul_pd(f0, f1)));
+        for (int j = 0; j < 8; j++)
         {
-            result[i*(N+M) + j] = 2*c[j*N + i] * k_mi_K_m(j, i, s, c, N);
+            K[group->clauses[t+j]] = k[j];
+            ds[v0[t+j]] += g0[j];
+            ds[v1[t+j]] += g1[j];
+            ds[v2[t+j]] += g2[j];
         }
     }
-    //J21
-    for (int i = N; i < N+M; i++)
+    triple_kernel_scalar(group, t, end, s, a, ds, K);
+}
+#endif
+
+//Kernels for the other widths: the leave-one-out products are built from prefix products (left)
+//and a running suffix product, K_m = 2^-k f_0 ... f_(k-1) and the gradient terms are
+//2^(1-2k) a_m c_p f_0 ... f_(k-1) * left_p * right_p. The width is a compile time constant, so the
+//loops are unrolled and the weights are constant.
+#define DEFINE_GROUP_KERNEL(WIDTH) \
+static void group_kernel_##WIDTH(const clause_group *group, int begin, int end, double s[], double a[], double ds[], double K[]){ \
+    int T = group->count; \
+    const double weight = 1.0 / (1 << WIDTH); \
+    for (int t = begin; t < end; t++) \
+    { \
+        int m = group->clauses[t]; \
+        double f[WIDTH], left[WIDTH]; \
+        double productum = 1.0; \
+        for (int p = 0; p < WIDTH; p++) \
+        { \
+            left[p] = productum; \
+            f[p] = 1.0 - group->signs[p*T + t] * s[group->variables[p*T + t]]; \
+            productum *= f[p]; \
+        } \
+        K[m] = weight * productum; \
+        double scale = 2.0 * weight * weight * a[m] * productum; \
+        double right = 1.0; \
+        for (int p = WIDTH-1; p >= 0; p--) \
+        { \
+            ds[group->variables[p*T + t]] += scale * group->signs[p*T + t] * (left[p] * right); \
+            right *= f[p]; \
+        } \
+    } \
+}
+
+DEFINE_GROUP_KERNEL(2)
+DEFINE_GROUP_KERNEL(4)
+DEFINE_GROUP_KERNEL(5)
+DEFINE_GROUP_KERNEL(6)
+DEFINE_GROUP_KERNEL(7)
+
+//Mixed precision kernels (RHS_MIXED_PRECISION): the spins are read from a float copy and the clause
+//factors and their products are float, which halves the gathered data and doubles the SIMD width.
+//The weighting with a_m, K_m and the gradient sums stay double, so large aux variables cannot
+//overflow and the small gradient terms of nearly satisfied clauses are not lost in the sums.
+static void triple_kernel_mixed_scalar(const clause_group *group, int begin, int end, const float s[], double a[], double ds[], double K[]){
+    int T = group->count;
+    const int *v0 = group->variables, *v1 = v0 + T, *v2 = v1 + T;
+    const float *c0 = group->signs_single, *c1 = c0 + T, *c2 = c1 + T;
+    for (int t = begin; t < end; t++)
     {
-        for (int j = 0; j < N; j++)
+        int m = group->clauses[t];
+        float f0 = 1.0f - c0[t] * s[v0[t]];
+        float f1 = 1.0f - c1[t] * s[v1[t]];
+        float f2 = 1.0f - c2[t] * s[v2[t]];
+        float f12 = f1 * f2;
+        float productum = f0 * f12;
+        double scale = 0.03125 * a[m] * productum;
+        K[m] = 0.125 * productum;
+        ds[v0[t]] += scale * (c0[t] * f12);
+        ds[v1[t]] += scale * (c1[t] * (f0 * f2));
+        ds[v2[t]] += scale * (c2[t] * (f0 * f1));
+    }
+}
+
+#ifdef SAT_X86_SIMD
+//8 or 16 clauses at once, the float part is the same as in the scalar kernel and the double part
+//is done per lane, so again all three give identical results
+__attribute__((target("avx2")))
+static void triple_kernel_mixed_avx2(const clause_group *group, int begin, int end, const float s[], double a[], double ds[], double K[]){
+    int T = group->count;
+    const int *v0 = group->variables, *v1 = v0 + T, *v2 = v1 + T;
+    const float *c0 = group->signs_single, *c1 = c0 + T, *c2 = c1 + T;
+    const __m256 one = _mm256_set1_ps(1.0f);
+    float g0[8], g1[8], g2[8], k[8];
+    int t = begin;
+    for (; t + 8 <= end; t += 8)
+    {
+        __m256 s0 = _mm256_i32gather_ps(s, _mm256_loadu_si256((const __m256i *)(v0 + t)), 4);
+        __m256 s1 = _mm256_i32gather_ps(s, _mm256_loadu_si256((const __m256i *)(v1 + t)), 4);
+        __m256 s2 = _mm256_i32gather_ps(s, _mm256_loadu_si256((const __m256i *)(v2 + t)), 4);
+        __m256 sign0 = _mm256_loadu_ps(c0 + t);
+        __m256 sign1 = _mm256_loadu_ps(c1 + t);
+        __m256 sign2 = _mm256_loadu_ps(c2 + t);
+        __m256 f0 = _mm256_sub_ps(one, _mm256_mul_ps(sign0, s0));
+        __m256 f1 = _mm256_sub_ps(one, _mm256_mul_ps(sign1, s1));
+        __m256 f2 = _mm256_sub_ps(one, _mm256_mul_ps(sign2, s2));
+        __m256 f12 = _mm256_mul_ps(f1, f2);
+        _mm256_storeu_ps(k, _mm256_mul_ps(f0, f12));
+        _mm256_storeu_ps(g0, _mm256_mul_ps(sign0, f12));
+        _mm256_storeu_ps(g1, _mm256_mul_ps(sign1, _mm256_mul_ps(f0, f2)));
+        _mm256_storeu_ps(g2, _mm256_mul_ps(sign2, _mm256_mul_ps(f0, f1)));
+        for (int j = 0; j < 8; j++)
         {
-            result[i*(N+M) + j] = a[i]*(-c[i*N + j])*k_mi(i, j, s, c, N);
+            int m = group->clauses[t+j];
+            double scale = 0.03125 * a[m] * k[j];
+            K[m] = 0.125 * k[j];
+            ds[v0[t+j]] += scale * g0[j];
+            ds[v1[t+j]] += scale * g1[j];
+            ds[v2[t+j]] += scale * g2[j];
         }
     }
-    //J22
-    for (int i = N; i < N+M; i++)
+    triple_kernel_mixed_scalar(group, t, end, s, a, ds, K);
+}
+
+__attribute__((target("avx512f")))
+static void triple_kernel_mixed_avx512(const clause_group *group, int begin, int end, const float s[], double a[], double ds[], double K[]){
+    int T = group->count;
+    const int *v0 = group->variables, *v1 = v0 + T, *v2 = v1 + T;
+    const float *c0 = group->signs_single, *c1 = c0 + T, *c2 = c1 + T;
+    const __m512 one = _mm512_set1_ps(1.0f);
+    float g0[16], g1[16], g2[16], k[16];
+    int t = begin;
+    for (; t + 16 <= end; t += 16)
     {
-        for (int j = N; j < N+M; j++)
+        __m512 s0 = _mm512_i32gather_ps(_mm512_loadu_si512((const void *)(v0 + t)), s, 4);
+        __m512 s1 = _mm512_i32gather_ps(_mm512_loadu_si512((const void *)(v1 + t)), s, 4);
+        __m512 s2 = _mm512_i32gather_ps(_mm512_loadu_si512((const void *)(v2 + t)), s, 4);
+        __m512 sign0 = _mm512_loadu_ps(c0 + t);
+        __m512 sign1 = _mm512_loadu_ps(c1 + t);
+        __m512 sign2 = _mm512_loadu_ps(c2 + t);
+        __m512 f0 = _mm512_sub_ps(one, _mm512_mul_ps(sign0, s0));
+        __m512 f1 = _mm512_sub_ps(one, _mm512_mul_ps(sign1, s1));
+        __m512 f2 = _mm512_sub_ps(one, _mm512_mul_ps(sign2, s2));
+        __m512 f12 = _mm512_mul_ps(f1, f2);
+        _mm512_storeu_ps(k, _mm512_mul_ps(f0, f12));
+        _mm512_storeu_ps(g0, _mm512_mul_ps(sign0, f12));
+        _mm512_storeu_ps(g1, _mm512_mul_ps(sign1, _mm512_mul_ps(f0, f2)));
+        _mm512_storeu_ps(g2, _mm512_mul_ps(sign2, _mm512_mul_ps(f0, f1)));
+        for (int j = 0; j < 16; j++)
         {
-            if (i == j) {
-                result[i*(N+M) + j] = K_m(i, s, c, N);
-            }
-            else {
-                result[i*(N+M) + j] = 0.0;
-            }
+            int m = group->clauses[t+j];
+            double scale = 0.03125 * a[m] * k[j];
+            K[m] = 0.125 * k[j];
+            ds[v0[t+j]] += scale * g0[j];
+            ds[v1[t+j]] += scale * g1[j];
+            ds[v2[t+j]] += scale * g2[j];
         }
     }
+    triple_kernel_mixed_scalar(group, t, end, s, a, ds, K);
 }
+#endif
 
-void jacobian2(int N, int M, int c[], double y[], double result[]){
-    //NOT YET IMPLEMENTED!!!!
-    double *s = y;
-    double *a = y + N;
-    //J11
+#define DEFINE_MIXED_GROUP_KERNEL(WIDTH) \
+static void mixed_group_kernel_##WIDTH(const clause_group *group, int begin, int end, const float s[], double a[], double ds[], double K[]){ \
+    int T = group->count; \
+    const double weight = 1.0 / (1 << WIDTH); \
+    for (int t = begin; t < end; t++) \
+    { \
+        int m = group->clauses[t]; \
+        float f[WIDTH], left[WIDTH]; \
+        float productum = 1.0f; \
+        for (int p = 0; p < WIDTH; p++) \
+        { \
+            left[p] = productum; \
+            f[p] = 1.0f - group->signs_single[p*T + t] * s[group->variables[p*T + t]]; \
+            productum *= f[p]; \
+        } \
+        K[m] = weight * productum; \
+        double scale = 2.0 * weight * weight * a[m] * productum; \
+        float right = 1.0f; \
+        for (int p = WIDTH-1; p >= 0; p--) \
+        { \
+            ds[group->variables[p*T + t]] += scale * (group->signs_single[p*T + t] * (left[p] * right)); \
+            right *= f[p]; \
+        } \
+    } \
+}
+
+DEFINE_MIXED_GROUP_KERNEL(2)
+DEFINE_MIXED_GROUP_KERNEL(4)
+DEFINE_MIXED_GROUP_KERNEL(5)
+DEFINE_MIXED_GROUP_KERNEL(6)
+DEFINE_MIXED_GROUP_KERNEL(7)
+
+//Best SIMD level supported by the cpu
+static int simd_available(void){
+#ifdef SAT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) { return SIMD_AVX512; }
+    if (__builtin_cpu_supports("avx2")) { return SIMD_AVX2; }
+#endif
+    return SIMD_SCALAR;
+}
+
+static void group_free(clause_group *group){
+    free(group->clauses);
+    free(group->variables);
+    free(group->signs);
+    free(group->signs_single);
+    memset(group, 0, sizeof(clause_group));
+}
+
+//Solver settings measured for an instance (CTD.auto_tune), kept with the handle and in its cache
+typedef struct sat_tuning {
+    int32_t tuned;          //nonzero if the fields below are set
+    int32_t method;         //SOLVER_* constant
+    int32_t rhs_type;       //rhs type the probes ran with (including RHS_MIXED_PRECISION)
+    int32_t probes;         //configurations that were probed
+    double h;               //fixed step size, initial step size of the adaptive methods (0: automatic)
+    double atol;
+    double rtol;
+    double progress;        //analog time per second of wall clock of the choice in the probes
+    double aux_limit;       //aux_limit the probes ran with
+} sat_tuning;
+
+//Persistent problem handle
+//Owns a copy of the sparse clause arrays and the tables derived from them (occurrence index, fixed
+//width groups, jacobian pattern, kernel scratch), so that python only passes the state and an output
+//buffer on every call
+
+typedef struct sat_problem {
+    int N;                  //number of variables
+    int M;                  //number of clauses
+    int *clause_offsets;    //M+1 entries
+    int *literal_variables; //clause_offsets[M] entries
+    int *literal_signs;     //clause_offsets[M] entries
+    int *occurrence_offsets;    //N+1 entries, variable i appears in the clauses listed from occurrence_offsets[i]
+    int *occurrence_clauses;    //clause_offsets[M] entries, ascending clause index per variable
+    int *occurrence_signs;      //clause_offsets[M] entries, sign of the variable in that clause
+    int *jacobian_offsets;      //N+M+1 row offsets of the compressed row jacobian pattern, built on first use
+    int *jacobian_columns;      //jacobian_offsets[N+M] column indices, ascending in every row
+    int *jacobian_diagonal;     //N+M slots of the diagonal entries
+    int *jacobian_pair_slots;   //k_m^2 slots per clause: entry p*k_m+q is (variable of literal p, variable of literal q)
+    int *jacobian_aux_slots;    //per literal: slot of (variable, N+m) in the spin row
+    int *jacobian_clause_slots; //per literal: slot of (N+m, variable) in the aux row
+    double *clause_scratch;     //3*(widest clause) values for the jacobian kernels
+    int threads;            //threads used by the kernels and the batch solver (OpenMP builds only)
+    double *thread_ds;      //(threads-1)*N gradient accumulators of the threaded rhs
+    clause_group groups[GROUP_MAX_WIDTH+1];     //groups[k]: clauses with exactly k literals (k = 2 ... GROUP_MAX_WIDTH)
+    group_kernel kernels[GROUP_MAX_WIDTH+1];    //kernel of each group, the width 3 one depends on the SIMD level
+    mixed_kernel mixed_kernels[GROUP_MAX_WIDTH+1];  //the same for RHS_MIXED_PRECISION
+    int other_count;        //clauses of any other width, evaluated by the generic kernel
+    int *other_clauses;
+    int simd;               //SIMD_* level of the width 3 kernel
+    char *mapping;          //cache file the clause and occurrence arrays point into (sat_problem_read_cache), else NULL
+    size_t mapping_size;
+    int mapping_mmapped;    //the mapping comes from mmap (otherwise it is a heap copy of the file)
+    sat_tuning tuning;      //stored in the cache, dropped when the clauses are edited
+} sat_problem;
+
+
+//Builds the variable to clause occurrence index from the clause arrays, returns 0 on success
+static int build_occurrences(sat_problem *problem){
+    int N = problem->N;
+    int M = problem->M;
+    int L = problem->clause_offsets[M];
+    problem->occurrence_offsets = calloc(N+1, sizeof(int));
+    problem->occurrence_clauses = malloc((L > 0 ? L : 1) * sizeof(int));
+    problem->occurrence_signs = malloc((L > 0 ? L : 1) * sizeof(int));
+    if (!problem->occurrence_offsets || !problem->occurrence_clauses || !problem->occurrence_signs) { return -1; }
+    for (int l = 0; l < L; l++)
+    {
+        problem->occurrence_offsets[problem->literal_variables[l] + 1]++;
+    }
     for (int i = 0; i < N; i++)
     {
-        for (int j = 0; j < N; j++)
+        problem->occurrence_offsets[i+1] += problem->occurrence_offsets[i];
+    }
+    int *fill = malloc((N > 0 ? N : 1) * sizeof(int));
+    if (!fill) { return -1; }
+    memcpy(fill, problem->occurrence_offsets, N * sizeof(int));
+    for (int m = 0; m < M; m++)
+    {
+        for (int l = problem->clause_offsets[m]; l < problem->clause_offsets[m+1]; l++)
         {
-            double kronecker_ij = 0.0;
-            if (i == j) { kronecker_ij = 1.0; }
-            double summ = 0;
-            for (int m = 0; m < M; m++)
-            {
-                double prod = 1;
-                for (int l = 0; l < N; l++)
-                {
-                    if (l != i && l != j)
-                    {
-                        prod *= (1-c[m*N + l]*s[l]);
-                    }
-                }
-                //2*2^(-2k); for SAT3 only!!!
-                summ += 0.03125*a[m]*c[m*N + i]*(-c[m*N + j])*(1-c[m*N + j]*s[j])*(1-c[m*N + i]*s[i]) * (1+kronecker_ij) * prod;
-            }
-            
-            result[i*(N+M) + j] = summ;
+            int position = fill[problem->literal_variables[l]]++;
+            problem->occurrence_clauses[position] = m;
+            problem->occurrence_signs[position] = problem->literal_signs[l];
         }
     }
-    //J12
-    for (int i = 0; i < N; i++)
+    free(fill);
+    return 0;
+}
+
+//Sorts the clauses into the fixed width groups and the other clauses, returns 0 on success
+static int build_groups(sat_problem *problem){
+    int M = problem->M;
+    int counts[GROUP_MAX_WIDTH+1] = {0};
+    int grouped = 0;
+    for (int m = 0; m < M; m++)
     {
-        for (int j = N; j < N+M; j++)
-        {
-            result[i*(N+M) + j] = 2*c[j*N + i] * k_mi_K_m(j, i, s, c, N);
+        int width = problem->clause_offsets[m+1] - problem->clause_offsets[m];
+        if (width >= 2 && width <= GROUP_MAX_WIDTH){
+            counts[width]++;
+            grouped++;
         }
     }
-    //J21
-    for (int i = N; i < N+M; i++)
+    for (int width = 2; width <= GROUP_MAX_WIDTH; width++)
     {
-        for (int j = 0; j < N; j++)
+        int T = counts[width];
+        clause_group *group = &problem->groups[width];
+        group->count = T;
+        group->clauses = malloc((T > 0 ? T : 1) * sizeof(int));
+        group->variables = malloc((size_t)width * (T > 0 ? T : 1) * sizeof(int));
+        group->signs = malloc((size_t)width * (T > 0 ? T : 1) * sizeof(double));
+        group->signs_single = malloc((size_t)width * (T > 0 ? T : 1) * sizeof(float));
+        if (!group->clauses || !group->variables || !group->signs || !group->signs_single) { return -1; }
+        group->count = 0;   //used as fill position below
+    }
+    problem->other_clauses = malloc((M-grouped > 0 ? M-grouped : 1) * sizeof(int));
+    if (!problem->other_clauses) { return -1; }
+    problem->other_count = 0;
+    for (int m = 0; m < M; m++)
+    {
+        int begin = problem->clause_offsets[m];
+        int width = problem->clause_offsets[m+1] - begin;
+        if (width < 2 || width > GROUP_MAX_WIDTH){
+            problem->other_clauses[problem->other_count++] = m;
+            continue;
+        }
+        clause_group *group = &problem->groups[width];
+        int T = counts[width];
+        int t = group->count++;
+        group->clauses[t] = m;
+        for (int p = 0; p < width; p++)
         {
-            result[i*(N+M) + j] = a[i]*(-c[i*N + j])*k_mi(i, j, s, c, N);
+            group->variables[p*T + t] = problem->literal_variables[begin + p];
+            group->signs[p*T + t] = problem->literal_signs[begin + p];
+            group->signs_single[p*T + t] = (float)problem->literal_signs[begin + p];
         }
     }
-    //J22
-    for (int i = N; i < N+M; i++)
+    problem->kernels[2] = group_kernel_2;
+    problem->kernels[3] = triple_kernel_scalar;
+    problem->kernels[4] = group_kernel_4;
+    problem->kernels[5] = group_kernel_5;
+    problem->kernels[6] = group_kernel_6;
+    problem->kernels[7] = group_kernel_7;
+    problem->mixed_kernels[2] = mixed_group_kernel_2;
+    problem->mixed_kernels[3] = triple_kernel_mixed_scalar;
+    problem->mixed_kernels[4] = mixed_group_kernel_4;
+    problem->mixed_kernels[5] = mixed_group_kernel_5;
+    problem->mixed_kernels[6] = mixed_group_kernel_6;
+    problem->mixed_kernels[7] = mixed_group_kernel_7;
+    return 0;
+}
+
+//Selects the SIMD level of the clause kernels (capped by what the cpu supports), returns the level used
+int sat_problem_set_simd(sat_problem *problem, int simd){
+    int available = simd_available();
+    problem->simd = simd < available ? (simd > SIMD_SCALAR ? simd : SIMD_SCALAR) : available;
+    problem->kernels[3] = triple_kernel_scalar;
+    problem->mixed_kernels[3] = triple_kernel_mixed_scalar;
+#ifdef SAT_X86_SIMD
+    if (problem->simd == SIMD_AVX2){
+        problem->kernels[3] = triple_kernel_avx2;
+        problem->mixed_kernels[3] = triple_kernel_mixed_avx2;
+    }
+    if (problem->simd == SIMD_AVX512){
+        problem->kernels[3] = triple_kernel_avx512;
+        problem->mixed_kernels[3] = triple_kernel_mixed_avx512;
+    }
+#endif
+    return problem->simd;
+}
+
+//Frees an array of the handle unless it lives in the mapped cache file
+static void free_owned(const sat_problem *problem, void *array){
+    char *address = array;
+    if (problem->mapping && address >= problem->mapping && address < problem->mapping + problem->mapping_size) { return; }
+    free(array);
+}
+
+void sat_problem_destroy(sat_problem *problem){
+    if (!problem) { return; }
+    free_owned(problem, problem->clause_offsets);
+    free_owned(problem, problem->literal_variables);
+    free_owned(problem, problem->literal_signs);
+    free_owned(problem, problem->occurrence_offsets);
+    free_owned(problem, problem->occurrence_clauses);
+    free_owned(problem, problem->occurrence_signs);
+    free(problem->jacobian_offsets);
+    free(problem->jacobian_columns);
+    free(problem->jacobian_diagonal);
+    free(problem->jacobian_pair_slots);
+    free(problem->jacobian_aux_slots);
+    free(problem->jacobian_clause_slots);
+    free(problem->clause_scratch);
+    free(problem->thread_ds);
+    for (int width = 0; width <= GROUP_MAX_WIDTH; width++)
+    {
+        group_free(&problem->groups[width]);
+    }
+    free(problem->other_clauses);
+    if (problem->mapping){
+#ifdef SAT_HAVE_MMAP
+        if (problem->mapping_mmapped) { munmap(problem->mapping, problem->mapping_size); }
+        else { free(problem->mapping); }
+#else
+        free(problem->mapping);
+#endif
+    }
+    free(problem);
+}
+
+//Builds the derived data of a handle whose clause arrays (and possibly the occurrence index) are set,
+//destroys it and returns NULL if that fails
+static sat_problem *problem_init(sat_problem *problem){
+    int M = problem->M;
+    int *clause_offsets = problem->clause_offsets;
+    int widest = 1;
+    for (int m = 0; m < M; m++)
+    {
+        if (clause_offsets[m+1] - clause_offsets[m] > widest) { widest = clause_offsets[m+1] - clause_offsets[m]; }
+    }
+    problem->clause_scratch = malloc((size_t)3 * widest * sizeof(double));
+    if (!problem->clause_scratch || (!problem->occurrence_offsets && build_occurrences(problem)) || build_groups(problem)){
+        sat_problem_destroy(problem);
+        return NULL;
+    }
+    problem->threads = 1;
+    sat_problem_set_simd(problem, SIMD_AVX512);
+    return problem;
+}
+
+//Builds a handle around the clause arrays, which are taken over (and freed if that fails)
+static sat_problem *problem_adopt(int N, int M, int *clause_offsets, int *literal_variables, int *literal_signs){
+    sat_problem *problem = calloc(1, sizeof(sat_problem));
+    if (!problem){
+        free(clause_offsets);
+        free(literal_variables);
+        free(literal_signs);
+        return NULL;
+    }
+    problem->N = N;
+    problem->M = M;
+    problem->clause_offsets = clause_offsets;
+    problem->literal_variables = literal_variables;
+    problem->literal_signs = literal_signs;
+    if (!clause_offsets || !literal_variables || !literal_signs){
+        sat_problem_destroy(problem);
+        return NULL;
+    }
+    return problem_init(problem);
+}
+
+sat_problem *sat_problem_create(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[]){
+    int L = clause_offsets[M];
+    int *offsets = malloc((M+1) * sizeof(int));
+    int *variables = malloc((L > 0 ? L : 1) * sizeof(int));
+    int *signs = malloc((L > 0 ? L : 1) * sizeof(int));
+    if (offsets && variables && signs){
+        memcpy(offsets, clause_offsets, (M+1) * sizeof(int));
+        memcpy(variables, literal_variables, L * sizeof(int));
+        memcpy(signs, literal_signs, L * sizeof(int));
+    }
+    return problem_adopt(N, M, offsets, variables, signs);
+}
+
+//DIMACS reader
+//Streams over the (memory mapped) file once: comment lines (c ...) are skipped, the header
+//p cnf N M is optional, clauses are sequences of nonzero integers terminated by 0 and may span
+//lines, whitespace is arbitrary and a line starting with % ends the formula (SATLIB files).
+//Files without any terminating 0 (like some of the small instances in SAT_problems) are read
+//with one clause per line. The number of variables is the larger of the header value and the
+//largest variable seen, the number of clauses is the number of clauses read.
+
+typedef struct int_buffer {
+    int *data;
+    size_t size;
+    size_t capacity;
+} int_buffer;
+
+static int int_buffer_push(int_buffer *buffer, int value){
+    if (buffer->size == buffer->capacity){
+        size_t capacity = buffer->capacity ? 2 * buffer->capacity : 1024;
+        int *data = realloc(buffer->data, capacity * sizeof(int));
+        if (!data) { return -1; }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    buffer->data[buffer->size++] = value;
+    return 0;
+}
+
+//Grows the capacity of a buffer to at least capacity values, returns 0 on success
+static int int_buffer_reserve(int_buffer *buffer, size_t capacity){
+    if (capacity <= buffer->capacity) { return 0; }
+    int *data = realloc(buffer->data, capacity * sizeof(int));
+    if (!data) { return -1; }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int is_space(char character){
+    return character == ' ' || character == '\t' || character == '\n' || character == '\r' || character == '\v' || character == '\f';
+}
+
+//Reads an integer at text[*position], returns 0 on success
+static int parse_int(const char *text, size_t size, size_t *position, long *value){
+    size_t i = *position;
+    int negative = 0;
+    if (i < size && (text[i] == '-' || text[i] == '+')) { negative = text[i++] == '-'; }
+    if (i >= size || text[i] < '0' || text[i] > '9') { return -1; }
+    long result = 0;
+    for (; i < size && text[i] >= '0' && text[i] <= '9'; i++)
+    {
+        result = 10*result + (text[i] - '0');
+        if (result > INT_MAX) { return -1; }
+    }
+    if (i < size && !is_space(text[i])) { return -1; }
+    *position = i;
+    *value = negative ? -result : result;
+    return 0;
+}
+
+//Parses the text into a handle, line_clauses: a line break also ends a clause. Sets *terminated if
+//a clause was terminated by 0.
+static sat_problem *parse_dimacs(const char *text, size_t size, int line_clauses, int *terminated){
+    int_buffer offsets = {0}, variables = {0}, signs = {0};
+    long header_N = 0;
+    long N = 0;
+    int open_clause = 0;
+    int failed = int_buffer_push(&offsets, 0);
+    size_t i = 0;
+    *terminated = 0;
+    while (!failed)
     {
-        for (int j = N; j < N+M; j++)
+        for (; i < size && is_space(text[i]); i++)
         {
-            if (i == j) {
-                result[i*(N+M) + j] = K_m(i, s, c, N);
-            }
-            else {
-                result[i*(N+M) + j] = 0.0;
+            if (line_clauses && text[i] == '\n' && open_clause){
+                failed = int_buffer_push(&offsets, (int)variables.size);
+                open_clause = 0;
             }
         }
+        if (failed) { break; }
+        if (i >= size || text[i] == '%') { break; }
+        if (text[i] == 'c'){
+            while (i < size && text[i] != '\n') { i++; }
+            continue;
+        }
+        if (text[i] == 'p'){
+            long header_M;
+            for (i++; i < size && is_space(text[i]); i++) {}
+            if (size - i < 3 || strncmp(text + i, "cnf", 3) != 0) { failed = 1; break; }
+            for (i += 3; i < size && is_space(text[i]); i++) {}
+            if (parse_int(text, size, &i, &header_N)) { failed = 1; break; }
+            for (; i < size && is_space(text[i]); i++) {}
+            if (parse_int(text, size, &i, &header_M) || header_N < 0 || header_M < 0) { failed = 1; break; }
+            continue;
+        }
+        long literal;
+        if (parse_int(text, size, &i, &literal)) { failed = 1; break; }
+        if (literal == 0){
+            if (open_clause || !line_clauses) { failed = int_buffer_push(&offsets, (int)variables.size); }
+            open_clause = 0;
+            *terminated = 1;
+            continue;
+        }
+        long variable = literal > 0 ? literal : -literal;
+        if (variable > N) { N = variable; }
+        failed = variables.size >= INT_MAX || int_buffer_push(&variables, (int)variable - 1) || int_buffer_push(&signs, literal > 0 ? 1 : -1);
+        open_clause = 1;
+    }
+    if (!failed && open_clause) { failed = int_buffer_push(&offsets, (int)variables.size); }
+    if (failed || (!line_clauses && !*terminated && variables.size > 0)){
+        free(offsets.data);
+        free(variables.data);
+        free(signs.data);
+        return NULL;
+    }
+    if (header_N > N) { N = header_N; }
+    if (!variables.data) { variables.data = malloc(sizeof(int)); }
+    if (!signs.data) { signs.data = malloc(sizeof(int)); }
+    return problem_adopt((int)N, (int)offsets.size - 1, offsets.data, variables.data, signs.data);
+}
+
+static sat_problem *parse_dimacs_text(const char *text, size_t size){
+    int terminated;
+    sat_problem *problem = parse_dimacs(text, size, 0, &terminated);
+    if (!problem && !terminated) { problem = parse_dimacs(text, size, 1, &terminated); }
+    return problem;
+}
+
+//Reads a DIMACS cnf file into a new handle, returns NULL if the file cannot be read or is malformed
+sat_problem *sat_problem_read_dimacs(const char *path){
+#ifdef SAT_HAVE_MMAP
+    int file = open(path, O_RDONLY);
+    if (file < 0) { return NULL; }
+    struct stat status;
+    if (fstat(file, &status) || status.st_size < 0){
+        close(file);
+        return NULL;
+    }
+    size_t size = (size_t)status.st_size;
+    if (size == 0){
+        close(file);
+        return parse_dimacs_text("", 0);
+    }
+    void *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (text == MAP_FAILED) { return NULL; }
+    sat_problem *problem = parse_dimacs_text((const char *)text, size);
+    munmap(text, size);
+    return problem;
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file) { return NULL; }
+    size_t capacity = 1 << 20, size = 0, count;
+    char *text = malloc(capacity);
+    while (text && (count = fread(text + size, 1, capacity - size, file)) > 0)
+    {
+        size += count;
+        if (size == capacity){
+            char *larger = realloc(text, 2 * capacity);
+            if (!larger) { free(text); text = NULL; break; }
+            text = larger;
+            capacity *= 2;
+        }
+    }
+    fclose(file);
+    if (!text) { return NULL; }
+    sat_problem *problem = parse_dimacs_text(text, size);
+    free(text);
+    return problem;
+#endif
+}
+
+//Sizes and clause arrays of a handle (e.g. one returned by sat_problem_read_dimacs)
+int sat_problem_variables(sat_problem *problem){
+    return problem->N;
+}
+
+int sat_problem_clauses(sat_problem *problem){
+    return problem->M;
+}
+
+int sat_problem_literals(sat_problem *problem){
+    return problem->clause_offsets[problem->M];
+}
+
+//Copies the clause arrays into clause_offsets (M+1 entries), literal_variables and literal_signs (literals entries)
+void sat_problem_export(sat_problem *problem, int clause_offsets[], int literal_variables[], int literal_signs[]){
+    int L = problem->clause_offsets[problem->M];
+    memcpy(clause_offsets, problem->clause_offsets, (problem->M + 1) * sizeof(int));
+    memcpy(literal_variables, problem->literal_variables, L * sizeof(int));
+    memcpy(literal_signs, problem->literal_signs, L * sizeof(int));
+}
+
+//Binary instance cache
+//Header followed by the clause arrays and optionally the occurrence index, every section is a
+//plain int32 array in the byte order of the writer, aligned to 64 bytes. Reading maps the file
+//(private, copy on write) and the handle points straight into the mapping, so nothing is parsed
+//and processes loading the same cache share its pages. The arrays are validated once on load.
+//Version 2 added the tuning to the header, it fits into the padding before the first section of
+//version 1 caches, which are still read (untuned). Version 3 added the aux_limit of the tuning,
+//version 2 caches are read with aux_limit 0.
+
+#define CACHE_VERSION 3
+#define CACHE_BYTE_ORDER 0x01020304u
+#define CACHE_ALIGNMENT 64
+#define CACHE_SECTIONS 6
+
+typedef struct cache_header {
+    char magic[8];                      //"CTDSSAT" followed by a zero byte
+    uint32_t byte_order;                //CACHE_BYTE_ORDER as written by the writer
+    uint32_t version;
+    int32_t N;
+    int32_t M;
+    int64_t literals;
+    int64_t sections[CACHE_SECTIONS];   //file offsets of clause_offsets, literal_variables, literal_signs,
+                                        //occurrence_offsets, occurrence_clauses, occurrence_signs (0: not stored)
+    sat_tuning tuning;                  //version 2, aux_limit version 3
+} cache_header;
+
+static const char cache_magic[8] = "CTDSSAT";
+
+//Bytes of the header of a cache version, the first section starts after them
+static size_t cache_header_size(uint32_t version){
+    if (version == 1) { return offsetof(cache_header, tuning); }
+    if (version == 2) { return offsetof(cache_header, tuning) + offsetof(sat_tuning, aux_limit); }
+    return sizeof(cache_header);
+}
+
+static int write_section(FILE *file, int64_t *position, const int *data, size_t count){
+    static const char padding[CACHE_ALIGNMENT] = {0};
+    size_t pad = (size_t)((CACHE_ALIGNMENT - *position % CACHE_ALIGNMENT) % CACHE_ALIGNMENT);
+    if (pad && fwrite(padding, 1, pad, file) != pad) { return -1; }
+    *position += pad;
+    if (count && fwrite(data, sizeof(int), count, file) != count) { return -1; }
+    *position += (int64_t)(count * sizeof(int));
+    return 0;
+}
+
+//Name of the file written next to path before it replaces path, NULL without memory
+static char *temporary_path(const char *path){
+    size_t length = strlen(path);
+    char *temporary = malloc(length + 32);
+    if (!temporary) { return NULL; }
+#ifdef SAT_HAVE_MMAP
+    snprintf(temporary, length + 32, "%s.%ld.tmp", path, (long)getpid());
+#else
+    snprintf(temporary, length + 32, "%s.tmp", path);
+#endif
+    return temporary;
+}
+
+//Closes the file written to temporary and renames it to path unless writing failed, the temporary
+//file is removed on failure and its name freed. Returns 0 on success.
+static int replace_file(FILE *file, int failed, char *temporary, const char *path){
+    failed |= fclose(file) != 0;
+#ifndef SAT_HAVE_MMAP
+    if (!failed) { remove(path); }
+#endif
+    if (failed || rename(temporary, path) != 0){
+        remove(temporary);
+        free(temporary);
+        return -1;
+    }
+    free(temporary);
+    return 0;
+}
+
+//Writes the clause arrays (and the occurrence index if with_occurrences) of the handle to path,
+//the file is written next to it and renamed, so readers never see a partial file. Returns 0 on success.
+int sat_problem_write_cache(sat_problem *problem, const char *path, int with_occurrences){
+    int N = problem->N;
+    int M = problem->M;
+    size_t L = (size_t)problem->clause_offsets[M];
+    const int *arrays[CACHE_SECTIONS] = {problem->clause_offsets, problem->literal_variables, problem->literal_signs,
+                                         problem->occurrence_offsets, problem->occurrence_clauses, problem->occurrence_signs};
+    size_t counts[CACHE_SECTIONS] = {(size_t)M+1, L, L, (size_t)N+1, L, L};
+    int stored = with_occurrences ? CACHE_SECTIONS : 3;
+    cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cache_magic, sizeof(header.magic));
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.version = CACHE_VERSION;
+    header.N = N;
+    header.M = M;
+    header.literals = (int64_t)L;
+    header.tuning = problem->tuning;
+    int64_t position = sizeof(cache_header);
+    for (int section = 0; section < stored; section++)
+    {
+        position += (CACHE_ALIGNMENT - position % CACHE_ALIGNMENT) % CACHE_ALIGNMENT;
+        header.sections[section] = position;
+        position += (int64_t)(counts[section] * sizeof(int));
     }
-}
\ No newline at end of file
+    char *temporary = temporary_path(path);
+    if (!temporary) { return -1; }
+    FILE *file = fopen(temporary, "wb");
+    if (!file){
+        free(temporary);
+        return -1;
+    }
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    position = sizeof(cache_header);
+    for (int section = 0; section < stored && !failed; section++)
+    {
+        failed = write_section(file, &position, arrays[section], counts[section]) != 0;
+    }
+    return replace_file(file, failed, temporary, path);
+}
+
+//Checks that offsets[0 ... count] is a valid offset array ending at total
+static int valid_offsets(const int *offsets, int count, int64_t total){
+    if (offsets[0] != 0 || offsets[count] != total) { return 0; }
+    for (int i = 0; i < count; i++)
+    {
+        if (offsets[i+1] < offsets[i]) { return 0; }
+    }
+    return 1;
+}
+
+static int valid_entries(const int *entries, size_t count, int lower, int upper, int signs){
+    for (size_t e = 0; e < count; e++)
+    {
+        if (signs ? (entries[e] != 1 && entries[e] != -1) : (entries[e] < lower || entries[e] >= upper)) { return 0; }
+    }
+    return 1;
+}
+
+//Checks that the stored occurrence index is the one build_occurrences makes from the clauses: the
+//per variable counts agree and every occurrence points back to a literal of its clause with the
+//same sign (in the same order). The kernels and the jacobian pattern rely on that, range checks are
+//not enough. Returns 0 if not (or without memory).
+static int valid_occurrences(int N, int M, const int clause_offsets[], const int literal_variables[], const int literal_signs[],
+                             const int occurrence_offsets[], const int occurrence_clauses[], const int occurrence_signs[]){
+    int *fill = calloc((size_t)N + 1, sizeof(int));
+    if (!fill) { return 0; }
+    int valid = 1;
+    for (int l = 0; l < clause_offsets[M]; l++)
+    {
+        fill[literal_variables[l] + 1]++;
+    }
+    for (int i = 0; i < N && valid; i++)
+    {
+        fill[i+1] += fill[i];
+        valid = fill[i+1] == occurrence_offsets[i+1];
+    }
+    for (int m = 0; m < M && valid; m++)
+    {
+        for (int l = clause_offsets[m]; l < clause_offsets[m+1] && valid; l++)
+        {
+            int position = fill[literal_variables[l]]++;
+            valid = occurrence_clauses[position] == m && occurrence_signs[position] == literal_signs[l];
+        }
+    }
+    free(fill);
+    return valid;
+}
+
+//Loads a cache written by sat_problem_write_cache, returns NULL if the file cannot be read, is not a
+//cache of a version up to CACHE_VERSION and of this byte order, or is inconsistent
+sat_problem *sat_problem_read_cache(const char *path){
+    char *mapping = NULL;
+    size_t size = 0;
+    int mmapped = 0;
+#ifdef SAT_HAVE_MMAP
+    int file = open(path, O_RDONLY);
+    if (file < 0) { return NULL; }
+    struct stat status;
+    if (fstat(file, &status) || (size_t)status.st_size < cache_header_size(1)){
+        close(file);
+        return NULL;
+    }
+    size = (size_t)status.st_size;
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (map == MAP_FAILED) { return NULL; }
+    mapping = map;
+    mmapped = 1;
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file) { return NULL; }
+    if (fseek(file, 0, SEEK_END) == 0) { size = (size_t)ftell(file); }
+    rewind(file);
+    mapping = size >= cache_header_size(1) ? malloc(size) : NULL;
+    if (mapping && fread(mapping, 1, size, file) != size){
+        free(mapping);
+        mapping = NULL;
+    }
+    fclose(file);
+    if (!mapping) { return NULL; }
+#endif
+    sat_problem *problem = calloc(1, sizeof(sat_problem));
+    if (!problem){
+#ifdef SAT_HAVE_MMAP
+        munmap(mapping, size);
+#else
+        free(mapping);
+#endif
+        return NULL;
+    }
+    problem->mapping = mapping;
+    problem->mapping_size = size;
+    problem->mapping_mmapped = mmapped;
+    cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(&header, mapping, size < sizeof(header) ? size : sizeof(header));
+    size_t header_size = cache_header_size(header.version);
+    //the bytes past the header of an older version belong to its first section
+    memset((char *)&header + header_size, 0, sizeof(header) - header_size);
+    int N = header.N;
+    int M = header.M;
+    int64_t L = header.literals;
+    int valid = memcmp(header.magic, cache_magic, sizeof(header.magic)) == 0 && header.byte_order == CACHE_BYTE_ORDER
+                && header.version >= 1 && header.version <= CACHE_VERSION && size >= header_size && N >= 0 && M >= 0 && L >= 0 && L <= INT_MAX;
+    int64_t counts[CACHE_SECTIONS] = {(int64_t)M+1, L, L, (int64_t)N+1, L, L};
+    int *arrays[CACHE_SECTIONS] = {NULL};
+    for (int section = 0; section < CACHE_SECTIONS && valid; section++)
+    {
+        int64_t start = header.sections[section];
+        if (start == 0 && section >= 3) { continue; }
+        valid = start >= (int64_t)header_size && start % CACHE_ALIGNMENT == 0
+                && (uint64_t)start + (uint64_t)counts[section] * sizeof(int) <= size;
+        if (valid) { arrays[section] = (int *)(mapping + start); }
+    }
+    int with_occurrences = valid && arrays[3] && arrays[4] && arrays[5];
+    valid = valid && arrays[0] && arrays[1] && arrays[2] && (with_occurrences || (!arrays[3] && !arrays[4] && !arrays[5]))
+            && valid_offsets(arrays[0], M, L) && valid_entries(arrays[1], (size_t)L, 0, N, 0) && valid_entries(arrays[2], (size_t)L, 0, 0, 1);
+    if (valid && with_occurrences){
+        valid = valid_offsets(arrays[3], N, L) && valid_occurrences(N, M, arrays[0], arrays[1], arrays[2], arrays[3], arrays[4], arrays[5]);
+    }
+    if (!valid){
+        sat_problem_destroy(problem);
+        return NULL;
+    }
+    problem->N = N;
+    problem->M = M;
+    problem->clause_offsets = arrays[0];
+    problem->literal_variables = arrays[1];
+    problem->literal_signs = arrays[2];
+    problem->occurrence_offsets = arrays[3];
+    problem->occurrence_clauses = arrays[4];
+    problem->occurrence_signs = arrays[5];
+    problem->tuning = header.tuning;
+    return problem_init(problem);
+}
+
+//Copies the tuning of the handle, returns nonzero if it is tuned
+int sat_problem_get_tuning(sat_problem *problem, sat_tuning *tuning){
+    *tuning = problem->tuning;
+    return problem->tuning.tuned;
+}
+
+void sat_problem_set_tuning(sat_problem *problem, const sat_tuning *tuning){
+    problem->tuning = *tuning;
+}
+
+//Random instances
+//Seeded xoshiro256** generator (state filled by splitmix64), so an instance only depends on its seed.
+//Uniform random k-SAT draws every clause as k distinct variables with independent random signs (as
+//SAT.__init__ does in python). The planted variant first draws a hidden assignment and redraws the
+//signs of every clause that it violates, which makes the clauses uniform among those it satisfies.
+
+typedef struct sat_random {
+    uint64_t state[4];
+} sat_random;
+
+static uint64_t mix64(uint64_t value){
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+static void random_seed(sat_random *random, uint64_t seed){
+    for (int j = 0; j < 4; j++)
+    {
+        seed += 0x9E3779B97F4A7C15ull;
+        random->state[j] = mix64(seed);
+    }
+}
+
+static uint64_t rotate_left(uint64_t value, int bits){
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t random_next(sat_random *random){
+    uint64_t *state = random->state;
+    uint64_t result = rotate_left(state[1] * 5, 7) * 9;
+    uint64_t shifted = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= shifted;
+    state[3] = rotate_left(state[3], 45);
+    return result;
+}
+
+//Uniform integer in [0, n), n > 0
+static uint64_t random_below(sat_random *random, uint64_t n){
+    uint64_t threshold = (0 - n) % n;
+    uint64_t value;
+    do
+    {
+        value = random_next(random);
+    } while (value < threshold);
+    return value % n;
+}
+
+//Random k-SAT instance with N variables and M clauses of k distinct variables (k <= N). With planted != 0
+//every clause is satisfied by a hidden assignment, stored in planted_assignment (N spins +1/-1) if that is
+//not NULL. Returns NULL if the sizes are invalid or memory runs out.
+sat_problem *sat_problem_random(int N, int M, int k, uint64_t seed, int planted, int planted_assignment[]){
+    if (N < 0 || M < 0 || k < 0 || k > N || (M > 0 && k > INT_MAX / M)) { return NULL; }
+    size_t L = (size_t)M * k;
+    int *offsets = malloc((size_t)(M+1) * sizeof(int));
+    int *variables = malloc((L > 0 ? L : 1) * sizeof(int));
+    int *signs = malloc((L > 0 ? L : 1) * sizeof(int));
+    int *hidden = planted ? malloc((N > 0 ? N : 1) * sizeof(int)) : NULL;
+    if (!offsets || !variables || !signs || (planted && !hidden)){
+        free(offsets);
+        free(variables);
+        free(signs);
+        free(hidden);
+        return NULL;
+    }
+    sat_random random;
+    random_seed(&random, seed);
+    for (int i = 0; planted && i < N; i++)
+    {
+        hidden[i] = random_next(&random) >> 63 ? 1 : -1;
+    }
+    for (int m = 0; m < M; m++)
+    {
+        int *clause_variables = variables + (size_t)m * k;
+        int *clause_signs = signs + (size_t)m * k;
+        offsets[m] = m * k;
+        //Floyd's sampling of k distinct variables
+        for (int p = 0, candidate = N - k; p < k; p++, candidate++)
+        {
+            int variable = (int)random_below(&random, (uint64_t)candidate + 1);
+            for (int q = 0; q < p; q++)
+            {
+                if (clause_variables[q] == variable){
+                    variable = candidate;
+                    break;
+                }
+            }
+            clause_variables[p] = variable;
+        }
+        int satisfied;
+        do
+        {
+            uint64_t bits = random_next(&random);
+            satisfied = !planted || k == 0;
+            for (int p = 0; p < k; p++)
+            {
+                if (p % 64 == 0 && p > 0) { bits = random_next(&random); }
+                clause_signs[p] = (bits >> (p % 64)) & 1 ? 1 : -1;
+                satisfied |= planted && clause_signs[p] == hidden[clause_variables[p]];
+            }
+        } while (!satisfied);
+    }
+    offsets[M] = (int)L;
+    if (planted && planted_assignment) { memcpy(planted_assignment, hidden, (size_t)N * sizeof(int)); }
+    free(hidden);
+    return problem_adopt(N, M, offsets, variables, signs);
+}
+
+//Generates count instances (instance b uses seed + b, so it is also sat_problem_random(..., seed + b, ...))
+//and writes them as binary caches named prefix<b>.ctds, using up to threads threads (0: OpenMP default).
+//Returns the number of instances written.
+int sat_write_random_caches(int count, int N, int M, int k, uint64_t seed, int planted, int threads, const char *prefix, int with_occurrences){
+    int written = 0;
+#ifdef _OPENMP
+    if (threads <= 0) { threads = omp_get_max_threads(); }
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:written) num_threads(threads) if(threads > 1)
+#else
+    (void)threads;
+#endif
+    for (int b = 0; b < count; b++)
+    {
+        sat_problem *problem = sat_problem_random(N, M, k, seed + (uint64_t)b, planted, NULL);
+        size_t length = strlen(prefix) + 32;
+        char *path = malloc(length);
+        if (problem && path){
+            snprintf(path, length, "%s%d.ctds", prefix, b);
+            written += sat_problem_write_cache(problem, path, with_occurrences) == 0;
+        }
+        free(path);
+        sat_problem_destroy(problem);
+    }
+    return written;
+}
+
+//Editing
+//An edit writes the edited clause arrays and occurrence index into new arrays of a staged copy of
+//the handle and builds the data derived from them (fixed width groups, scratch buffer) there, the
+//jacobian pattern is rebuilt on its next use. The staged arrays only replace the ones of the handle
+//once everything is allocated, so an edit that fails leaves the handle as it was. The first edit of
+//a handle read from a cache file releases the mapping.
+
+//Points the clause and occurrence arrays of staged to new arrays for N variables, M clauses and L
+//literals, returns 0 on success (nothing stays allocated otherwise)
+static int staged_alloc(sat_problem *staged, int N, int M, int L){
+    staged->clause_offsets = malloc((size_t)(M+1) * sizeof(int));
+    staged->literal_variables = malloc((size_t)(L > 0 ? L : 1) * sizeof(int));
+    staged->literal_signs = malloc((size_t)(L > 0 ? L : 1) * sizeof(int));
+    staged->occurrence_offsets = malloc((size_t)(N+1) * sizeof(int));
+    staged->occurrence_clauses = malloc((size_t)(L > 0 ? L : 1) * sizeof(int));
+    staged->occurrence_signs = malloc((size_t)(L > 0 ? L : 1) * sizeof(int));
+    staged->clause_scratch = NULL;
+    staged->other_clauses = NULL;
+    memset(staged->groups, 0, sizeof(staged->groups));
+    if (staged->clause_offsets && staged->literal_variables && staged->literal_signs && staged->occurrence_offsets
+        && staged->occurrence_clauses && staged->occurrence_signs) { return 0; }
+    free(staged->clause_offsets);
+    free(staged->literal_variables);
+    free(staged->literal_signs);
+    free(staged->occurrence_offsets);
+    free(staged->occurrence_clauses);
+    free(staged->occurrence_signs);
+    return -1;
+}
+
+//Builds the derived data of the edited arrays of staged and, if that succeeds, makes staged the new
+//state of the handle. Returns 0 on success, otherwise staged is freed and the handle is unchanged.
+static int problem_commit(sat_problem *problem, sat_problem *staged){
+    int widest = 1;
+    for (int m = 0; m < staged->M; m++)
+    {
+        int width = staged->clause_offsets[m+1] - staged->clause_offsets[m];
+        if (width > widest) { widest = width; }
+    }
+    staged->clause_scratch = malloc((size_t)3 * widest * sizeof(double));
+    if (!staged->clause_scratch || build_groups(staged)){
+        free(staged->clause_offsets);
+        free(staged->literal_variables);
+        free(staged->literal_signs);
+        free(staged->occurrence_offsets);
+        free(staged->occurrence_clauses);
+        free(staged->occurrence_signs);
+        free(staged->clause_scratch);
+        for (int width = 0; width <= GROUP_MAX_WIDTH; width++)
+        {
+            group_free(&staged->groups[width]);
+        }
+        free(staged->other_clauses);
+        return -1;
+    }
+    free_owned(problem, problem->clause_offsets);
+    free_owned(problem, problem->literal_variables);
+    free_owned(problem, problem->literal_signs);
+    free_owned(problem, problem->occurrence_offsets);
+    free_owned(problem, problem->occurrence_clauses);
+    free_owned(problem, problem->occurrence_signs);
+    free(problem->jacobian_offsets);
+    free(problem->jacobian_columns);
+    free(problem->jacobian_diagonal);
+    free(problem->jacobian_pair_slots);
+    free(problem->jacobian_aux_slots);
+    free(problem->jacobian_clause_slots);
+    free(problem->clause_scratch);
+    for (int width = 0; width <= GROUP_MAX_WIDTH; width++)
+    {
+        group_free(&problem->groups[width]);
+    }
+    free(problem->other_clauses);
+    if (problem->mapping){
+#ifdef SAT_HAVE_MMAP
+        if (problem->mapping_mmapped) { munmap(problem->mapping, problem->mapping_size); }
+        else { free(problem->mapping); }
+#else
+        free(problem->mapping);
+#endif
+    }
+    *problem = *staged;
+    problem->jacobian_offsets = NULL;
+    problem->jacobian_columns = NULL;
+    problem->jacobian_diagonal = NULL;
+    problem->jacobian_pair_slots = NULL;
+    problem->jacobian_aux_slots = NULL;
+    problem->jacobian_clause_slots = NULL;
+    problem->mapping = NULL;
+    problem->mapping_size = 0;
+    memset(&problem->tuning, 0, sizeof(sat_tuning));
+    sat_problem_set_simd(problem, problem->simd);
+    return 0;
+}
+
+//Copies the clauses with removed[m] == 0 into the staged arrays and, if variable >= 0, removes that
+//variable (the variables above it are renumbered down by one, it must not appear in any of the kept
+//clauses) together with the occurrence index.
+static void problem_compact(const sat_problem *problem, const unsigned char removed[], int *renumbered, int variable, sat_problem *staged){
+    int N = problem->N;
+    int M = problem->M;
+    const int *offsets = problem->clause_offsets;
+    int kept = 0;
+    int write = 0;
+    for (int m = 0; m < M; m++)
+    {
+        renumbered[m] = removed[m] ? -1 : kept;
+        if (removed[m]) { continue; }
+        staged->clause_offsets[kept++] = write;
+        for (int l = offsets[m]; l < offsets[m+1]; l++)
+        {
+            int i = problem->literal_variables[l];
+            staged->literal_variables[write] = variable >= 0 && i > variable ? i - 1 : i;
+            staged->literal_signs[write++] = problem->literal_signs[l];
+        }
+    }
+    staged->clause_offsets[kept] = write;
+    int variables = 0;
+    int occurrence = 0;
+    for (int i = 0; i < N; i++)
+    {
+        if (i == variable) { continue; }
+        staged->occurrence_offsets[variables++] = occurrence;
+        for (int o = problem->occurrence_offsets[i]; o < problem->occurrence_offsets[i+1]; o++)
+        {
+            int m = renumbered[problem->occurrence_clauses[o]];
+            if (m < 0) { continue; }
+            staged->occurrence_clauses[occurrence] = m;
+            staged->occurrence_signs[occurrence++] = problem->occurrence_signs[o];
+        }
+    }
+    staged->occurrence_offsets[variables] = occurrence;
+    staged->N = variables;
+    staged->M = kept;
+}
+
+static int problem_remove(sat_problem *problem, const unsigned char removed[], int variable){
+    sat_problem staged = *problem;
+    int *renumbered = malloc((problem->M > 0 ? problem->M : 1) * sizeof(int));
+    if (!renumbered || staged_alloc(&staged, problem->N, problem->M, problem->clause_offsets[problem->M])){
+        free(renumbered);
+        return -1;
+    }
+    problem_compact(problem, removed, renumbered, variable, &staged);
+    free(renumbered);
+    return problem_commit(problem, &staged);
+}
+
+//Removes variable i (0-based) and every clause it appears in, the variables above i are renumbered
+//down by one (as SAT.remove_variable). Returns 0 on success, the handle is unchanged otherwise.
+int sat_problem_remove_variable(sat_problem *problem, int i){
+    if (i < 0 || i >= problem->N) { return -1; }
+    unsigned char *removed = calloc(problem->M > 0 ? problem->M : 1, 1);
+    if (!removed) { return -1; }
+    for (int o = problem->occurrence_offsets[i]; o < problem->occurrence_offsets[i+1]; o++)
+    {
+        removed[problem->occurrence_clauses[o]] = 1;
+    }
+    int result = problem_remove(problem, removed, i);
+    free(removed);
+    return result;
+}
+
+//Removes clause m, the clauses after it move down by one. Returns 0 on success, the handle is
+//unchanged otherwise.
+int sat_problem_remove_clause(sat_problem *problem, int m){
+    if (m < 0 || m >= problem->M) { return -1; }
+    unsigned char *removed = calloc(problem->M, 1);
+    if (!removed) { return -1; }
+    removed[m] = 1;
+    int result = problem_remove(problem, removed, -1);
+    free(removed);
+    return result;
+}
+
+//Appends a clause with k literals (variables 0-based, signs +1 or -1), returns its index or -1 (the
+//handle is unchanged then)
+int sat_problem_add_clause(sat_problem *problem, int k, int variables[], int signs[]){
+    int N = problem->N;
+    int M = problem->M;
+    int L = problem->clause_offsets[M];
+    if (k < 0 || L > INT_MAX - k) { return -1; }
+    for (int p = 0; p < k; p++)
+    {
+        if (variables[p] < 0 || variables[p] >= N || (signs[p] != 1 && signs[p] != -1)) { return -1; }
+    }
+    sat_problem staged = *problem;
+    if (staged_alloc(&staged, N, M+1, L+k)) { return -1; }
+    memcpy(staged.clause_offsets, problem->clause_offsets, (size_t)(M+1) * sizeof(int));
+    memcpy(staged.literal_variables, problem->literal_variables, (size_t)L * sizeof(int));
+    memcpy(staged.literal_signs, problem->literal_signs, (size_t)L * sizeof(int));
+    for (int p = 0; p < k; p++)
+    {
+        staged.literal_variables[L+p] = variables[p];
+        staged.literal_signs[L+p] = signs[p];
+    }
+    staged.clause_offsets[M+1] = L+k;
+    //the new clause has the largest index, so it goes to the end of the occurrence list of each of its variables
+    int shift = 0;
+    for (int i = 0; i < N; i++)
+    {
+        int begin = problem->occurrence_offsets[i];
+        int end = problem->occurrence_offsets[i+1];
+        memcpy(staged.occurrence_clauses + begin + shift, problem->occurrence_clauses + begin, (size_t)(end - begin) * sizeof(int));
+        memcpy(staged.occurrence_signs + begin + shift, problem->occurrence_signs + begin, (size_t)(end - begin) * sizeof(int));
+        staged.occurrence_offsets[i] = begin + shift;
+        int position = end + shift;
+        for (int p = 0; p < k; p++)
+        {
+            if (variables[p] == i){
+                staged.occurrence_clauses[position] = M;
+                staged.occurrence_signs[position++] = signs[p];
+                shift++;
+            }
+        }
+    }
+    staged.occurrence_offsets[N] = L+k;
+    staged.M = M+1;
+    if (problem_commit(problem, &staged)) { return -1; }
+    return M;
+}
+
+//Number of clauses variable i appears in (counted per literal)
+int sat_problem_occurrences(sat_problem *problem, int i){
+    return problem->occurrence_offsets[i+1] - problem->occurrence_offsets[i];
+}
+
+//Copies the occurrence list of variable i (ascending clause indices and the signs) into clauses and signs
+void sat_problem_occurrence_list(sat_problem *problem, int i, int clauses[], int signs[]){
+    int begin = problem->occurrence_offsets[i];
+    int count = problem->occurrence_offsets[i+1] - begin;
+    memcpy(clauses, problem->occurrence_clauses + begin, (size_t)count * sizeof(int));
+    memcpy(signs, problem->occurrence_signs + begin, (size_t)count * sizeof(int));
+}
+
+//Variable (0-based) with the fewest occurrences, the first one on ties, -1 if there are no variables
+int sat_problem_smallest_variable(sat_problem *problem){
+    int smallest = -1;
+    for (int i = 0; i < problem->N; i++)
+    {
+        if (smallest < 0 || sat_problem_occurrences(problem, i) < sat_problem_occurrences(problem, smallest)) { smallest = i; }
+    }
+    return smallest;
+}
+
+//Preprocessing
+//Simplifies a problem before the dynamics are started, every clause removed shrinks both the rhs cost
+//and the number of aux variables. Unit propagation, pure literal removal, subsumption and bounded
+//variable elimination (a variable is resolved away if that does not increase the number of clauses)
+//are repeated until nothing changes. The result is a new handle on the remaining variables (renumbered
+//densely, in their original order) and a reconstruction that extends an assignment of it to one of the
+//original problem: every removed clause that is not implied by the remaining ones is pushed on a stack
+//together with a witness literal, going through the stack backwards the witness is made true wherever
+//its clause is false. Literals are encoded as 2*variable + (1 if negated) in this section.
+
+#define PREPROCESS_DONE 0
+#define PREPROCESS_UNSATISFIABLE 1  //an empty clause was derived, no simplified problem is returned
+#define PREPROCESS_NO_MEMORY -3
+
+typedef struct sat_preprocess_options {
+    int unit_propagation;       //0: unit clauses (also unit resolvents) are kept as clauses instead of being assigned
+    int pure_literals;
+    int subsumption;
+    int elimination;
+    int max_occurrences;        //variables with more occurrences are not eliminated
+    int max_resolvent_length;   //no elimination producing a longer resolvent (0: unlimited)
+    int max_rounds;             //0: until nothing changes
+} sat_preprocess_options;
+
+typedef struct sat_preprocess_stats {
+    int status;             //PREPROCESS_* constant
+    int variables;          //size of the simplified problem
+    int clauses;
+    int units;              //variables fixed by unit propagation
+    int pure_literals;      //variables fixed as pure literals
+    int subsumed;           //clauses removed by subsumption
+    int eliminated;         //variables resolved away
+    int resolvents;         //clauses added by the eliminations
+    int rounds;
+} sat_preprocess_stats;
+
+typedef struct sat_reconstruction {
+    int N;                  //variables of the original problem
+    int reduced;            //variables of the simplified problem
+    int *variable_map;      //reduced entries, original index of every variable of the simplified problem
+    signed char *values;    //N values (+1/-1) of the variables not in the simplified problem
+    int_buffer stack;       //records of witness literal, other literals, record size
+} sat_reconstruction;
+
+typedef struct simplifier {
+    int N;
+    int failed;             //out of memory
+    int unsatisfiable;
+    int units;              //unit clauses are assigned and propagated (unit_propagation)
+    int_buffer literals;    //literal pool of all clauses, shortened clauses keep their place
+    int_buffer begins;      //per clause, position in the literal pool
+    int_buffer sizes;       //per clause, 0 once the clause is removed
+    int_buffer *occurrences;    //2N lists of the clauses containing each literal, removed clauses are skipped lazily
+    signed char *values;    //N, 0 while unassigned
+    unsigned char *eliminated;
+    unsigned char *touched; //N, a clause of the variable changed since its last elimination attempt
+    unsigned char *marks;   //2N, literals of the clause being compared
+    int_buffer queue;       //assigned literals not yet propagated
+    int_buffer resolvents;  //scratch of the elimination, records of size and literals
+    sat_reconstruction *reconstruction;
+    sat_preprocess_stats *stats;
+} simplifier;
+
+//Records a removed clause with its witness literal on the reconstruction stack
+static void push_record(simplifier *simplifier, int witness, const int *literals, int size){
+    int_buffer *stack = &simplifier->reconstruction->stack;
+    int failed = int_buffer_push(stack, witness);
+    for (int p = 0; p < size && !failed; p++)
+    {
+        if (literals[p] != witness) { failed = int_buffer_push(stack, literals[p]); }
+    }
+    if (failed || int_buffer_push(stack, size)) { simplifier->failed = 1; }
+}
+
+//Marks the variables of a clause that is about to change as elimination candidates
+static void touch_clause(simplifier *simplifier, int clause){
+    const int *literals = simplifier->literals.data + simplifier->begins.data[clause];
+    for (int p = 0; p < simplifier->sizes.data[clause]; p++)
+    {
+        simplifier->touched[literals[p] >> 1] = 1;
+    }
+}
+
+//Makes a literal true, returns 1 if it was unassigned
+static int assign_literal(simplifier *simplifier, int literal){
+    int value = literal & 1 ? -1 : 1;
+    signed char *assigned = &simplifier->values[literal >> 1];
+    if (*assigned){
+        if (*assigned != value) { simplifier->unsatisfiable = 1; }
+        return 0;
+    }
+    *assigned = (signed char)value;
+    if (int_buffer_push(&simplifier->queue, literal)) { simplifier->failed = 1; }
+    push_record(simplifier, literal, &literal, 1);
+    return 1;
+}
+
+//Drops the removed clauses from the occurrence list of a literal, returns the number left
+static int live_occurrences(simplifier *simplifier, int literal){
+    int_buffer *list = &simplifier->occurrences[literal];
+    size_t kept = 0;
+    for (size_t o = 0; o < list->size; o++)
+    {
+        if (simplifier->sizes.data[list->data[o]]) { list->data[kept++] = list->data[o]; }
+    }
+    list->size = kept;
+    return (int)kept;
+}
+
+//Adds a clause (duplicate literals are merged, tautologies are dropped), units are assigned
+static void simplifier_add_clause(simplifier *simplifier, const int *literals, int size){
+    int clause = (int)simplifier->sizes.size;
+    int begin = (int)simplifier->literals.size;
+    int kept = 0;
+    int tautology = 0;
+    for (int p = 0; p < size; p++)
+    {
+        int literal = literals[p];
+        if (simplifier->marks[literal ^ 1]) { tautology = 1; }
+        if (simplifier->marks[literal]) { continue; }
+        simplifier->marks[literal] = 1;
+        if (int_buffer_push(&simplifier->literals, literal)) { simplifier->failed = 1; }
+        kept++;
+    }
+    for (int p = 0; p < kept && !simplifier->failed; p++)
+    {
+        simplifier->marks[simplifier->literals.data[begin + p]] = 0;
+    }
+    if (simplifier->failed) { return; }
+    if (tautology){
+        simplifier->literals.size = begin;
+        return;
+    }
+    if (kept == 0) { simplifier->unsatisfiable = 1; }
+    if (int_buffer_push(&simplifier->begins, begin) || int_buffer_push(&simplifier->sizes, kept)){
+        simplifier->failed = 1;
+        return;
+    }
+    for (int p = 0; p < kept; p++)
+    {
+        if (int_buffer_push(&simplifier->occurrences[simplifier->literals.data[begin + p]], clause)) { simplifier->failed = 1; }
+    }
+    touch_clause(simplifier, clause);
+    if (kept == 1 && simplifier->units && assign_literal(simplifier, simplifier->literals.data[begin])) { simplifier->stats->units++; }
+}
+
+//Propagates the assigned literals: clauses containing them are satisfied, their negations are removed
+//(only pure literals are assigned without unit propagation, their negations occur nowhere)
+static void propagate(simplifier *simplifier){
+    while (simplifier->queue.size && !simplifier->unsatisfiable && !simplifier->failed)
+    {
+        int literal = simplifier->queue.data[--simplifier->queue.size];
+        int_buffer *satisfied = &simplifier->occurrences[literal];
+        for (size_t o = 0; o < satisfied->size; o++)
+        {
+            touch_clause(simplifier, satisfied->data[o]);
+            simplifier->sizes.data[satisfied->data[o]] = 0;
+        }
+        satisfied->size = 0;
+        int_buffer *shortened = &simplifier->occurrences[literal ^ 1];
+        for (size_t o = 0; o < shortened->size && !simplifier->unsatisfiable; o++)
+        {
+            int clause = shortened->data[o];
+            int size = simplifier->sizes.data[clause];
+            if (!size) { continue; }
+            touch_clause(simplifier, clause);
+            int *literals = simplifier->literals.data + simplifier->begins.data[clause];
+            int kept = 0;
+            for (int p = 0; p < size; p++)
+            {
+                if (literals[p] != (literal ^ 1)) { literals[kept++] = literals[p]; }
+            }
+            simplifier->sizes.data[clause] = kept;
+            if (kept == 0) { simplifier->unsatisfiable = 1; }
+            if (kept == 1 && simplifier->units && assign_literal(simplifier, literals[0])) { simplifier->stats->units++; }
+        }
+        shortened->size = 0;
+    }
+}
+
+//Assigns the pure literals, returns the number found
+static int pure_literals(simplifier *simplifier){
+    int found = 0;
+    for (int i = 0; i < simplifier->N && !simplifier->unsatisfiable && !simplifier->failed; i++)
+    {
+        if (simplifier->values[i] || simplifier->eliminated[i]) { continue; }
+        int positive = live_occurrences(simplifier, 2*i);
+        int negative = live_occurrences(simplifier, 2*i + 1);
+        if ((positive == 0) != (negative == 0) && assign_literal(simplifier, positive ? 2*i : 2*i + 1)){
+            found++;
+            propagate(simplifier);
+        }
+    }
+    simplifier->stats->pure_literals += found;
+    return found;
+}
+
+//Removes the clauses containing all the literals of a shorter (or equal) clause, returns the number removed
+static int subsume(simplifier *simplifier){
+    int removed = 0;
+    for (int clause = 0; clause < (int)simplifier->sizes.size; clause++)
+    {
+        int size = simplifier->sizes.data[clause];
+        if (!size) { continue; }
+        const int *literals = simplifier->literals.data + simplifier->begins.data[clause];
+        //only the clauses containing the least frequent literal can be subsumed
+        int rarest = literals[0];
+        size_t rarest_count = simplifier->occurrences[rarest].size;
+        for (int p = 1; p < size; p++)
+        {
+            size_t count = simplifier->occurrences[literals[p]].size;
+            if (count < rarest_count){
+                rarest = literals[p];
+                rarest_count = count;
+            }
+        }
+        for (int p = 0; p < size; p++)
+        {
+            simplifier->marks[literals[p]] = 1;
+        }
+        const int_buffer *candidates = &simplifier->occurrences[rarest];
+        for (size_t o = 0; o < candidates->size; o++)
+        {
+            int other = candidates->data[o];
+            int other_size = simplifier->sizes.data[other];
+            if (other == clause || other_size < size) { continue; }
+            const int *other_literals = simplifier->literals.data + simplifier->begins.data[other];
+            int common = 0;
+            for (int p = 0; p < other_size; p++)
+            {
+                common += simplifier->marks[other_literals[p]];
+            }
+            if (common == size){
+                touch_clause(simplifier, other);
+                simplifier->sizes.data[other] = 0;
+                removed++;
+            }
+        }
+        for (int p = 0; p < size; p++)
+        {
+            simplifier->marks[literals[p]] = 0;
+        }
+    }
+    simplifier->stats->subsumed += removed;
+    return removed;
+}
+
+//Resolves variable i away if the non-tautological resolvents are not more than the clauses they
+//replace (and not longer than the limit), returns 1 if it was eliminated
+static int eliminate(simplifier *simplifier, int i, const sat_preprocess_options *options){
+    simplifier->touched[i] = 0;
+    int positive = live_occurrences(simplifier, 2*i);
+    int negative = live_occurrences(simplifier, 2*i + 1);
+    if (positive + negative == 0 || positive + negative > options->max_occurrences) { return 0; }
+    int_buffer *resolvents = &simplifier->resolvents;
+    resolvents->size = 0;
+    int count = 0;
+    for (int a = 0; a < positive; a++)
+    {
+        int first = simplifier->occurrences[2*i].data[a];
+        const int *first_literals = simplifier->literals.data + simplifier->begins.data[first];
+        int first_size = simplifier->sizes.data[first];
+        for (int p = 0; p < first_size; p++)
+        {
+            simplifier->marks[first_literals[p]] = 1;
+        }
+        int possible = 1;
+        for (int b = 0; b < negative && possible; b++)
+        {
+            int second = simplifier->occurrences[2*i + 1].data[b];
+            const int *second_literals = simplifier->literals.data + simplifier->begins.data[second];
+            int second_size = simplifier->sizes.data[second];
+            int tautology = 0;
+            int length = first_size - 1;
+            for (int p = 0; p < second_size; p++)
+            {
+                int literal = second_literals[p];
+                if (literal == 2*i + 1) { continue; }
+                if (simplifier->marks[literal ^ 1]) { tautology = 1; }
+                length += !simplifier->marks[literal];
+            }
+            if (tautology) { continue; }
+            if (++count > positive + negative || (options->max_resolvent_length > 0 && length > options->max_resolvent_length)){
+                possible = 0;
+                break;
+            }
+            int failed = int_buffer_push(resolvents, length);
+            for (int p = 0; p < first_size && !failed; p++)
+            {
+                if (first_literals[p] != 2*i) { failed = int_buffer_push(resolvents, first_literals[p]); }
+            }
+            for (int p = 0; p < second_size && !failed; p++)
+            {
+                int literal = second_literals[p];
+                if (literal != 2*i + 1 && !simplifier->marks[literal]) { failed = int_buffer_push(resolvents, literal); }
+            }
+            if (failed){
+                simplifier->failed = 1;
+                possible = 0;
+            }
+        }
+        for (int p = 0; p < first_size; p++)
+        {
+            simplifier->marks[first_literals[p]] = 0;
+        }
+        if (!possible) { return 0; }
+    }
+    //the clauses of i go to the reconstruction stack, i itself defaults to false
+    simplifier->eliminated[i] = 1;
+    simplifier->reconstruction->values[i] = -1;
+    for (int literal = 2*i; literal <= 2*i + 1; literal++)
+    {
+        int_buffer *list = &simplifier->occurrences[literal];
+        for (size_t o = 0; o < list->size; o++)
+        {
+            int clause = list->data[o];
+            push_record(simplifier, literal, simplifier->literals.data + simplifier->begins.data[clause], simplifier->sizes.data[clause]);
+            touch_clause(simplifier, clause);
+            simplifier->sizes.data[clause] = 0;
+        }
+        list->size = 0;
+    }
+    for (size_t r = 0; r < resolvents->size && !simplifier->unsatisfiable && !simplifier->failed; r += 1 + resolvents->data[r])
+    {
+        simplifier_add_clause(simplifier, resolvents->data + r + 1, resolvents->data[r]);
+    }
+    simplifier->stats->resolvents += count;
+    simplifier->stats->eliminated++;
+    propagate(simplifier);
+    return 1;
+}
+
+static void simplifier_free(simplifier *simplifier){
+    free(simplifier->literals.data);
+    free(simplifier->begins.data);
+    free(simplifier->sizes.data);
+    if (simplifier->occurrences){
+        for (int literal = 0; literal < 2*simplifier->N; literal++)
+        {
+            free(simplifier->occurrences[literal].data);
+        }
+    }
+    free(simplifier->occurrences);
+    free(simplifier->values);
+    free(simplifier->eliminated);
+    free(simplifier->touched);
+    free(simplifier->marks);
+    free(simplifier->queue.data);
+    free(simplifier->resolvents.data);
+}
+
+void sat_reconstruction_destroy(sat_reconstruction *reconstruction){
+    if (!reconstruction) { return; }
+    free(reconstruction->variable_map);
+    free(reconstruction->values);
+    free(reconstruction->stack.data);
+    free(reconstruction);
+}
+
+//Builds the handle of the clauses left, fills the variable map of the reconstruction
+static sat_problem *simplified_problem(simplifier *simplifier){
+    sat_reconstruction *reconstruction = simplifier->reconstruction;
+    int N = simplifier->N;
+    int *renumbered = malloc((N > 0 ? N : 1) * sizeof(int));
+    reconstruction->variable_map = malloc((N > 0 ? N : 1) * sizeof(int));
+    if (!renumbered || !reconstruction->variable_map){
+        free(renumbered);
+        return NULL;
+    }
+    for (int i = 0; i < N; i++)
+    {
+        renumbered[i] = -1;
+    }
+    int M = 0;
+    size_t L = 0;
+    for (size_t clause = 0; clause < simplifier->sizes.size; clause++)
+    {
+        int size = simplifier->sizes.data[clause];
+        const int *literals = simplifier->literals.data + simplifier->begins.data[clause];
+        M += size > 0;
+        L += size;
+        for (int p = 0; p < size; p++)
+        {
+            renumbered[literals[p] >> 1] = 0;
+        }
+    }
+    int reduced = 0;
+    for (int i = 0; i < N; i++)
+    {
+        if (renumbered[i] < 0){
+            if (simplifier->values[i]) { reconstruction->values[i] = simplifier->values[i]; }
+            continue;
+        }
+        reconstruction->variable_map[reduced] = i;
+        renumbered[i] = reduced++;
+    }
+    int *offsets = malloc((size_t)(M+1) * sizeof(int));
+    int *variables = malloc((L > 0 ? L : 1) * sizeof(int));
+    int *signs = malloc((L > 0 ? L : 1) * sizeof(int));
+    if (!offsets || !variables || !signs){
+        free(renumbered);
+        free(offsets);
+        free(variables);
+        free(signs);
+        return NULL;
+    }
+    int m = 0;
+    int l = 0;
+    offsets[0] = 0;
+    for (size_t clause = 0; clause < simplifier->sizes.size; clause++)
+    {
+        int size = simplifier->sizes.data[clause];
+        if (!size) { continue; }
+        const int *literals = simplifier->literals.data + simplifier->begins.data[clause];
+        for (int p = 0; p < size; p++)
+        {
+            variables[l] = renumbered[literals[p] >> 1];
+            signs[l++] = literals[p] & 1 ? -1 : 1;
+        }
+        offsets[++m] = l;
+    }
+    free(renumbered);
+    reconstruction->reduced = reduced;
+    simplifier->stats->variables = reduced;
+    simplifier->stats->clauses = M;
+    return problem_adopt(reduced, M, offsets, variables, signs);
+}
+
+//Simplifies a problem (options NULL: everything enabled with the default limits). Returns the handle of
+//the simplified problem and stores the reconstruction, which is freed with sat_reconstruction_destroy,
+//or returns NULL and sets the status in stats if an empty clause was derived or memory ran out.
+sat_problem *sat_problem_preprocess(const sat_problem *problem, const sat_preprocess_options *options,
+                                    sat_reconstruction **reconstruction, sat_preprocess_stats *stats){
+    sat_preprocess_options defaults = {1, 1, 1, 1, 16, 16, 0};
+    if (!options) { options = &defaults; }
+    int N = problem->N;
+    memset(stats, 0, sizeof(sat_preprocess_stats));
+    *reconstruction = calloc(1, sizeof(sat_reconstruction));
+    simplifier simplifier = {0};
+    simplifier.N = N;
+    simplifier.units = options->unit_propagation;
+    simplifier.stats = stats;
+    simplifier.reconstruction = *reconstruction;
+    simplifier.occurrences = calloc(2*(size_t)N + 1, sizeof(int_buffer));
+    simplifier.values = calloc(N + 1, 1);
+    simplifier.eliminated = calloc(N + 1, 1);
+    simplifier.touched = calloc(N + 1, 1);
+    simplifier.marks = calloc(2*(size_t)N + 1, 1);
+    int failed = !*reconstruction || !simplifier.occurrences || !simplifier.values || !simplifier.eliminated || !simplifier.touched || !simplifier.marks;
+    if (!failed){
+        (*reconstruction)->N = N;
+        (*reconstruction)->values = malloc(N + 1);
+        failed = !(*reconstruction)->values;
+    }
+    //the occurrence lists start with the exact size (a few of them grow through resolvents)
+    for (int l = 0; l < (failed ? 0 : problem->clause_offsets[problem->M]); l++)
+    {
+        simplifier.occurrences[2*problem->literal_variables[l] + (problem->literal_signs[l] < 0)].size++;
+    }
+    for (int literal = 0; literal < (failed ? 0 : 2*N); literal++)
+    {
+        int_buffer *list = &simplifier.occurrences[literal];
+        failed |= int_buffer_reserve(list, list->size + 4);
+        list->size = 0;
+    }
+    if (!failed){
+        memset((*reconstruction)->values, 1, N);
+        int *literals = malloc((problem->clause_offsets[problem->M] > 0 ? problem->clause_offsets[problem->M] : 1) * sizeof(int));
+        failed = !literals;
+        for (int m = 0; m < problem->M && !failed && !simplifier.failed && !simplifier.unsatisfiable; m++)
+        {
+            int begin = problem->clause_offsets[m];
+            int size = problem->clause_offsets[m+1] - begin;
+            for (int p = 0; p < size; p++)
+            {
+                literals[p] = 2*problem->literal_variables[begin + p] + (problem->literal_signs[begin + p] < 0);
+            }
+            simplifier_add_clause(&simplifier, literals, size);
+        }
+        free(literals);
+    }
+    int changed = 1;
+    while (!failed && changed && !simplifier.failed && !simplifier.unsatisfiable && (options->max_rounds <= 0 || stats->rounds < options->max_rounds))
+    {
+        changed = 0;
+        stats->rounds++;
+        if (options->unit_propagation){
+            int units = stats->units;
+            propagate(&simplifier);
+            changed |= stats->units != units;
+        }
+        if (options->pure_literals) { changed |= pure_literals(&simplifier) > 0; }
+        if (options->subsumption && !simplifier.unsatisfiable) { changed |= subsume(&simplifier) > 0; }
+        for (int i = 0; options->elimination && i < N && !simplifier.failed && !simplifier.unsatisfiable; i++)
+        {
+            if (!simplifier.values[i] && !simplifier.eliminated[i] && simplifier.touched[i]) { changed |= eliminate(&simplifier, i, options); }
+        }
+    }
+    sat_problem *simplified = NULL;
+    if (!failed && !simplifier.failed && !simplifier.unsatisfiable){
+        simplified = simplified_problem(&simplifier);
+        failed = !simplified;
+    }
+    stats->status = simplifier.unsatisfiable ? PREPROCESS_UNSATISFIABLE : PREPROCESS_DONE;
+    if (failed || simplifier.failed) { stats->status = PREPROCESS_NO_MEMORY; }
+    simplifier_free(&simplifier);
+    if (!simplified){
+        sat_reconstruction_destroy(*reconstruction);
+        *reconstruction = NULL;
+    }
+    return simplified;
+}
+
+//Variables of the original problem
+int sat_reconstruction_variables(const sat_reconstruction *reconstruction){
+    return reconstruction->N;
+}
+
+//Extends the spins s of the simplified problem (only their signs are used) to a satisfying assignment of
+//the original one if s satisfies the simplified problem, full[i] = +1 or -1 for all original variables
+void sat_reconstruct(const sat_reconstruction *reconstruction, const double s[], double full[]){
+    for (int i = 0; i < reconstruction->N; i++)
+    {
+        full[i] = reconstruction->values[i];
+    }
+    for (int j = 0; j < reconstruction->reduced; j++)
+    {
+        full[reconstruction->variable_map[j]] = s[j] > 0 ? 1.0 : -1.0;
+    }
+    const int *stack = reconstruction->stack.data;
+    for (size_t end = reconstruction->stack.size; end > 0;)
+    {
+        int size = stack[end - 1];
+        size_t begin = end - 1 - size;
+        int satisfied = 0;
+        for (size_t p = begin; p < end - 1 && !satisfied; p++)
+        {
+            satisfied = (full[stack[p] >> 1] > 0) == !(stack[p] & 1);
+        }
+        if (!satisfied) { full[stack[begin] >> 1] = stack[begin] & 1 ? -1.0 : 1.0; }
+        end = begin;
+    }
+}
+
+//Sets the number of threads (0: OpenMP default), returns the number actually used. The rhs kernels
+//use fewer of them on small instances (rhs_threads)
+int sat_problem_set_threads(sat_problem *problem, int threads){
+#ifdef _OPENMP
+    if (threads <= 0) { threads = omp_get_max_threads(); }
+#else
+    threads = 1;
+#endif
+    double *thread_ds = NULL;
+    if (threads > 1){
+        thread_ds = malloc((size_t)(threads-1) * (problem->N > 0 ? problem->N : 1) * sizeof(double));
+        if (!thread_ds) { threads = 1; }
+    }
+    free(problem->thread_ds);
+    problem->thread_ds = thread_ds;
+    problem->threads = threads;
+    return threads;
+}
+
+//Threads of the rhs kernels: every thread gets at least RHS_CLAUSES_PER_THREAD clauses, below that
+//forking the team and reducing the accumulators (N doubles each) costs more than the clauses
+#define RHS_CLAUSES_PER_THREAD 4096
+
+static int rhs_threads(const sat_problem *problem){
+    int threads = problem->M / RHS_CLAUSES_PER_THREAD;
+    if (threads > problem->threads) { threads = problem->threads; }
+    return threads > 1 ? threads : 1;
+}
+
+//Gradient and clause terms of the handle's clauses. With several threads every thread scatters a
+//fixed block of clauses into its own accumulator, which are summed in a fixed order afterwards,
+//so the result does not depend on scheduling. The bits are the same for every SIMD level and fixed
+//for a given number of rhs threads, another number splits the clauses into other blocks and sums
+//in another order. With a float copy of the spins (spins != NULL) the groups use the mixed
+//precision kernels, the other clauses are always evaluated in double
+static void problem_clause_terms(sat_problem *problem, double s[], const float spins[], double a[], double ds[], double K[]){
+    int N = problem->N;
+#ifdef _OPENMP
+    int threads = rhs_threads(problem);
+    if (threads > 1 && !omp_in_parallel()){
+        #pragma omp parallel num_threads(threads)
+        {
+            int thread = omp_get_thread_num();
+            int used = omp_get_num_threads();
+            double *accumulator = thread == 0 ? ds : problem->thread_ds + (size_t)(thread-1)*N;
+            for (int i = 0; i < N; i++)
+            {
+                accumulator[i] = 0.0;
+            }
+            for (int width = 2; width <= GROUP_MAX_WIDTH; width++)
+            {
+                int T = problem->groups[width].count;
+                int begin = (int)((long long)T * thread / used);
+                int end = (int)((long long)T * (thread+1) / used);
+                if (spins) { problem->mixed_kernels[width](&problem->groups[width], begin, end, spins, a, accumulator, K); }
+                else { problem->kernels[width](&problem->groups[width], begin, end, s, a, accumulator, K); }
+            }
+            int R = problem->other_count;
+            clause_list_sparse(problem->other_clauses, (int)((long long)R * thread / used), (int)((long long)R * (thread+1) / used),
+                               problem->clause_offsets, problem->literal_variables, problem->literal_signs, s, a, accumulator, K);
+            #pragma omp barrier
+            #pragma omp for schedule(static)
+            for (int i = 0; i < N; i++)
+            {
+                for (int t = 1; t < used; t++)
+                {
+                    ds[i] += problem->thread_ds[(size_t)(t-1)*N + i];
+                }
+            }
+        }
+        return;
+    }
+#endif
+    for (int i = 0; i < N; i++)
+    {
+        ds[i] = 0.0;
+    }
+    for (int width = 2; width <= GROUP_MAX_WIDTH; width++)
+    {
+        if (spins) { problem->mixed_kernels[width](&problem->groups[width], 0, problem->groups[width].count, spins, a, ds, K); }
+        else { problem->kernels[width](&problem->groups[width], 0, problem->groups[width].count, s, a, ds, K); }
+    }
+    clause_list_sparse(problem->other_clauses, 0, problem->other_count, problem->clause_offsets, problem->literal_variables, problem->literal_signs, s, a, ds, K);
+}
+
+//State with the aux variables a_m = exp(y[N+m]) of a log-domain state y, NULL if out of memory
+static double *plain_state(int N, int M, const double y[]){
+    double *plain = malloc(((size_t)N + M > 0 ? (size_t)N + M : 1) * sizeof(double));
+    if (!plain) { return NULL; }
+    memcpy(plain, y, (size_t)N * sizeof(double));
+    for (int m = 0; m < M; m++)
+    {
+        plain[N+m] = exp(y[N+m]);
+    }
+    return plain;
+}
+
+//rhs with caller provided scratch for the aux variables of a log-domain state (M values) and the
+//float copy of the spins of a mixed precision one (N values)
+static void problem_rhs(sat_problem *problem, int rhs_type, double y[], double result[], double aux[], float spins[]){
+    int N = problem->N;
+    double *a = y + N;
+    if (rhs_type & RHS_LOG_AUX){
+        for (int m = 0; m < problem->M; m++)
+        {
+            aux[m] = exp(y[N+m]);
+        }
+        a = aux;
+    }
+    if (rhs_type & RHS_MIXED_PRECISION){
+        for (int i = 0; i < N; i++)
+        {
+            spins[i] = (float)y[i];
+        }
+    }
+    problem_clause_terms(problem, y, rhs_type & RHS_MIXED_PRECISION ? spins : NULL, a, result, result + N);
+    finish_rhs(N, problem->M, rhs_type, y, a, result);
+}
+
+void sat_problem_rhs(sat_problem *problem, int rhs_type, double y[], double result[]){
+    double *aux = NULL;
+    float *spins = NULL;
+    if (rhs_type & RHS_LOG_AUX) { aux = malloc((problem->M > 0 ? problem->M : 1) * sizeof(double)); }
+    if (rhs_type & RHS_MIXED_PRECISION) { spins = malloc((problem->N > 0 ? problem->N : 1) * sizeof(float)); }
+    if ((rhs_type & RHS_LOG_AUX && !aux) || (rhs_type & RHS_MIXED_PRECISION && !spins)){
+        for (int i = 0; i < problem->N + problem->M; i++)
+        {
+            result[i] = NAN;
+        }
+    }
+    else { problem_rhs(problem, rhs_type, y, result, aux, spins); }
+    free(aux);
+    free(spins);
+}
+
+//Sparse jacobian
+//The jacobian of rhs type t is stored in compressed row format with the pattern of the clause
+//structure: spin row i has the spins sharing a clause with i (and i itself) and the aux variables
+//of the clauses containing i, aux row N+m has the spins of clause m and N+m itself. With
+//g_mi = 2 a_m c_mi K_m k_mi the derivatives are
+//  dg_mi/ds_i = -2 a_m k_mi^2,  dg_mi/ds_j = -4 a_m c_mi c_mj k_mi k_mj (j != i),  dg_mi/da_m = 2 c_mi K_m k_mi
+//  d(a_m K_m)/ds_j = -a_m c_mj k_mj,  d(a_m K_m^2)/ds_j = -2 a_m K_m c_mj k_mj
+//where k_mi and k_mj are products over the other literals, so no division is needed. The sin bias
+//of types three to five adds 0.5*pi^2*b*alpha*<a>*cos(pi*s_i) to the diagonal. Its dependence on
+//the mean of a would couple every spin to every aux variable, this rank one part is left out of the
+//sparse jacobian (the dense jacobian includes it).
+
+static int compare_int(const void *x, const void *y){
+    int u = *(const int *)x, v = *(const int *)y;
+    return (u > v) - (u < v);
+}
+
+//Factors f_p = 1 - c_p s_p and leave-one-out products k_p = 2^-k_m * (product of the factors before p)
+//* (product of the factors after p) of the clause with the literals begin ... begin+width-1, left needs
+//width scratch values. Returns K_m.
+static double clause_factors(int begin, int width, const int variables[], const int signs[], const double s[], double f[], double k[], double left[]){
+    double productum = 1.0;
+    for (int p = 0; p < width; p++)
+    {
+        left[p] = productum;
+        f[p] = 1.0 - signs[begin + p] * s[variables[begin + p]];
+        productum *= f[p];
+    }
+    double weight = ldexp(1.0, -width);
+    double right = 1.0;
+    for (int p = width-1; p >= 0; p--)
+    {
+        k[p] = weight * left[p] * right;
+        right *= f[p];
+    }
+    return weight * productum;
+}
+
+//Builds the sparsity pattern and the slot maps of the jacobian, returns 0 on success
+static int build_jacobian_pattern(sat_problem *problem){
+    int N = problem->N;
+    int M = problem->M;
+    int L = problem->clause_offsets[M];
+    const int *offsets = problem->clause_offsets;
+    const int *variables = problem->literal_variables;
+    size_t pairs = 0;
+    for (int m = 0; m < M; m++)
+    {
+        int width = offsets[m+1] - offsets[m];
+        pairs += (size_t)width * width;
+    }
+    int *position = malloc((size_t)(N+M > 0 ? N+M : 1) * sizeof(int));
+    int *row = malloc((size_t)(N+M > 0 ? N+M : 1) * sizeof(int));
+    problem->jacobian_offsets = malloc((size_t)(N+M+1) * sizeof(int));
+    problem->jacobian_diagonal = malloc((size_t)(N+M > 0 ? N+M : 1) * sizeof(int));
+    problem->jacobian_pair_slots = malloc((pairs > 0 ? pairs : 1) * sizeof(int));
+    problem->jacobian_aux_slots = malloc((size_t)(L > 0 ? L : 1) * sizeof(int));
+    problem->jacobian_clause_slots = malloc((size_t)(L > 0 ? L : 1) * sizeof(int));
+    if (!position || !row || !problem->jacobian_offsets || !problem->jacobian_diagonal || !problem->jacobian_pair_slots
+        || !problem->jacobian_aux_slots || !problem->jacobian_clause_slots){
+        free(position);
+        free(row);
+        return -1;
+    }
+    for (int j = 0; j < N+M; j++)
+    {
+        position[j] = -1;
+    }
+    //first pass: row lengths, position[] marks the columns already seen in the current row
+    problem->jacobian_offsets[0] = 0;
+    for (int i = 0; i < N; i++)
+    {
+        int length = 1;
+        position[i] = i;
+        for (int o = problem->occurrence_offsets[i]; o < problem->occurrence_offsets[i+1]; o++)
+        {
+            int m = problem->occurrence_clauses[o];
+            if (position[N+m] == i) { continue; }
+            position[N+m] = i;
+            length++;
+            for (int l = offsets[m]; l < offsets[m+1]; l++)
+            {
+                if (position[variables[l]] != i){
+                    position[variables[l]] = i;
+                    length++;
+                }
+            }
+        }
+        problem->jacobian_offsets[i+1] = problem->jacobian_offsets[i] + length;
+    }
+    for (int j = 0; j < N+M; j++)
+    {
+        position[j] = -1;
+    }
+    for (int m = 0; m < M; m++)
+    {
+        int length = 1;
+        for (int l = offsets[m]; l < offsets[m+1]; l++)
+        {
+            if (position[variables[l]] != N+m){
+                position[variables[l]] = N+m;
+                length++;
+            }
+        }
+        problem->jacobian_offsets[N+m+1] = problem->jacobian_offsets[N+m] + length;
+    }
+    int nnz = problem->jacobian_offsets[N+M];
+    problem->jacobian_columns = malloc((size_t)(nnz > 0 ? nnz : 1) * sizeof(int));
+    if (!problem->jacobian_columns){
+        free(position);
+        free(row);
+        return -1;
+    }
+    for (int j = 0; j < N+M; j++)
+    {
+        position[j] = -1;
+    }
+    //second pass: sorted columns of every row, position[] maps the columns of the current row to their slots
+    size_t *pair_base = malloc((size_t)(M > 0 ? M : 1) * sizeof(size_t));
+    if (!pair_base){
+        free(position);
+        free(row);
+        return -1;
+    }
+    pairs = 0;
+    for (int m = 0; m < M; m++)
+    {
+        int width = offsets[m+1] - offsets[m];
+        pair_base[m] = pairs;
+        pairs += (size_t)width * width;
+    }
+    for (int r = 0; r < N+M; r++)
+    {
+        int begin = problem->jacobian_offsets[r];
+        int length = 0;
+        if (r < N){
+            row[length++] = r;
+            position[r] = -2 - r;
+            for (int o = problem->occurrence_offsets[r]; o < problem->occurrence_offsets[r+1]; o++)
+            {
+                int m = problem->occurrence_clauses[o];
+                if (position[N+m] == -2 - r) { continue; }
+                position[N+m] = -2 - r;
+                row[length++] = N+m;
+                for (int l = offsets[m]; l < offsets[m+1]; l++)
+                {
+                    if (position[variables[l]] != -2 - r){
+                        position[variables[l]] = -2 - r;
+                        row[length++] = variables[l];
+                    }
+                }
+            }
+        }
+        else {
+            int m = r - N;
+            for (int l = offsets[m]; l < offsets[m+1]; l++)
+            {
+                if (position[variables[l]] != -2 - r){
+                    position[variables[l]] = -2 - r;
+                    row[length++] = variables[l];
+                }
+            }
+            row[length++] = r;
+        }
+        qsort(row, length, sizeof(int), compare_int);
+        for (int e = 0; e < length; e++)
+        {
+            problem->jacobian_columns[begin + e] = row[e];
+            position[row[e]] = begin + e;
+        }
+        problem->jacobian_diagonal[r] = position[r];
+        //slots of the entries of this row
+        if (r < N){
+            for (int o = problem->occurrence_offsets[r]; o < problem->occurrence_offsets[r+1]; o++)
+            {
+                int m = problem->occurrence_clauses[o];
+                if (o > problem->occurrence_offsets[r] && problem->occurrence_clauses[o-1] == m) { continue; }
+                int width = offsets[m+1] - offsets[m];
+                for (int p = 0; p < width; p++)
+                {
+                    if (variables[offsets[m] + p] != r) { continue; }
+                    problem->jacobian_aux_slots[offsets[m] + p] = position[N+m];
+                    for (int q = 0; q < width; q++)
+                    {
+                        problem->jacobian_pair_slots[pair_base[m] + (size_t)p*width + q] = position[variables[offsets[m] + q]];
+                    }
+                }
+            }
+        }
+        else {
+            int m = r - N;
+            for (int l = offsets[m]; l < offsets[m+1]; l++)
+            {
+                problem->jacobian_clause_slots[l] = position[variables[l]];
+            }
+        }
+        for (int e = 0; e < length; e++)
+        {
+            position[row[e]] = -1;
+        }
+    }
+    free(pair_base);
+    free(position);
+    free(row);
+    return 0;
+}
+
+//Number of nonzeros of the jacobian (the pattern is built on the first call), -1 if out of memory
+int sat_problem_jacobian_nnz(sat_problem *problem){
+    if (!problem->jacobian_columns && build_jacobian_pattern(problem)) { return -1; }
+    return problem->jacobian_offsets[problem->N + problem->M];
+}
+
+//Copies the pattern into row_offsets (N+M+1 entries) and columns (nnz entries), returns 0 on success
+int sat_problem_jacobian_pattern(sat_problem *problem, int row_offsets[], int columns[]){
+    int nnz = sat_problem_jacobian_nnz(problem);
+    if (nnz < 0) { return -1; }
+    memcpy(row_offsets, problem->jacobian_offsets, (size_t)(problem->N + problem->M + 1) * sizeof(int));
+    memcpy(columns, problem->jacobian_columns, (size_t)nnz * sizeof(int));
+    return 0;
+}
+
+//Writes the nonzeros of the jacobian of the given rhs type into values (in the order of the pattern),
+//returns 0 on success
+int sat_problem_jacobian_sparse(sat_problem *problem, int rhs_type, double y[], double values[]){
+    int N = problem->N;
+    int M = problem->M;
+    int nnz = sat_problem_jacobian_nnz(problem);
+    if (nnz < 0) { return -1; }
+    rhs_type &= ~RHS_MIXED_PRECISION;   //the jacobians are always evaluated in double
+    if (rhs_type & RHS_LOG_AUX){
+        //in ln a the aux columns are multiplied by a_m, the aux rows divided by a_m and the aux diagonal vanishes
+        double *plain = plain_state(N, M, y);
+        if (!plain || sat_problem_jacobian_sparse(problem, rhs_type & ~RHS_LOG_AUX, plain, values)){
+            free(plain);
+            return -1;
+        }
+        for (int r = 0; r < N+M; r++)
+        {
+            for (int e = problem->jacobian_offsets[r]; e < problem->jacobian_offsets[r+1]; e++)
+            {
+                int column = problem->jacobian_columns[e];
+                if (r >= N) { values[e] = column == r ? 0.0 : values[e] / plain[r]; }
+                else if (column >= N) { values[e] *= plain[column]; }
+            }
+        }
+        free(plain);
+        return 0;
+    }
+    const int *offsets = problem->clause_offsets;
+    const int *variables = problem->literal_variables;
+    const int *signs = problem->literal_signs;
+    double *s = y;
+    double *a = y + N;
+    double *f = problem->clause_scratch;
+    int squared = rhs_type == RHS_TYPE_TWO || rhs_type == RHS_TYPE_THREE;
+    double sign = rhs_type == RHS_TYPE_FIVE ? -1.0 : 1.0;
+    memset(values, 0, (size_t)nnz * sizeof(double));
+    size_t pair = 0;
+    for (int m = 0; m < M; m++)
+    {
+        int begin = offsets[m];
+        int width = offsets[m+1] - begin;
+        double *k = f + width;
+        double K = clause_factors(begin, width, variables, signs, s, f, k, k + width);
+        double aux_factor = squared ? 2.0 * a[m] * K : a[m];
+        for (int p = 0; p < width; p++)
+        {
+            double c_p = signs[begin + p];
+            values[problem->jacobian_aux_slots[begin + p]] += sign * 2.0 * c_p * K * k[p];
+            for (int q = 0; q < width; q++)
+            {
+                int slot = problem->jacobian_pair_slots[pair + (size_t)p*width + q];
+                if (p == q){
+                    values[slot] += sign * -2.0 * a[m] * k[p] * k[p];
+                }
+                else {
+                    values[slot] += sign * -4.0 * a[m] * c_p * signs[begin + q] * k[p] * k[q];
+                }
+            }
+            values[problem->jacobian_clause_slots[begin + p]] += sign * -aux_factor * c_p * k[p];
+        }
+        values[problem->jacobian_diagonal[N+m]] = sign * (squared ? K * K : K);
+        pair += (size_t)width * width;
+    }
+    if ((rhs_type == RHS_TYPE_THREE || rhs_type == RHS_TYPE_FOUR || rhs_type == RHS_TYPE_FIVE) && M > 0){
+        double b = 0.0725;
+        double a_mean = 0.0;
+        for (int m = 0; m < M; m++)
+        {
+            a_mean += a[m];
+        }
+        a_mean /= M;
+        double constant = 0.5*M_PI*M_PI*b*((double)M/N)*a_mean;
+        for (int i = 0; i < N; i++)
+        {
+            values[problem->jacobian_diagonal[i]] += sign * constant * cos(M_PI*s[i]);
+        }
+    }
+    return 0;
+}
+
+//Dense (N+M)x(N+M) jacobian in row major order including the mean field coupling of the sin bias,
+//returns 0 on success, -1 if out of memory
+int sat_problem_jacobian(sat_problem *problem, int rhs_type, double y[], double result[]){
+    int N = problem->N;
+    int M = problem->M;
+    rhs_type &= ~RHS_MIXED_PRECISION;
+    if (rhs_type & RHS_LOG_AUX){
+        //same transformation as in sat_problem_jacobian_sparse, which here includes the mean field coupling
+        size_t n = (size_t)N + M;
+        double *plain = plain_state(N, M, y);
+        if (!plain || sat_problem_jacobian(problem, rhs_type & ~RHS_LOG_AUX, plain, result)){
+            free(plain);
+            return -1;
+        }
+        for (size_t r = 0; r < n; r++)
+        {
+            for (size_t column = 0; column < n; column++)
+            {
+                if (r >= (size_t)N) { result[r*n + column] = column == r ? 0.0 : result[r*n + column] / plain[r]; }
+                else if (column >= (size_t)N) { result[r*n + column] *= plain[column]; }
+            }
+        }
+        free(plain);
+        return 0;
+    }
+    int nnz = sat_problem_jacobian_nnz(problem);
+    double *values = malloc((size_t)(nnz > 0 ? nnz : 1) * sizeof(double));
+    if (nnz < 0 || !values || sat_problem_jacobian_sparse(problem, rhs_type, y, values)){
+        free(values);
+        return -1;
+    }
+    size_t n = (size_t)N + M;
+    memset(result, 0, n * n * sizeof(double));
+    for (int r = 0; r < N+M; r++)
+    {
+        for (int e = problem->jacobian_offsets[r]; e < problem->jacobian_offsets[r+1]; e++)
+        {
+            result[r*n + problem->jacobian_columns[e]] = values[e];
+        }
+    }
+    free(values);
+    if ((rhs_type == RHS_TYPE_THREE || rhs_type == RHS_TYPE_FOUR || rhs_type == RHS_TYPE_FIVE) && M > 0){
+        double b = 0.0725;
+        double sign = rhs_type == RHS_TYPE_FIVE ? -1.0 : 1.0;
+        double constant = 0.5*M_PI*b/N;   //alpha/M = 1/N
+        for (int i = 0; i < N; i++)
+        {
+            double coupling = sign * constant * sin(M_PI*y[i]);
+            for (int m = 0; m < M; m++)
+            {
+                result[i*n + N + m] += coupling;
+            }
+        }
+    }
+    return 0;
+}
+
+//Dense jacobians for the dense clause matrix c (kept for compatibility, go through a temporary handle)
+static void jacobian_dense(int N, int M, int c[], int rhs_type, double y[], double result[]){
+    int *clause_offsets = malloc((size_t)(M+1) * sizeof(int));
+    int L = 0;
+    for (size_t e = 0; e < (size_t)M * N; e++)
+    {
+        L += c[e] != 0;
+    }
+    int *literal_variables = malloc((size_t)(L > 0 ? L : 1) * sizeof(int));
+    int *literal_signs = malloc((size_t)(L > 0 ? L : 1) * sizeof(int));
+    sat_problem *problem = NULL;
+    if (clause_offsets && literal_variables && literal_signs){
+        int l = 0;
+        for (int m = 0; m < M; m++)
+        {
+            clause_offsets[m] = l;
+            for (int j = 0; j < N; j++)
+            {
+                if (c[(size_t)m*N + j] != 0){
+                    literal_variables[l] = j;
+                    literal_signs[l++] = c[(size_t)m*N + j];
+                }
+            }
+        }
+        clause_offsets[M] = l;
+        problem = sat_problem_create(N, M, clause_offsets, literal_variables, literal_signs);
+    }
+    if (!problem || sat_problem_jacobian(problem, rhs_type, y, result)){
+        for (size_t e = 0; e < ((size_t)N + M) * (N + M); e++)
+        {
+            result[e] = NAN;
+        }
+    }
+    sat_problem_destroy(problem);
+    free(clause_offsets);
+    free(literal_variables);
+    free(literal_signs);
+}
+
+void jacobian1(int N, int M, int c[], double y[], double result[]){
+    jacobian_dense(N, M, c, RHS_TYPE_ONE, y, result);
+}
+
+void jacobian2(int N, int M, int c[], double y[], double result[]){
+    jacobian_dense(N, M, c, RHS_TYPE_TWO, y, result);
+}
+
+//Jacobian vector products
+//J v is computed from the clause structure without forming J: with sigma_m = sum_q c_mq k_mq v_q over
+//the spins of clause m and u_m = v_(N+m), the derivatives of the sparse jacobian give
+//  (J v)_i     += 2 a_m k_mi^2 v_i - 4 a_m c_mi k_mi sigma_m + 2 c_mi K_m k_mi u_m
+//  (J v)_(N+m)  = -a_m sigma_m + K_m u_m   (types one, four)  or  -2 a_m K_m sigma_m + K_m^2 u_m   (types two, three)
+//so a product costs O(literals). Unlike the sparse jacobian it includes the mean field coupling
+//of the sin bias, i.e. it agrees with the dense jacobian.
+
+//J V for the P vectors V[r*(N+M) ... (r+1)*(N+M)-1], scratch needs 3*(widest clause) values
+static void jvp_clauses(int N, int M, const int offsets[], const int variables[], const int signs[], double scratch[],
+                        int rhs_type, const double y[], int P, const double V[], double result[]){
+    const double *s = y;
+    const double *a = y + N;
+    size_t n = (size_t)N + M;
+    int squared = rhs_type == RHS_TYPE_TWO || rhs_type == RHS_TYPE_THREE;
+    memset(result, 0, (size_t)P * n * sizeof(double));
+    for (int m = 0; m < M; m++)
+    {
+        int begin = offsets[m];
+        int width = offsets[m+1] - begin;
+        double *f = scratch;
+        double *k = f + width;
+        double K = clause_factors(begin, width, variables, signs, s, f, k, k + width);
+        double aux_factor = squared ? 2.0 * a[m] * K : a[m];
+        for (int r = 0; r < P; r++)
+        {
+            const double *v = V + r*n;
+            double *out = result + r*n;
+            double sigma = 0.0;
+            for (int p = 0; p < width; p++)
+            {
+                sigma += signs[begin + p] * k[p] * v[variables[begin + p]];
+            }
+            double u = v[N+m];
+            for (int p = 0; p < width; p++)
+            {
+                int i = variables[begin + p];
+                double c_p = signs[begin + p];
+                out[i] += 2.0 * a[m] * k[p] * k[p] * v[i] - 4.0 * a[m] * c_p * k[p] * sigma + 2.0 * c_p * K * k[p] * u;
+            }
+            out[N+m] = -aux_factor * sigma + (squared ? K * K : K) * u;
+        }
+    }
+    if ((rhs_type == RHS_TYPE_THREE || rhs_type == RHS_TYPE_FOUR || rhs_type == RHS_TYPE_FIVE) && M > 0){
+        double b = 0.0725;
+        double a_mean = 0.0;
+        for (int m = 0; m < M; m++)
+        {
+            a_mean += a[m];
+        }
+        a_mean /= M;
+        double diagonal = 0.5*M_PI*M_PI*b*((double)M/N)*a_mean;
+        double coupling = 0.5*M_PI*b/N;   //alpha/M = 1/N
+        for (int r = 0; r < P; r++)
+        {
+            const double *v = V + r*n;
+            double *out = result + r*n;
+            double u_sum = 0.0;
+            for (int m = 0; m < M; m++)
+            {
+                u_sum += v[N+m];
+            }
+            for (int i = 0; i < N; i++)
+            {
+                out[i] += diagonal * cos(M_PI*s[i]) * v[i] + coupling * sin(M_PI*s[i]) * u_sum;
+            }
+        }
+    }
+    if (rhs_type == RHS_TYPE_FIVE){
+        for (size_t e = 0; e < (size_t)P * n; e++)
+        {
+            result[e] = -result[e];
+        }
+    }
+}
+
+void jvp_sparse(int N, int M, int clause_offsets[], int literal_variables[], int literal_signs[], int rhs_type, double y[], double v[], double result[]){
+    int widest = 1;
+    for (int m = 0; m < M; m++)
+    {
+        if (clause_offsets[m+1] - clause_offsets[m] > widest) { widest = clause_offsets[m+1] - clause_offsets[m]; }
+    }
+    double *scratch = malloc((size_t)3 * widest * sizeof(double));
+    if (!scratch) { return; }
+    jvp_clauses(N, M, clause_offsets, literal_variables, literal_signs, scratch, rhs_type, y, 1, v, result);
+    free(scratch);
+}
+
+//Products for a log-domain state: J_log V = D^-1 J(s, a) D V - diag(0, d ln a/dt) V with D = diag(1, a),
+//the last term needs one rhs evaluation. Fills the result with NAN if out of memory.
+static void jvp_log_aux(sat_problem *problem, int rhs_type, double y[], int P, double V[], double result[]){
+    int N = problem->N;
+    int M = problem->M;
+    size_t n = (size_t)N + M;
+    double *plain = plain_state(N, M, y);
+    double *scaled = calloc(P > 0 ? (size_t)P * n : 1, sizeof(double));
+    double *rate = malloc((n > 0 ? n : 1) * sizeof(double));
+    if (!plain || !scaled || !rate){
+        for (size_t e = 0; e < (size_t)P * n; e++)
+        {
+            result[e] = NAN;
+        }
+    }
+    else {
+        for (int p = 0; p < P; p++)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                scaled[p*n + i] = i < (size_t)N ? V[p*n + i] : plain[i] * V[p*n + i];
+            }
+        }
+        jvp_clauses(N, M, problem->clause_offsets, problem->literal_variables, problem->literal_signs,
+                    problem->clause_scratch, rhs_type & ~RHS_LOG_AUX, plain, P, scaled, result);
+        problem_rhs(problem, rhs_type & ~RHS_LOG_AUX, plain, rate, NULL, NULL);
+        for (int p = 0; p < P; p++)
+        {
+            for (int m = 0; m < M; m++)
+            {
+                //rate holds da_m/dt, so (da_m/dt)/a_m = d ln a_m/dt
+                result[p*n + N + m] = (result[p*n + N + m] - rate[N+m] * V[p*n + N + m]) / plain[N+m];
+            }
+        }
+    }
+    free(plain);
+    free(scaled);
+    free(rate);
+}
+
+//J V for P vectors stored one after the other (P x (N+M), row major), the clause products are shared by all vectors
+void sat_problem_jvp_batch(sat_problem *problem, int rhs_type, double y[], int P, double V[], double result[]){
+    rhs_type &= ~RHS_MIXED_PRECISION;
+    if (rhs_type & RHS_LOG_AUX){
+        jvp_log_aux(problem, rhs_type, y, P, V, result);
+        return;
+    }
+    jvp_clauses(problem->N, problem->M, problem->clause_offsets, problem->literal_variables, problem->literal_signs,
+                problem->clause_scratch, rhs_type, y, P, V, result);
+}
+
+void sat_problem_jvp(sat_problem *problem, int rhs_type, double y[], double v[], double result[]){
+    sat_problem_jvp_batch(problem, rhs_type, y, 1, v, result);
+}
+
+//Native integrator
+//Runs a whole trajectory in one call: fixed step forward Euler and RK4, or adaptive
+//Cash-Karp and Dormand-Prince 5(4) with a PI step size controller (tolerances as in scipy)
+
+#define ORTANT 0
+#define CONVERGENCE_RADIUS -1
+#define NEGATIVE_AUX -2
+
+#define SOLVER_EULER 0
+#define SOLVER_RK4 1
+#define SOLVER_CASH_KARP 2
+#define SOLVER_DORMAND_PRINCE 3
+
+#define SOLVE_RUNNING 2
+#define SOLVE_EXIT 1
+#define SOLVE_T_MAX 0
+#define SOLVE_STEP_UNDERFLOW -1
+#define SOLVE_MAX_STEPS -2
+#define SOLVE_NO_MEMORY -3
+#define SOLVE_NOT_FINITE -4
+#define SOLVE_CANCELLED -5
+#define SOLVE_TRACE_ERROR -7    //the trace or the output file could not be opened, or the output file not written
+#define SOLVE_CHECKPOINT_ERROR -8   //a checkpoint could not be written, or the one to resume could not be read or belongs to another problem
+#define SOLVE_INVALID_ARGUMENT -9   //the options cannot be run (sat_solve_check)
+
+#define OUTPUT_DECIMATE 0       //a full output buffer drops every other row and doubles the stride, it always spans the whole solve
+#define OUTPUT_RING 1           //a full output buffer overwrites its oldest row, it holds the end of the solve
+
+//Receives every recorded row (t and the recorded part of the state), a nonzero return value cancels the solve
+typedef int (*sat_output_callback)(void *data, double t, const double row[], int width);
+
+typedef struct sat_solve_options {
+    int rhs_type;
+    int method;             //SOLVER_* constant
+    int exit_type;          //ORTANT, CONVERGENCE_RADIUS, NEGATIVE_AUX, anything else runs until t_max
+    double t_max;
+    double h;               //step size of the fixed step methods, initial step of the adaptive ones (<= 0: automatic)
+    double atol;
+    double rtol;
+    double h_min;           //adaptive methods fail with SOLVE_STEP_UNDERFLOW below this step size
+    long long max_steps;    //0: unlimited
+    double aux_limit;       //> 0: whenever the largest aux variable exceeds it after a step, all of them are divided by it (not with NEGATIVE_AUX)
+    int timing;             //nonzero: count the cycles spent in the rhs, in the exit checks and in the whole solve
+    int trace_interval;     //> 0 with a trace_path: every trace_interval-th accepted step (and the last one) is written to the trace
+    const char *trace_path; //trace file (overwritten), NULL for none
+    int output_interval;    //> 0: the state is recorded at t = 0, every output_interval-th accepted step and at the end (sat_solve only)
+    int output_mode;        //OUTPUT_DECIMATE or OUTPUT_RING
+    int output_spins;       //nonzero: only the N spins are recorded, not the aux block
+    long long output_capacity;  //rows of output
+    double *output;         //output_capacity rows of 1 + width doubles (t, recorded state), NULL for none
+    const char *output_path;    //every recorded row is also written to this file as raw doubles (overwritten), NULL for none
+    sat_output_callback output_callback;    //called with every recorded row, NULL for none
+    void *output_data;      //first argument of output_callback
+    double checkpoint_interval; //> 0 with a checkpoint_path: wall clock seconds between checkpoints (sat_solve only)
+    const char *checkpoint_path;    //replaced by every checkpoint, NULL for none
+    const char *resume_path;    //non-NULL: sat_solve continues the solve saved in this checkpoint instead of starting from y
+    unsigned long long seed;    //stored in the checkpoints (e.g. the seed of the initial state), seeds the local searches
+    int finish_threshold;   //> 0 (ORTANT exit): a local search starts from the signs of the spins when at most this many clauses are unsatisfied
+    long long finish_flips; //flip budget of every local search (<= 0: 20 N)
+    double finish_noise;    //probability of a random walk move of the local search
+} sat_solve_options;
+
+typedef struct sat_solve_stats {
+    int status;             //SOLVE_* constant
+    double t;               //analog time reached
+    long long accepted_steps;
+    long long rejected_steps;
+    long long rhs_evaluations;
+    double h_min;           //smallest and largest accepted step
+    double h_max;
+    double h_last;          //step size proposed for the next step
+    long long renormalisations; //of the aux variables (aux_limit)
+    long long flips;        //sign changes of the spin variables
+    long long rhs_cycles;   //the cycle counts are only filled with options->timing (see sat_cycles_per_second)
+    long long exit_cycles;  //orthant update, exit checks and local searches
+    long long cycles;       //whole solve
+    long long output_rows;  //rows recorded in output
+    long long output_first; //row of output holding the oldest record (only moves in OUTPUT_RING mode)
+    long long output_stride;    //accepted steps between the rows of output, counted from the first row (the start or the resumed step,
+                                //OUTPUT_DECIMATE doubles it when output fills up)
+    long long checkpoints;  //checkpoints written, including the ones of the resumed solves
+    long long searches;     //local searches of the finishing stage
+    long long search_flips; //flips done by them
+    int search_unsatisfied; //unsatisfied clauses at the start of the last failed search, 0 once the count rose above finish_threshold
+    int search_solved;      //the exit was reached by a local search
+} sat_solve_stats;
+
+//Cycle counter of the instrumentation: the time stamp counter on x86, else nanoseconds
+static long long cycle_count(void){
+#ifdef SAT_X86_SIMD
+    return (long long)__rdtsc();
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+#else
+    return (long long)((double)clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
+//Rate of cycle_count, calibrated against the wall clock for about 20 ms
+double sat_cycles_per_second(void){
+#if defined(SAT_X86_SIMD) && defined(CLOCK_MONOTONIC)
+    struct timespec begin, now;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    long long first = cycle_count();
+    double elapsed;
+    do
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - begin.tv_sec) + 1e-9 * (now.tv_nsec - begin.tv_nsec);
+    } while (elapsed < 0.02);
+    return (cycle_count() - first) / elapsed;
+#else
+    return 1e9;
+#endif
+}
+
+typedef struct orthant_tracker {
+    unsigned char *positive;    //N entries, sign of the spin variables
+    int *true_literals;         //M entries
+    int unsatisfied;            //number of clauses without a true literal
+    long long flips;            //number of sign changes seen
+} orthant_tracker;
+
+//State of a single trajectory; the stage buffers live in a separate workspace
+typedef struct sat_trajectory {
+    double *y;
+    double *f;              //rhs at (t, y), first stage of the adaptive methods
+    double *aux;            //M aux variables of a log-domain state (RHS_LOG_AUX)
+    float *spins;           //N spins of a mixed precision state (RHS_MIXED_PRECISION)
+    int f_valid;
+    double h;
+    double err_prev;        //error norm of the last accepted step
+    int h_rejected;         //the current step size comes from a rejected step
+    orthant_tracker orthant;
+    sat_solve_stats stats;
+    int index;              //position in the batch, first column of the trace
+    FILE *trace;            //NULL without a trace
+    struct local_search *search;    //allocated by the first local search
+} sat_trajectory;
+
+typedef struct sat_workspace {
+    double *k[7];
+    double *y_stage;
+    double *y_new;
+    double *y_err;
+} sat_workspace;
+
+static int workspace_alloc(sat_workspace *ws, int n){
+    double *buffer = malloc((size_t)10 * (n > 0 ? n : 1) * sizeof(double));
+    if (!buffer) { return -1; }
+    for (int i = 0; i < 7; i++)
+    {
+        ws->k[i] = buffer + (size_t)i*n;
+    }
+    ws->y_stage = buffer + (size_t)7*n;
+    ws->y_new = buffer + (size_t)8*n;
+    ws->y_err = buffer + (size_t)9*n;
+    return 0;
+}
+
+static void workspace_free(sat_workspace *ws){
+    free(ws->k[0]);
+}
+
+static void evaluate(sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory, double y[], double result[]){
+    long long start = options->timing ? cycle_count() : 0;
+    problem_rhs(problem, options->rhs_type, y, result, trajectory->aux, trajectory->spins);
+    trajectory->stats.rhs_evaluations++;
+    if (options->timing) { trajectory->stats.rhs_cycles += cycle_count() - start; }
+}
+
+//Incremental orthant test: keeps the number of true literals of every clause for the sign
+//assignment of the spin variables (s_i > 0 is true), and the number of unsatisfied clauses.
+//After a step only the variables that changed sign touch their clauses (occurrence index).
+static void orthant_init(const sat_problem *problem, orthant_tracker *tracker, const double s[]){
+    tracker->unsatisfied = 0;
+    for (int i = 0; i < problem->N; i++)
+    {
+        tracker->positive[i] = s[i] > 0;
+    }
+    for (int m = 0; m < problem->M; m++)
+    {
+        int true_literals = 0;
+        for (int l = problem->clause_offsets[m]; l < problem->clause_offsets[m+1]; l++)
+        {
+            true_literals += tracker->positive[problem->literal_variables[l]] == (problem->literal_signs[l] > 0);
+        }
+        tracker->true_literals[m] = true_literals;
+        tracker->unsatisfied += true_literals == 0;
+    }
+}
+
+static void orthant_flip(const sat_problem *problem, orthant_tracker *tracker, int i){
+    tracker->positive[i] = !tracker->positive[i];
+    tracker->flips++;
+    for (int o = problem->occurrence_offsets[i]; o < problem->occurrence_offsets[i+1]; o++)
+    {
+        int m = problem->occurrence_clauses[o];
+        if ((problem->occurrence_signs[o] > 0) == tracker->positive[i]){
+            tracker->unsatisfied -= tracker->true_literals[m]++ == 0;
+        }
+        else {
+            tracker->unsatisfied += --tracker->true_literals[m] == 0;
+        }
+    }
+}
+
+static void orthant_update(const sat_problem *problem, orthant_tracker *tracker, const double s[]){
+    for (int i = 0; i < problem->N; i++)
+    {
+        if ((s[i] > 0) != tracker->positive[i]){
+            orthant_flip(problem, tracker, i);
+        }
+    }
+}
+
+static int exit_reached(const sat_problem *problem, int rhs_type, int exit_type, const orthant_tracker *tracker, const double y[]){
+    int N = problem->N;
+    if (exit_type == ORTANT){
+        return tracker->unsatisfied == 0;
+    }
+    else if (exit_type == CONVERGENCE_RADIUS){
+        if (tracker->unsatisfied) { return 0; }
+        double sigma = 0.5;
+        double norm_squared = 0.0;
+        for (int i = 0; i < N; i++)
+        {
+            norm_squared += y[i]*y[i];
+        }
+        return norm_squared >= N - 1 + sigma*sigma;
+    }
+    else if (exit_type == NEGATIVE_AUX){
+        double one = rhs_type & RHS_LOG_AUX ? 0.0 : 1.0;   //a_m < 1
+        for (int m = 0; m < problem->M; m++)
+        {
+            if (y[N+m] < one) { return 1; }
+        }
+    }
+    return 0;
+}
+
+//Finishing stage: WalkSAT (SKC variant) from the sign assignment of a trajectory close to a solution.
+//The search works on its own copy of the clauses with repeated literals merged and tautologies left
+//empty (always satisfied), so every literal of a clause is a distinct variable. Every clause keeps its
+//number of true literals and the xor of their variables, which is the critical variable of a clause
+//with a single true literal, so the break counts (clauses only the variable satisfies) are updated
+//incrementally along the occurrence lists of the flipped variable.
+
+typedef struct local_search {
+    unsigned char *positive;    //N entries, assignment of the search
+    int *breaks;                //N entries
+    int *true_literals;         //M entries
+    int *critical;              //M entries, xor of the variables of the true literals
+    int *unsatisfied;           //the unsatisfied clauses ...
+    int *position;              //... and the position of every clause in that list (-1: satisfied)
+    int count;                  //unsatisfied clauses
+    unsigned char *tautology;   //M entries, the clause has both literals of a variable
+    int *clause_offsets;        //M+1 entries, the clauses without repeated literals ...
+    int *literal_variables;
+    int *literal_signs;
+    int *occurrence_offsets;    //N+1 entries, ... and their occurrence lists
+    int *occurrence_clauses;
+    int *occurrence_signs;
+} local_search;
+
+static void search_free(local_search *search){
+    if (!search) { return; }
+    free(search->positive);
+    free(search->breaks);
+    free(search->true_literals);
+    free(search->critical);
+    free(search->unsatisfied);
+    free(search->position);
+    free(search->tautology);
+    free(search->clause_offsets);
+    free(search->literal_variables);
+    free(search->literal_signs);
+    free(search->occurrence_offsets);
+    free(search->occurrence_clauses);
+    free(search->occurrence_signs);
+    free(search);
+}
+
+//Copies the clauses of the problem without repeated literals (breaks is the scratch of the marks)
+static void search_clauses(const sat_problem *problem, local_search *search){
+    int *marks = search->breaks;    //2(m+1) + (sign > 0): variable seen in clause m with that sign
+    memset(marks, 0, problem->N * sizeof(int));
+    int l = 0;
+    search->clause_offsets[0] = 0;
+    for (int m = 0; m < problem->M; m++)
+    {
+        int begin = l;
+        search->tautology[m] = 0;
+        for (int k = problem->clause_offsets[m]; k < problem->clause_offsets[m+1]; k++)
+        {
+            int i = problem->literal_variables[k];
+            int mark = 2*(m+1) + (problem->literal_signs[k] > 0);
+            if (marks[i] == mark) { continue; }
+            if (marks[i] == (mark ^ 1)) { search->tautology[m] = 1; }
+            marks[i] = mark;
+            search->literal_variables[l] = i;
+            search->literal_signs[l] = problem->literal_signs[k];
+            l++;
+        }
+        if (search->tautology[m]) { l = begin; }
+        search->clause_offsets[m+1] = l;
+    }
+    memset(search->occurrence_offsets, 0, (problem->N + 1) * sizeof(int));
+    for (int k = 0; k < l; k++)
+    {
+        search->occurrence_offsets[search->literal_variables[k] + 1]++;
+    }
+    for (int i = 0; i < problem->N; i++)
+    {
+        search->occurrence_offsets[i+1] += search->occurrence_offsets[i];
+        marks[i] = search->occurrence_offsets[i];
+    }
+    for (int m = 0; m < problem->M; m++)
+    {
+        for (int k = search->clause_offsets[m]; k < search->clause_offsets[m+1]; k++)
+        {
+            int o = marks[search->literal_variables[k]]++;
+            search->occurrence_clauses[o] = m;
+            search->occurrence_signs[o] = search->literal_signs[k];
+        }
+    }
+}
+
+static local_search *search_alloc(const sat_problem *problem){
+    size_t N = problem->N > 0 ? (size_t)problem->N : 1;
+    size_t M = problem->M > 0 ? (size_t)problem->M : 1;
+    size_t L = problem->clause_offsets[problem->M] > 0 ? (size_t)problem->clause_offsets[problem->M] : 1;
+    local_search *search = calloc(1, sizeof(local_search));
+    if (!search) { return NULL; }
+    search->positive = malloc(N);
+    search->breaks = malloc(N * sizeof(int));
+    search->true_literals = malloc(M * sizeof(int));
+    search->critical = malloc(M * sizeof(int));
+    search->unsatisfied = malloc(M * sizeof(int));
+    search->position = malloc(M * sizeof(int));
+    search->tautology = malloc(M);
+    search->clause_offsets = malloc((M + 1) * sizeof(int));
+    search->literal_variables = malloc(L * sizeof(int));
+    search->literal_signs = malloc(L * sizeof(int));
+    search->occurrence_offsets = malloc((N + 1) * sizeof(int));
+    search->occurrence_clauses = malloc(L * sizeof(int));
+    search->occurrence_signs = malloc(L * sizeof(int));
+    if (!search->positive || !search->breaks || !search->true_literals || !search->critical || !search->unsatisfied || !search->position
+        || !search->tautology || !search->clause_offsets || !search->literal_variables || !search->literal_signs
+        || !search->occurrence_offsets || !search->occurrence_clauses || !search->occurrence_signs){
+        search_free(search);
+        return NULL;
+    }
+    search_clauses(problem, search);
+    return search;
+}
+
+static void search_init(const sat_problem *problem, local_search *search, const orthant_tracker *tracker){
+    memcpy(search->positive, tracker->positive, problem->N);
+    memset(search->breaks, 0, problem->N * sizeof(int));
+    search->count = 0;
+    for (int m = 0; m < problem->M; m++)
+    {
+        int true_literals = 0;
+        int critical = 0;
+        for (int l = search->clause_offsets[m]; l < search->clause_offsets[m+1]; l++)
+        {
+            int i = search->literal_variables[l];
+            if (search->positive[i] == (search->literal_signs[l] > 0)){
+                true_literals++;
+                critical ^= i;
+            }
+        }
+        //a tautology has no literals and stays satisfied: never 0 or 1 true literals
+        if (search->tautology[m]) { true_literals = 2; }
+        search->true_literals[m] = true_literals;
+        search->critical[m] = critical;
+        search->position[m] = -1;
+        if (true_literals == 1) { search->breaks[critical]++; }
+        if (true_literals == 0){
+            search->position[m] = search->count;
+            search->unsatisfied[search->count++] = m;
+        }
+    }
+}
+
+static void search_flip(local_search *search, int i){
+    search->positive[i] = !search->positive[i];
+    for (int o = search->occurrence_offsets[i]; o < search->occurrence_offsets[i+1]; o++)
+    {
+        int m = search->occurrence_clauses[o];
+        if ((search->occurrence_signs[o] > 0) == search->positive[i]){
+            if (search->true_literals[m] == 0){
+                int last = search->unsatisfied[--search->count];
+                search->unsatisfied[search->position[m]] = last;
+                search->position[last] = search->position[m];
+                search->position[m] = -1;
+                search->breaks[i]++;
+            }
+            else if (search->true_literals[m] == 1){
+                search->breaks[search->critical[m]]--;
+            }
+            search->true_literals[m]++;
+            search->critical[m] ^= i;
+        }
+        else {
+            search->true_literals[m]--;
+            search->critical[m] ^= i;
+            if (search->true_literals[m] == 0){
+                search->position[m] = search->count;
+                search->unsatisfied[search->count++] = m;
+                search->breaks[i]--;
+            }
+            else if (search->true_literals[m] == 1){
+                search->breaks[search->critical[m]]++;
+            }
+        }
+    }
+}
+
+//Bounded local search from the signs of the spins. On success the tracker and the spins take the
+//satisfying assignment (flipped spins are set to +-1) and 1 is returned, else the trajectory is unchanged.
+static int finish_search(const sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory){
+    orthant_tracker *tracker = &trajectory->orthant;
+    sat_solve_stats *stats = &trajectory->stats;
+    if (tracker->unsatisfied > options->finish_threshold){
+        stats->search_unsatisfied = 0;
+        return 0;
+    }
+    if (tracker->unsatisfied == 0 || (stats->search_unsatisfied && tracker->unsatisfied >= stats->search_unsatisfied)) { return 0; }
+    if (!trajectory->search && !(trajectory->search = search_alloc(problem))) { return 0; }
+    local_search *search = trajectory->search;
+    //a fresh stream for every search, so a resumed checkpoint searches the same way
+    sat_random random;
+    random_seed(&random, mix64(options->seed ^ mix64((uint64_t)trajectory->index)) + (uint64_t)stats->searches);
+    long long budget = options->finish_flips > 0 ? options->finish_flips : 20LL * problem->N;
+    long long flips = 0;
+    search_init(problem, search, tracker);
+    stats->searches++;
+    while (search->count > 0 && flips < budget)
+    {
+        int m = search->unsatisfied[random_below(&random, (uint64_t)search->count)];
+        int begin = search->clause_offsets[m];
+        int width = search->clause_offsets[m+1] - begin;
+        if (width == 0) { break; }
+        int best = search->literal_variables[begin];
+        int ties = 1;
+        for (int l = begin + 1; l < begin + width; l++)
+        {
+            int i = search->literal_variables[l];
+            if (search->breaks[i] < search->breaks[best]){
+                best = i;
+                ties = 1;
+            }
+            else if (search->breaks[i] == search->breaks[best] && random_below(&random, (uint64_t)++ties) == 0){
+                best = i;
+            }
+        }
+        if (search->breaks[best] > 0 && (random_next(&random) >> 11) * 0x1.0p-53 < options->finish_noise){
+            best = search->literal_variables[begin + (int)random_below(&random, (uint64_t)width)];
+        }
+        search_flip(search, best);
+        flips++;
+    }
+    stats->search_flips += flips;
+    if (search->count > 0){
+        stats->search_unsatisfied = tracker->unsatisfied;
+        return 0;
+    }
+    for (int i = 0; i < problem->N; i++)
+    {
+        if (search->positive[i] != tracker->positive[i]){
+            orthant_flip(problem, tracker, i);
+            trajectory->y[i] = search->positive[i] ? 1.0 : -1.0;
+        }
+    }
+    trajectory->f_valid = 0;
+    stats->search_solved = 1;
+    return 1;
+}
+
+//Weighted RMS norm used by the step size controller and the initial step selection
+static double scaled_norm(int n, const double v[], const double y0[], const double y1[], double atol, double rtol){
+    double summ = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        double scale = atol + rtol * fmax(fabs(y0[i]), fabs(y1[i]));
+        summ += (v[i]/scale) * (v[i]/scale);
+    }
+    return n > 0 ? sqrt(summ / n) : 0.0;
+}
+
+static int all_finite(int n, const double v[]){
+    for (int i = 0; i < n; i++)
+    {
+        if (!isfinite(v[i])) { return 0; }
+    }
+    return 1;
+}
+
+//Initial step size of the adaptive methods (Hairer, Norsett & Wanner, as in scipy)
+static double initial_step(sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory, sat_workspace *ws){
+    int n = problem->N + problem->M;
+    double *y = trajectory->y;
+    double *f = trajectory->f;
+    double d0 = scaled_norm(n, y, y, y, options->atol, options->rtol);
+    double d1 = scaled_norm(n, f, y, y, options->atol, options->rtol);
+    double h0 = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+    for (int i = 0; i < n; i++)
+    {
+        ws->y_stage[i] = y[i] + h0 * f[i];
+    }
+    evaluate(problem, options, trajectory, ws->y_stage, ws->k[1]);
+    for (int i = 0; i < n; i++)
+    {
+        ws->y_err[i] = ws->k[1][i] - f[i];
+    }
+    double d2 = scaled_norm(n, ws->y_err, y, y, options->atol, options->rtol) / h0;
+    double h1 = (d1 <= 1e-15 && d2 <= 1e-15) ? fmax(1e-6, h0 * 1e-3) : pow(0.01 / fmax(d1, d2), 0.2);
+    return fmin(100 * h0, h1);
+}
+
+static void step_fixed(sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory, sat_workspace *ws){
+    int n = problem->N + problem->M;
+    double *y = trajectory->y;
+    int last = trajectory->h * (1 + 1e-10) >= options->t_max - trajectory->stats.t;
+    double h = last ? options->t_max - trajectory->stats.t : trajectory->h;
+    if (options->method == SOLVER_EULER){
+        evaluate(problem, options, trajectory, y, ws->k[0]);
+        for (int i = 0; i < n; i++)
+        {
+            y[i] += h * ws->k[0][i];
+        }
+    }
+    else {
+        evaluate(problem, options, trajectory, y, ws->k[0]);
+        for (int i = 0; i < n; i++)
+        {
+            ws->y_stage[i] = y[i] + 0.5 * h * ws->k[0][i];
+        }
+        evaluate(problem, options, trajectory, ws->y_stage, ws->k[1]);
+        for (int i = 0; i < n; i++)
+        {
+            ws->y_stage[i] = y[i] + 0.5 * h * ws->k[1][i];
+        }
+        evaluate(problem, options, trajectory, ws->y_stage, ws->k[2]);
+        for (int i = 0; i < n; i++)
+        {
+            ws->y_stage[i] = y[i] + h * ws->k[2][i];
+        }
+        evaluate(problem, options, trajectory, ws->y_stage, ws->k[3]);
+        for (int i = 0; i < n; i++)
+        {
+            y[i] += h * (ws->k[0][i] + 2*ws->k[1][i] + 2*ws->k[2][i] + ws->k[3][i]) / 6.0;
+        }
+    }
+    trajectory->stats.t = last ? options->t_max : trajectory->stats.t + h;
+    trajectory->stats.accepted_steps++;
+    trajectory->stats.h_min = fmin(trajectory->stats.h_min, h);
+    trajectory->stats.h_max = fmax(trajectory->stats.h_max, h);
+    trajectory->stats.h_last = trajectory->h;
+    if (!all_finite(n, y)) { trajectory->stats.status = SOLVE_NOT_FINITE; }
+}
+
+//Butcher tableaus of the embedded methods (the rhs is autonomous, so the nodes are not needed),
+//the error weights are the differences of the two solutions
+static const double cash_karp_a[6][5] = {
+    {0},
+    {1.0/5},
+    {3.0/40, 9.0/40},
+    {3.0/10, -9.0/10, 6.0/5},
+    {-11.0/54, 5.0/2, -70.0/27, 35.0/27},
+    {1631.0/55296, 175.0/512, 575.0/13824, 44275.0/110592, 253.0/4096}
+};
+static const double cash_karp_b[6] = {37.0/378, 0.0, 250.0/621, 125.0/594, 0.0, 512.0/1771};
+static const double cash_karp_e[6] = {37.0/378 - 2825.0/27648, 0.0, 250.0/621 - 18575.0/48384, 125.0/594 - 13525.0/55296, -277.0/14336, 512.0/1771 - 1.0/4};
+
+static const double dormand_prince_a[7][6] = {
+    {0},
+    {1.0/5},
+    {3.0/40, 9.0/40},
+    {44.0/45, -56.0/15, 32.0/9},
+    {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+    {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+    {35.0/384, 0.0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}
+};
+static const double dormand_prince_b[7] = {35.0/384, 0.0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84, 0.0};
+static const double dormand_prince_e[7] = {71.0/57600, 0.0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525, -1.0/40};
+
+static void step_adaptive(sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory, sat_workspace *ws){
+    int n = problem->N + problem->M;
+    int stages = options->method == SOLVER_CASH_KARP ? 6 : 7;
+    const double *b = options->method == SOLVER_CASH_KARP ? cash_karp_b : dormand_prince_b;
+    const double *e = options->method == SOLVER_CASH_KARP ? cash_karp_e : dormand_prince_e;
+    double *y = trajectory->y;
+    double t = trajectory->stats.t;
+    int last = trajectory->h * (1 + 1e-10) >= options->t_max - t;
+    double h = last ? options->t_max - t : trajectory->h;
+
+    if (!trajectory->f_valid){
+        evaluate(problem, options, trajectory, y, trajectory->f);
+        trajectory->f_valid = 1;
+    }
+    memcpy(ws->k[0], trajectory->f, n * sizeof(double));
+    for (int stage = 1; stage < stages; stage++)
+    {
+        const double *a = options->method == SOLVER_CASH_KARP ? cash_karp_a[stage] : dormand_prince_a[stage];
+        for (int i = 0; i < n; i++)
+        {
+            double increment = 0.0;
+            for (int j = 0; j < stage; j++)
+            {
+                increment += a[j] * ws->k[j][i];
+            }
+            ws->y_stage[i] = y[i] + h * increment;
+        }
+        if (options->method == SOLVER_DORMAND_PRINCE && stage == 6){
+            //last stage is evaluated at the new solution (first same as last)
+            memcpy(ws->y_new, ws->y_stage, n * sizeof(double));
+        }
+        evaluate(problem, options, trajectory, ws->y_stage, ws->k[stage]);
+    }
+    if (options->method == SOLVER_CASH_KARP){
+        for (int i = 0; i < n; i++)
+        {
+            double increment = 0.0;
+            for (int j = 0; j < stages; j++)
+            {
+                increment += b[j] * ws->k[j][i];
+            }
+            ws->y_new[i] = y[i] + h * increment;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        double error = 0.0;
+        for (int j = 0; j < stages; j++)
+        {
+            error += e[j] * ws->k[j][i];
+        }
+        ws->y_err[i] = h * error;
+    }
+    double err = scaled_norm(n, ws->y_err, y, ws->y_new, options->atol, options->rtol);
+
+    //PI controller (Hairer & Wanner, Solving ODEs II, IV.2), exponents for an order 4 error estimate
+    double safety = 0.9, min_factor = 0.2, max_factor = 10.0;
+    if (!isfinite(err)){
+        trajectory->h = h * min_factor;
+        trajectory->h_rejected = 1;
+        trajectory->stats.rejected_steps++;
+    }
+    else if (err <= 1.0){
+        double factor = err == 0.0 ? max_factor : safety * pow(err, -0.7/5) * pow(trajectory->err_prev, 0.4/5);
+        factor = fmin(max_factor, fmax(min_factor, factor));
+        if (trajectory->h_rejected){
+            factor = fmin(1.0, factor);
+        }
+        memcpy(y, ws->y_new, n * sizeof(double));
+        if (options->method == SOLVER_DORMAND_PRINCE){
+            memcpy(trajectory->f, ws->k[6], n * sizeof(double));
+        }
+        else {
+            trajectory->f_valid = 0;
+        }
+        trajectory->stats.t = last ? options->t_max : t + h;
+        trajectory->stats.accepted_steps++;
+        trajectory->stats.h_min = fmin(trajectory->stats.h_min, h);
+        trajectory->stats.h_max = fmax(trajectory->stats.h_max, h);
+        trajectory->err_prev = fmax(err, 1e-4);
+        trajectory->h = h * factor;
+        trajectory->h_rejected = 0;
+    }
+    else {
+        double factor = fmax(min_factor, safety * pow(err, -0.2));
+        trajectory->h = h * factor;
+        trajectory->h_rejected = 1;
+        trajectory->stats.rejected_steps++;
+    }
+    trajectory->stats.h_last = trajectory->h;
+    if (trajectory->h_rejected && trajectory->h < options->h_min){
+        trajectory->stats.status = SOLVE_STEP_UNDERFLOW;
+    }
+}
+
+//Allocates the buffers of a trajectory (the state y is owned by the caller), returns 0 on success
+static int trajectory_alloc(const sat_problem *problem, sat_trajectory *trajectory){
+    int N = problem->N;
+    int M = problem->M;
+    memset(trajectory, 0, sizeof(sat_trajectory));
+    trajectory->f = malloc((N+M > 0 ? N+M : 1) * sizeof(double));
+    trajectory->aux = malloc((M > 0 ? M : 1) * sizeof(double));
+    trajectory->spins = malloc((N > 0 ? N : 1) * sizeof(float));
+    trajectory->orthant.positive = malloc(N > 0 ? N : 1);
+    trajectory->orthant.true_literals = malloc((M > 0 ? M : 1) * sizeof(int));
+    if (!trajectory->f || !trajectory->aux || !trajectory->spins || !trajectory->orthant.positive || !trajectory->orthant.true_literals) { return -1; }
+    return 0;
+}
+
+static void trajectory_free(sat_trajectory *trajectory){
+    search_free(trajectory->search);
+    free(trajectory->f);
+    free(trajectory->aux);
+    free(trajectory->spins);
+    free(trajectory->orthant.positive);
+    free(trajectory->orthant.true_literals);
+}
+
+//Initialises an allocated trajectory starting at t = 0 from y
+static void trajectory_init(sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory, double y[]){
+    trajectory->y = y;
+    trajectory->f_valid = 0;
+    trajectory->h = options->h;
+    trajectory->err_prev = 1e-4;
+    trajectory->h_rejected = 0;
+    memset(&trajectory->stats, 0, sizeof(sat_solve_stats));
+    trajectory->stats.status = SOLVE_RUNNING;
+    trajectory->stats.h_min = INFINITY;
+    trajectory->stats.h_max = 0.0;
+    trajectory->orthant.flips = 0;
+    orthant_init(problem, &trajectory->orthant, y);
+    if (exit_reached(problem, options->rhs_type, options->exit_type, &trajectory->orthant, y)){
+        trajectory->stats.status = SOLVE_EXIT;
+    }
+}
+
+//Global renormalisation: if the largest aux variable exceeds aux_limit all of them are divided by it
+//(ln a_m shifted in log-domain states), which keeps a finite on long runs. All aux variables change by
+//the same factor, so their ratios are kept, the spins just see a uniformly rescaled clause weighting.
+//Returns 1 if it was done.
+static int renormalise_aux(const sat_problem *problem, const sat_solve_options *options, double y[]){
+    if (options->aux_limit <= 0.0 || problem->M == 0) { return 0; }
+    int log_aux = options->rhs_type & RHS_LOG_AUX;
+    double *aux = y + problem->N;
+    double largest = aux[0];
+    for (int m = 1; m < problem->M; m++)
+    {
+        largest = fmax(largest, aux[m]);
+    }
+    if (!(largest > (log_aux ? log(options->aux_limit) : options->aux_limit))) { return 0; }
+    for (int m = 0; m < problem->M; m++)
+    {
+        if (log_aux) { aux[m] -= largest; }
+        else { aux[m] /= largest; }
+    }
+    return 1;
+}
+
+//Does one (possibly rejected) step and updates the status of the trajectory
+static void advance_step(sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory, sat_workspace *ws){
+    int adaptive = options->method == SOLVER_CASH_KARP || options->method == SOLVER_DORMAND_PRINCE;
+    long long accepted = trajectory->stats.accepted_steps;
+    if (adaptive){
+        if (trajectory->h <= 0.0){
+            if (!trajectory->f_valid){
+                evaluate(problem, options, trajectory, trajectory->y, trajectory->f);
+                trajectory->f_valid = 1;
+            }
+            trajectory->h = initial_step(problem, options, trajectory, ws);
+        }
+        step_adaptive(problem, options, trajectory, ws);
+    }
+    else {
+        step_fixed(problem, options, trajectory, ws);
+    }
+    if (trajectory->stats.status != SOLVE_RUNNING || trajectory->stats.accepted_steps == accepted) { return; }
+    if (renormalise_aux(problem, options, trajectory->y)){
+        trajectory->f_valid = 0;
+        trajectory->stats.renormalisations++;
+    }
+    long long start = options->timing ? cycle_count() : 0;
+    orthant_update(problem, &trajectory->orthant, trajectory->y);
+    int exit = exit_reached(problem, options->rhs_type, options->exit_type, &trajectory->orthant, trajectory->y);
+    //a found assignment is an orthant exit, under the other exit types the stage would end the solve early
+    if (!exit && options->exit_type == ORTANT && options->finish_threshold > 0) { exit = finish_search(problem, options, trajectory); }
+    if (options->timing) { trajectory->stats.exit_cycles += cycle_count() - start; }
+    if (exit){
+        trajectory->stats.status = SOLVE_EXIT;
+    }
+    else if (trajectory->stats.t >= options->t_max){
+        trajectory->stats.status = SOLVE_T_MAX;
+    }
+    else if (options->max_steps > 0 && trajectory->stats.accepted_steps >= options->max_steps){
+        trajectory->stats.status = SOLVE_MAX_STEPS;
+    }
+}
+
+//Trace file of a solve with a header line, NULL if there is no trace or it cannot be opened
+static FILE *trace_open(const sat_solve_options *options){
+    if (!options->trace_path || options->trace_interval <= 0) { return NULL; }
+    FILE *trace = fopen(options->trace_path, "w");
+    if (trace) { fprintf(trace, "#trajectory step t h unsatisfied flips rhs_evaluations rejected_steps largest_aux\n"); }
+    return trace;
+}
+
+static void trace_sample(const sat_problem *problem, const sat_trajectory *trajectory){
+    double largest = -INFINITY;
+    for (int m = 0; m < problem->M; m++)
+    {
+        largest = fmax(largest, trajectory->y[problem->N + m]);
+    }
+    const sat_solve_stats *stats = &trajectory->stats;
+#ifdef _OPENMP
+    #pragma omp critical(sat_trace)
+#endif
+    fprintf(trajectory->trace, "%d %lld %.17g %.17g %d %lld %lld %lld %.17g\n", trajectory->index, stats->accepted_steps, stats->t, stats->h_last,
+            trajectory->orthant.unsatisfied, trajectory->orthant.flips, stats->rhs_evaluations, stats->rejected_steps, largest);
+}
+
+//advance_step with the instrumentation: cycle count, flips and the sampled trace
+static void trajectory_advance(sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory, sat_workspace *ws){
+    long long start = options->timing ? cycle_count() : 0;
+    long long accepted = trajectory->stats.accepted_steps;
+    advance_step(problem, options, trajectory, ws);
+    trajectory->stats.flips = trajectory->orthant.flips;
+    if (trajectory->trace && trajectory->stats.accepted_steps != accepted &&
+        (trajectory->stats.accepted_steps % options->trace_interval == 0 || trajectory->stats.status != SOLVE_RUNNING)){
+        trace_sample(problem, trajectory);
+    }
+    if (options->timing) { trajectory->stats.cycles += cycle_count() - start; }
+}
+
+//Recorded output of a single solve, the rows kept in the output buffer are counted in the stats
+typedef struct sat_recorder {
+    int width;              //recorded doubles per row besides t
+    long long start;        //accepted steps at the first row (nonzero for a resumed solve), the rows are counted from it
+    long long last;         //accepted steps at the last recorded row, -1 before the first one
+    double *row;            //1 + width doubles
+    FILE *file;             //NULL without an output file
+} sat_recorder;
+
+//Append a row to the output buffer, OUTPUT_DECIMATE keeps only the rows on the stride (steps since the
+//first row) except the final one
+static void output_store(const sat_solve_options *options, sat_solve_stats *stats, const double row[], int width, long long steps, int final){
+    long long capacity = options->output_capacity;
+    size_t size = (size_t)(1 + width);
+    if (options->output_mode == OUTPUT_RING){
+        long long row_index = (stats->output_first + stats->output_rows) % capacity;
+        if (stats->output_rows == capacity) { stats->output_first = (stats->output_first + 1) % capacity; }
+        else { stats->output_rows++; }
+        memcpy(options->output + (size_t)row_index*size, row, size * sizeof(double));
+        return;
+    }
+    if (!final && steps % stats->output_stride) { return; }
+    if (stats->output_rows == capacity){
+        if (capacity < 2){
+            stats->output_rows = 0;
+        }
+        else {
+            //rows 0, 2, 4, ... are the ones on the doubled stride
+            for (long long r = 1; 2*r < stats->output_rows; r++)
+            {
+                memcpy(options->output + (size_t)r*size, options->output + (size_t)(2*r)*size, size * sizeof(double));
+            }
+            stats->output_rows = (stats->output_rows + 1) / 2;
+            stats->output_stride *= 2;
+            if (!final && steps % stats->output_stride) { return; }
+        }
+    }
+    memcpy(options->output + (size_t)stats->output_rows*size, row, size * sizeof(double));
+    stats->output_rows++;
+}
+
+//Records the current state of the trajectory, returns nonzero if the callback asked to stop. A failed
+//write of the output file closes it and ends the solve with SOLVE_TRACE_ERROR
+static int output_record(const sat_solve_options *options, sat_recorder *recorder, sat_trajectory *trajectory, int final){
+    double *row = recorder->row;
+    int stop = 0;
+    row[0] = trajectory->stats.t;
+    memcpy(row + 1, trajectory->y, recorder->width * sizeof(double));
+    recorder->last = trajectory->stats.accepted_steps;
+    if (options->output && options->output_capacity > 0){
+        output_store(options, &trajectory->stats, row, recorder->width, trajectory->stats.accepted_steps - recorder->start, final);
+    }
+    if (recorder->file && fwrite(row, sizeof(double), (size_t)(1 + recorder->width), recorder->file) != (size_t)(1 + recorder->width)){
+        fclose(recorder->file);
+        recorder->file = NULL;
+        trajectory->stats.status = SOLVE_TRACE_ERROR;
+        return 0;
+    }
+    if (options->output_callback) { stop = options->output_callback(options->output_data, row[0], row + 1, recorder->width); }
+    return stop;
+}
+
+//Checkpoints
+//A checkpoint holds everything sat_solve needs to continue a trajectory bit for bit: the state, the
+//rhs at the state when the next step reuses it, the step size controller and the stats (stored as
+//the struct of the writer, so only the same build reads them). Like the cache it is written next to
+//its path and renamed, so a preempted job always finds a complete checkpoint. The rhs sums depend on
+//the number of rhs threads (problem_clause_terms), so a checkpoint only resumes with the same number.
+
+#define CHECKPOINT_VERSION 2
+
+typedef struct checkpoint_header {
+    char magic[8];          //"CTDSCKP" followed by a zero byte
+    uint32_t byte_order;    //CACHE_BYTE_ORDER as written by the writer
+    uint32_t version;
+    uint32_t stats_size;    //sizeof(sat_solve_stats) of the writer, the stats follow the header
+    int32_t N;
+    int32_t M;
+    int32_t rhs_type;
+    int32_t method;
+    int32_t h_rejected;
+    int32_t f_valid;        //the N+M doubles of the rhs follow the N+M doubles of the state
+    int32_t threads;        //rhs threads of the writer (rhs_threads)
+    int64_t literals;
+    uint64_t seed;
+    double h;
+    double err_prev;
+} checkpoint_header;
+
+static const char checkpoint_magic[8] = "CTDSCKP";
+
+static double wall_seconds(void){
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+#else
+    return (double)time(NULL);
+#endif
+}
+
+//Writes the trajectory to options->checkpoint_path, returns 0 on success
+static int checkpoint_write(const sat_problem *problem, const sat_solve_options *options, const sat_trajectory *trajectory){
+    size_t n = (size_t)problem->N + problem->M;
+    checkpoint_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.version = CHECKPOINT_VERSION;
+    header.stats_size = sizeof(sat_solve_stats);
+    header.N = problem->N;
+    header.M = problem->M;
+    header.rhs_type = options->rhs_type;
+    header.method = options->method;
+    header.h_rejected = trajectory->h_rejected;
+    header.f_valid = trajectory->f_valid;
+    header.threads = rhs_threads(problem);
+    header.literals = problem->clause_offsets[problem->M];
+    header.seed = options->seed;
+    header.h = trajectory->h;
+    header.err_prev = trajectory->err_prev;
+    char *temporary = temporary_path(options->checkpoint_path);
+    if (!temporary) { return -1; }
+    FILE *file = fopen(temporary, "wb");
+    if (!file){
+        free(temporary);
+        return -1;
+    }
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(&trajectory->stats, sizeof(sat_solve_stats), 1, file) != 1
+                 || fwrite(trajectory->y, sizeof(double), n, file) != n || (trajectory->f_valid && fwrite(trajectory->f, sizeof(double), n, file) != n);
+    return replace_file(file, failed, temporary, options->checkpoint_path);
+}
+
+//Reads the header and the stats of a checkpoint of this problem, and with y non-NULL also the state
+//(and with f non-NULL the rhs into f if it was stored). Nothing is read into y unless the whole file is valid.
+//Returns 0 on success.
+static int checkpoint_read(const sat_problem *problem, const char *path, checkpoint_header *header, sat_solve_stats *stats, double y[], double f[]){
+    size_t n = (size_t)problem->N + problem->M;
+    FILE *file = fopen(path, "rb");
+    if (!file) { return -1; }
+    int valid = fread(header, sizeof(checkpoint_header), 1, file) == 1 && memcmp(header->magic, checkpoint_magic, sizeof(header->magic)) == 0
+                && header->byte_order == CACHE_BYTE_ORDER && header->version == CHECKPOINT_VERSION && header->stats_size == sizeof(sat_solve_stats)
+                && header->N == problem->N && header->M == problem->M && header->literals == problem->clause_offsets[problem->M]
+                && fread(stats, sizeof(sat_solve_stats), 1, file) == 1;
+    if (valid && y){
+        long size = (long)(sizeof(checkpoint_header) + sizeof(sat_solve_stats) + (header->f_valid ? 2 : 1) * n * sizeof(double));
+        valid = fseek(file, 0, SEEK_END) == 0 && ftell(file) == size && fseek(file, (long)(sizeof(checkpoint_header) + sizeof(sat_solve_stats)), SEEK_SET) == 0
+                && fread(y, sizeof(double), n, file) == n && (!header->f_valid || !f || fread(f, sizeof(double), n, file) == n);
+    }
+    fclose(file);
+    return valid ? 0 : -1;
+}
+
+//Reads the seed and the stats of a checkpoint of this problem without resuming it, returns 0 on success
+int sat_checkpoint_info(sat_problem *problem, const char *path, unsigned long long *seed, sat_solve_stats *stats){
+    checkpoint_header header;
+    if (checkpoint_read(problem, path, &header, stats, NULL, NULL)) { return -1; }
+    *seed = header.seed;
+    return 0;
+}
+
+//Reads the state (N+M doubles) a checkpoint of this problem resumes from, returns 0 on success
+int sat_checkpoint_state(sat_problem *problem, const char *path, double y[]){
+    checkpoint_header header;
+    sat_solve_stats stats;
+    return checkpoint_read(problem, path, &header, &stats, y, NULL);
+}
+
+//Initialises an allocated trajectory from options->resume_path, which has to be a checkpoint of the same
+//problem, rhs type, method and number of rhs threads. The exit condition and the limits are those of
+//options. Returns 0 on success.
+static int trajectory_resume(sat_problem *problem, const sat_solve_options *options, sat_trajectory *trajectory, double y[]){
+    checkpoint_header header;
+    trajectory->y = y;
+    if (checkpoint_read(problem, options->resume_path, &header, &trajectory->stats, y, trajectory->f)
+        || header.rhs_type != options->rhs_type || header.method != options->method || header.threads != rhs_threads(problem)) { return -1; }
+    trajectory->f_valid = header.f_valid;
+    trajectory->h = header.h;
+    trajectory->err_prev = header.err_prev;
+    trajectory->h_rejected = header.h_rejected;
+    trajectory->stats.status = SOLVE_RUNNING;
+    trajectory->stats.output_rows = 0;
+    trajectory->stats.output_first = 0;
+    orthant_init(problem, &trajectory->orthant, y);
+    trajectory->orthant.flips = trajectory->stats.flips;
+    if (exit_reached(problem, options->rhs_type, options->exit_type, &trajectory->orthant, y)){
+        trajectory->stats.status = SOLVE_EXIT;
+    }
+    else if (trajectory->stats.t >= options->t_max){
+        trajectory->stats.status = SOLVE_T_MAX;
+    }
+    else if (options->max_steps > 0 && trajectory->stats.accepted_steps >= options->max_steps){
+        trajectory->stats.status = SOLVE_MAX_STEPS;
+    }
+    return 0;
+}
+
+//Rejects options a solve could never finish with: the fixed step methods need a positive step size
+//(t would not advance toward t_max), and the global renormalisation leaves every aux variable but the
+//largest below 1 (below 0 in the log domain), so aux_limit together with the NEGATIVE_AUX exit would
+//stop right after the first renormalisation. Returns 0 or SOLVE_INVALID_ARGUMENT
+int sat_solve_check(const sat_solve_options *options){
+    if ((options->method == SOLVER_EULER || options->method == SOLVER_RK4) && !(options->h > 0.0)) { return SOLVE_INVALID_ARGUMENT; }
+    if (options->aux_limit > 0.0 && options->exit_type == NEGATIVE_AUX) { return SOLVE_INVALID_ARGUMENT; }
+    return 0;
+}
+
+//Integrates y (N+M doubles, overwritten by the final state) from t = 0 until t_max or the exit
+//condition, returns the final status (also stored in stats). With an output_interval the state
+//is recorded along the way into the output buffer, the output file and the callback, the
+//buffer keeps a bounded number of rows however long the solve runs. With a checkpoint_path the
+//trajectory is saved every checkpoint_interval seconds and when it stops at t_max, max_steps or
+//a cancellation, with a resume_path it continues from a checkpoint (the trace and the output
+//files are started again).
+int sat_solve(sat_problem *problem, const sat_solve_options *options, double y[], sat_solve_stats *stats){
+    int n = problem->N + problem->M;
+    if (sat_solve_check(options)){
+        memset(stats, 0, sizeof(sat_solve_stats));
+        stats->status = SOLVE_INVALID_ARGUMENT;
+        return stats->status;
+    }
+    sat_workspace ws;
+    sat_trajectory trajectory;
+    sat_recorder recorder = {options->output_spins ? problem->N : n, 0, -1, NULL, NULL};
+    int recording = options->output_interval > 0;
+    if (recording) { recorder.row = malloc((size_t)(1 + recorder.width) * sizeof(double)); }
+    if (trajectory_alloc(problem, &trajectory) || (recording && !recorder.row) || workspace_alloc(&ws, n)){
+        free(recorder.row);
+        trajectory_free(&trajectory);
+        memset(stats, 0, sizeof(sat_solve_stats));
+        stats->status = SOLVE_NO_MEMORY;
+        return stats->status;
+    }
+    int checkpointing = options->checkpoint_path != NULL;
+    double checkpoint_time = checkpointing ? wall_seconds() : 0.0;
+    if (!options->resume_path){
+        trajectory_init(problem, options, &trajectory, y);
+    }
+    else if (trajectory_resume(problem, options, &trajectory, y)){
+        trajectory.stats.status = SOLVE_CHECKPOINT_ERROR;
+        checkpointing = 0;
+    }
+    trajectory.trace = trajectory.stats.status != SOLVE_CHECKPOINT_ERROR ? trace_open(options) : NULL;
+    if (options->trace_path && options->trace_interval > 0 && !trajectory.trace && trajectory.stats.status != SOLVE_CHECKPOINT_ERROR){
+        trajectory.stats.status = SOLVE_TRACE_ERROR;
+    }
+    trajectory.stats.output_stride = recording ? options->output_interval : 0;
+    recorder.start = trajectory.stats.accepted_steps;
+    int failed = trajectory.stats.status == SOLVE_TRACE_ERROR || trajectory.stats.status == SOLVE_CHECKPOINT_ERROR;
+    if (recording && options->output_path && !failed){
+        recorder.file = fopen(options->output_path, "wb");
+        if (!recorder.file) { trajectory.stats.status = SOLVE_TRACE_ERROR; }
+    }
+    failed = trajectory.stats.status == SOLVE_TRACE_ERROR || trajectory.stats.status == SOLVE_CHECKPOINT_ERROR;
+    if (recording && !failed &&
+        output_record(options, &recorder, &trajectory, trajectory.stats.status != SOLVE_RUNNING) && trajectory.stats.status == SOLVE_RUNNING){
+        trajectory.stats.status = SOLVE_CANCELLED;
+    }
+    while (trajectory.stats.status == SOLVE_RUNNING)
+    {
+        trajectory_advance(problem, options, &trajectory, &ws);
+        if (recording && trajectory.stats.status == SOLVE_RUNNING && trajectory.stats.accepted_steps != recorder.last &&
+            (trajectory.stats.accepted_steps - recorder.start) % options->output_interval == 0 && output_record(options, &recorder, &trajectory, 0)){
+            trajectory.stats.status = SOLVE_CANCELLED;
+        }
+        if (checkpointing && options->checkpoint_interval > 0 && trajectory.stats.status == SOLVE_RUNNING
+            && wall_seconds() - checkpoint_time >= options->checkpoint_interval){
+            trajectory.stats.checkpoints++;
+            if (checkpoint_write(problem, options, &trajectory)) { trajectory.stats.status = SOLVE_CHECKPOINT_ERROR; }
+            checkpoint_time = wall_seconds();
+        }
+    }
+    if (recording && !failed && trajectory.stats.accepted_steps != recorder.last){
+        output_record(options, &recorder, &trajectory, 1);
+    }
+    if (checkpointing && (trajectory.stats.status == SOLVE_T_MAX || trajectory.stats.status == SOLVE_MAX_STEPS || trajectory.stats.status == SOLVE_CANCELLED)){
+        trajectory.stats.checkpoints++;
+        if (checkpoint_write(problem, options, &trajectory)) { trajectory.stats.status = SOLVE_CHECKPOINT_ERROR; }
+    }
+    //buffered rows may only fail to reach the file when it is closed
+    if (recorder.file && fclose(recorder.file)) { trajectory.stats.status = SOLVE_TRACE_ERROR; }
+    *stats = trajectory.stats;
+    if (trajectory.trace) { fclose(trajectory.trace); }
+    free(recorder.row);
+    workspace_free(&ws);
+    trajectory_free(&trajectory);
+    return stats->status;
+}
+
+//Integrates B trajectories sharing the clause structure, y holds B consecutive states of N+M
+//doubles (overwritten by the final states) and stats receives B entries. The running trajectory
+//with the smallest analog time is always advanced next, so with stop_after = k > 0 the batch
+//stops once k trajectories reached the exit condition first in analog time, the unfinished ones
+//are marked SOLVE_CANCELLED. Only the per-trajectory state is allocated per trajectory, the
+//stage buffers are shared. With several threads (sat_problem_set_threads) the trajectories run
+//concurrently and stop_after counts them in the order they finish instead. All trajectories share
+//one trace file. Returns the number of trajectories that reached the exit condition,
+//SOLVE_NO_MEMORY, SOLVE_TRACE_ERROR or SOLVE_INVALID_ARGUMENT.
+int sat_solve_batch(sat_problem *problem, const sat_solve_options *options, int B, double y[], int stop_after, sat_solve_stats stats[]){
+    int n = problem->N + problem->M;
+    if (sat_solve_check(options)) { return SOLVE_INVALID_ARGUMENT; }
+    sat_workspace ws;
+    sat_trajectory *trajectories = calloc(B > 0 ? B : 1, sizeof(sat_trajectory));
+    if (!trajectories) { return SOLVE_NO_MEMORY; }
+    if (workspace_alloc(&ws, n)){
+        free(trajectories);
+        return SOLVE_NO_MEMORY;
+    }
+    for (int b = 0; b < B; b++)
+    {
+        if (trajectory_alloc(problem, &trajectories[b])){
+            for (int j = 0; j <= b; j++)
+            {
+                trajectory_free(&trajectories[j]);
+            }
+            workspace_free(&ws);
+            free(trajectories);
+            return SOLVE_NO_MEMORY;
+        }
+    }
+
+    FILE *trace = trace_open(options);
+    if (options->trace_path && options->trace_interval > 0 && !trace){
+        for (int b = 0; b < B; b++)
+        {
+            trajectory_free(&trajectories[b]);
+        }
+        workspace_free(&ws);
+        free(trajectories);
+        return SOLVE_TRACE_ERROR;
+    }
+    int solved = 0;
+    for (int b = 0; b < B; b++)
+    {
+        trajectory_init(problem, options, &trajectories[b], y + (size_t)b*n);
+        trajectories[b].index = b;
+        trajectories[b].trace = trace;
+        solved += trajectories[b].stats.status == SOLVE_EXIT;
+    }
+#ifdef _OPENMP
+    if (problem->threads > 1 && B > 1){
+        //Thread pool mode: trajectory lengths differ by orders of magnitude, so the trajectories are
+        //handed out one at a time to whichever thread becomes idle, every thread owns a workspace.
+        //Trajectories of a thread that could not allocate one are finished by the serial loop below
+        #pragma omp parallel num_threads(problem->threads)
+        {
+            sat_workspace thread_ws;
+            int ready = workspace_alloc(&thread_ws, n) == 0;
+            #pragma omp for schedule(dynamic, 1)
+            for (int b = 0; b < B; b++)
+            {
+                while (ready && trajectories[b].stats.status == SOLVE_RUNNING)
+                {
+                    //checked before every step, so trajectories handed out after the batch is done stay untouched
+                    int solved_now;
+                    #pragma omp atomic read
+                    solved_now = solved;
+                    if (stop_after > 0 && solved_now >= stop_after) { break; }
+                    trajectory_advance(problem, options, &trajectories[b], &thread_ws);
+                    if (trajectories[b].stats.status == SOLVE_EXIT){
+                        #pragma omp atomic
+                        solved++;
+                    }
+                }
+            }
+            if (ready) { workspace_free(&thread_ws); }
+        }
+    }
+#endif
+    while (stop_after <= 0 || solved < stop_after)
+    {
+        int next = -1;
+        for (int b = 0; b < B; b++)
+        {
+            if (trajectories[b].stats.status == SOLVE_RUNNING && (next < 0 || trajectories[b].stats.t < trajectories[next].stats.t)){
+                next = b;
+            }
+        }
+        if (next < 0) { break; }
+        trajectory_advance(problem, options, &trajectories[next], &ws);
+        solved += trajectories[next].stats.status == SOLVE_EXIT;
+    }
+    for (int b = 0; b < B; b++)
+    {
+        if (trajectories[b].stats.status == SOLVE_RUNNING){
+            trajectories[b].stats.status = SOLVE_CANCELLED;
+        }
+        stats[b] = trajectories[b].stats;
+        trajectory_free(&trajectories[b]);
+    }
+    if (trace) { fclose(trace); }
+    workspace_free(&ws);
+    free(trajectories);
+    return solved;
+}
+
+//Portfolio: trajectories with their own options race on the threads of the handle. The running ones
+//take turns of PORTFOLIO_SLICE rhs evaluations, so with more trajectories than threads they progress
+//at the same rate of work (analog time is not comparable across rhs types and methods).
+#define PORTFOLIO_SLICE 256
+
+//Integrates B trajectories, trajectory b from the state y + b*(N+M) with options[b] (rhs type,
+//method, tolerances, limits; the trace, output and checkpoint fields are ignored), until the
+//first one reaches its exit condition, the unfinished ones are marked SOLVE_CANCELLED. The final
+//states overwrite y and stats receives B entries. Returns the index of the winner, -1 if every
+//trajectory stopped without reaching the exit condition, SOLVE_NO_MEMORY or SOLVE_INVALID_ARGUMENT.
+int sat_solve_portfolio(sat_problem *problem, int B, const sat_solve_options options[], double y[], sat_solve_stats stats[]){
+    int n = problem->N + problem->M;
+    for (int b = 0; b < B; b++)
+    {
+        if (sat_solve_check(&options[b])) { return SOLVE_INVALID_ARGUMENT; }
+    }
+    int threads = 1;
+#ifdef _OPENMP
+    threads = problem->threads < B ? problem->threads : B;
+    if (threads < 1) { threads = 1; }
+#endif
+    sat_workspace *workspaces = calloc(threads, sizeof(sat_workspace));
+    sat_trajectory *trajectories = calloc(B > 0 ? B : 1, sizeof(sat_trajectory));
+    int allocated = 0;
+    int ready = 0;
+    int failed = !workspaces || !trajectories;
+    while (!failed && ready < threads)
+    {
+        failed = workspace_alloc(&workspaces[ready], n) != 0;
+        ready += !failed;
+    }
+    while (!failed && allocated < B)
+    {
+        failed = trajectory_alloc(problem, &trajectories[allocated]) != 0;
+        allocated++;
+    }
+    int winner = -1;
+    if (!failed){
+        for (int b = B-1; b >= 0; b--)
+        {
+            trajectory_init(problem, &options[b], &trajectories[b], y + (size_t)b*n);
+            trajectories[b].index = b;
+            if (trajectories[b].stats.status == SOLVE_EXIT) { winner = b; }
+        }
+        int proceed = winner < 0;
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(threads) if(threads > 1)
+#endif
+        {
+            int thread = 0;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+#endif
+            while (proceed)
+            {
+#ifdef _OPENMP
+                #pragma omp for schedule(dynamic, 1)
+#endif
+                for (int b = 0; b < B; b++)
+                {
+                    sat_trajectory *trajectory = &trajectories[b];
+                    long long budget = trajectory->stats.rhs_evaluations + PORTFOLIO_SLICE;
+                    while (trajectory->stats.status == SOLVE_RUNNING && trajectory->stats.rhs_evaluations < budget)
+                    {
+                        //checked before every step, no member steps on once a winner exists
+                        int current;
+#ifdef _OPENMP
+                        #pragma omp atomic read
+#endif
+                        current = winner;
+                        if (current >= 0) { break; }
+                        trajectory_advance(problem, &options[b], trajectory, &workspaces[thread]);
+                    }
+                    if (trajectory->stats.status == SOLVE_EXIT){
+                        //the writers are serialised by the critical section (the first winner is kept),
+                        //the write is atomic against the reads of the other members
+#ifdef _OPENMP
+                        #pragma omp critical(sat_portfolio)
+#endif
+                        if (winner < 0){
+#ifdef _OPENMP
+                            #pragma omp atomic write
+#endif
+                            winner = b;
+                        }
+                    }
+                }
+#ifdef _OPENMP
+                #pragma omp single
+#endif
+                {
+                    int running = 0;
+                    for (int b = 0; b < B; b++)
+                    {
+                        running += trajectories[b].stats.status == SOLVE_RUNNING;
+                    }
+                    proceed = winner < 0 && running > 0;
+                }
+            }
+        }
+        for (int b = 0; b < B; b++)
+        {
+            if (trajectories[b].stats.status == SOLVE_RUNNING){
+                trajectories[b].stats.status = SOLVE_CANCELLED;
+            }
+            stats[b] = trajectories[b].stats;
+        }
+    }
+    for (int b = 0; b < allocated; b++)
+    {
+        trajectory_free(&trajectories[b]);
+    }
+    for (int w = 0; w < ready; w++)
+    {
+        workspace_free(&workspaces[w]);
+    }
+    free(workspaces);
+    free(trajectories);
+    return failed ? SOLVE_NO_MEMORY : winner;
+}
+
+//Number of clauses not satisfied by the signs of the spin variables s (s_i > 0 is true)
+int sat_problem_unsatisfied(sat_problem *problem, double s[]){
+    int unsatisfied = 0;
+    for (int m = 0; m < problem->M; m++)
+    {
+        int satisfied = 0;
+        for (int l = problem->clause_offsets[m]; l < problem->clause_offsets[m+1] && !satisfied; l++)
+        {
+            satisfied = (s[problem->literal_variables[l]] > 0) == (problem->literal_signs[l] > 0);
+        }
+        unsatisfied += !satisfied;
+    }
+    return unsatisfied;
+}
+
+//Bit-parallel checking and enumeration
+//Assignments are bit-sliced: one 64 bit word of a variable holds its value in 64 assignments, so a clause
+//is evaluated for all of them with one OR per literal and the problem with one AND per clause.
+//The enumerator numbers the assignments like SAT.all_solutions, bit N-1-i of the integer is the value of
+//variable i (the first variable is the most significant bit). It walks blocks of 64 consecutive integers,
+//in which the lowest 6 bits follow fixed patterns and all other variables are constant, and a clause made
+//only of such constant variables that is false rules out every block up to its lowest bit changing.
+
+//Evaluates count assignments given bit-sliced: assignments[i*words + w] (words = (count+63)/64) holds
+//variable i of the assignments 64*w ... 64*w+63. Bit b of satisfied[w] is set if assignment 64*w+b
+//satisfies every clause. Returns the number of satisfying assignments.
+long long sat_problem_check_packed(sat_problem *problem, long long count, const uint64_t assignments[], uint64_t satisfied[]){
+    long long words = (count + 63) / 64;
+    long long found = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:found) num_threads(problem->threads) if(problem->threads > 1 && words > 1)
+#endif
+    for (long long w = 0; w < words; w++)
+    {
+        uint64_t alive = w == words - 1 && count % 64 ? ((uint64_t)1 << (count % 64)) - 1 : ~(uint64_t)0;
+        for (int m = 0; m < problem->M && alive; m++)
+        {
+            uint64_t clause = 0;
+            for (int l = problem->clause_offsets[m]; l < problem->clause_offsets[m+1]; l++)
+            {
+                uint64_t values = assignments[(size_t)problem->literal_variables[l] * words + w];
+                clause |= problem->literal_signs[l] > 0 ? values : ~values;
+            }
+            alive &= clause;
+        }
+        satisfied[w] = alive;
+        for (uint64_t bits = alive; bits; bits &= bits - 1)
+        {
+            found++;
+        }
+    }
+    return found;
+}
+
+typedef struct enumerator {
+    int M;
+    int *clause_offsets;    //clauses sorted by their lowest bit, highest first
+    int *literals;          //2*(bit of the variable) + (1 if negated)
+    int *lowest;            //per sorted clause, lowest bit of its variables (N for an empty clause)
+} enumerator;
+
+typedef struct solution_buffer {
+    uint64_t *data;
+    long long size;
+    long long capacity;
+    long long limit;        //the enumeration stops once this many solutions are stored
+    int growable;
+    int failed;
+} solution_buffer;
+
+static int enumerator_init(enumerator *enumerator, const sat_problem *problem){
+    int N = problem->N;
+    int M = problem->M;
+    int L = problem->clause_offsets[M];
+    enumerator->M = M;
+    enumerator->clause_offsets = malloc((size_t)(M+1) * sizeof(int));
+    enumerator->literals = malloc((L > 0 ? L : 1) * sizeof(int));
+    enumerator->lowest = malloc((M > 0 ? M : 1) * sizeof(int));
+    int *lowest = malloc((M > 0 ? M : 1) * sizeof(int));
+    int counts[64 + 1] = {0};
+    if (!enumerator->clause_offsets || !enumerator->literals || !enumerator->lowest || !lowest){
+        free(lowest);
+        return -1;
+    }
+    for (int m = 0; m < M; m++)
+    {
+        lowest[m] = N;
+        for (int l = problem->clause_offsets[m]; l < problem->clause_offsets[m+1]; l++)
+        {
+            int bit = N - 1 - problem->literal_variables[l];
+            if (bit < lowest[m]) { lowest[m] = bit; }
+        }
+        counts[N - lowest[m]]++;
+    }
+    //counting sort, descending lowest bit, stable in the clause index
+    for (int rank = 1; rank <= 64; rank++)
+    {
+        counts[rank] += counts[rank-1];
+    }
+    int *order = enumerator->lowest;    //clause of every sorted position first, replaced below
+    for (int m = M - 1; m >= 0; m--)
+    {
+        order[--counts[N - lowest[m]]] = m;
+    }
+    int l = 0;
+    for (int position = 0; position < M; position++)
+    {
+        int m = order[position];
+        enumerator->clause_offsets[position] = l;
+        for (int k = problem->clause_offsets[m]; k < problem->clause_offsets[m+1]; k++)
+        {
+            enumerator->literals[l++] = 2*(N - 1 - problem->literal_variables[k]) + (problem->literal_signs[k] < 0);
+        }
+        order[position] = lowest[m];
+    }
+    enumerator->clause_offsets[M] = l;
+    free(lowest);
+    return 0;
+}
+
+static void enumerator_free(enumerator *enumerator){
+    free(enumerator->clause_offsets);
+    free(enumerator->literals);
+    free(enumerator->lowest);
+}
+
+static int lowest_set_bit(uint64_t word){
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    for (; !(word & 1); word >>= 1)
+    {
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static int solution_push(solution_buffer *buffer, uint64_t solution){
+    if (buffer->size == buffer->capacity){
+        long long capacity = buffer->capacity ? 2 * buffer->capacity : 1024;
+        if (capacity > buffer->limit) { capacity = buffer->limit; }
+        uint64_t *data = buffer->growable ? realloc(buffer->data, (size_t)capacity * sizeof(uint64_t)) : NULL;
+        if (!data){
+            buffer->failed = 1;
+            return -1;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    buffer->data[buffer->size++] = solution;
+    return 0;
+}
+
+//Stores the satisfying assignments in [begin, end) until the limit of the buffer is reached,
+//returns where the enumeration continues (end once the range is done)
+static uint64_t enumerate_range(const enumerator *enumerator, uint64_t begin, uint64_t end, solution_buffer *out){
+    static const uint64_t patterns[6] = {0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+                                         0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull};
+    uint64_t position = begin;
+    while (position < end)
+    {
+        uint64_t base = position & ~(uint64_t)63;
+        uint64_t alive = ~(uint64_t)0 << (position - base);
+        if (end - base < 64) { alive &= ((uint64_t)1 << (end - base)) - 1; }
+        uint64_t following = base + 64;
+        for (int m = 0; m < enumerator->M && alive; m++)
+        {
+            uint64_t clause = 0;
+            for (int l = enumerator->clause_offsets[m]; l < enumerator->clause_offsets[m+1]; l++)
+            {
+                int bit = enumerator->literals[l] >> 1;
+                uint64_t values = bit < 6 ? patterns[bit] : (uint64_t)0 - ((base >> bit) & 1);
+                clause |= enumerator->literals[l] & 1 ? ~values : values;
+            }
+            alive &= clause;
+            int lowest = enumerator->lowest[m];
+            if (!clause && lowest >= 6) { following = ((base >> lowest) + 1) << lowest; }
+        }
+        for (; alive; alive &= alive - 1)
+        {
+            uint64_t solution = base + (uint64_t)lowest_set_bit(alive);
+            if (solution_push(out, solution)) { return solution; }
+            if (out->size == out->limit) { return solution + 1; }
+        }
+        position = following;
+    }
+    return end;
+}
+
+//Writes the satisfying assignments numbered in [first, last) (capped at 2^N) in ascending order into
+//solutions, at most capacity of them, and sets *next to where the enumeration continues (last once the
+//range is done). Several threads work on consecutive chunks of the range. Needs N <= 62, returns the
+//number of solutions written or -1 on failure.
+long long sat_problem_enumerate(sat_problem *problem, uint64_t first, uint64_t last, uint64_t solutions[], long long capacity, uint64_t *next){
+    if (problem->N > 62) { return -1; }
+    uint64_t total = (uint64_t)1 << problem->N;
+    if (last > total) { last = total; }
+    *next = first < last ? first : last;
+    if (first >= last || capacity <= 0) { return 0; }
+    enumerator enumerator;
+    if (enumerator_init(&enumerator, problem)){
+        enumerator_free(&enumerator);
+        return -1;
+    }
+    long long written = 0;
+    int failed = 0;
+#ifdef _OPENMP
+    if (problem->threads > 1){
+        const uint64_t chunk = (uint64_t)64 << 14;
+        int chunks = 4 * problem->threads;
+        solution_buffer *buffers = calloc(chunks, sizeof(solution_buffer));
+        uint64_t *resume = malloc(chunks * sizeof(uint64_t));
+        failed = !buffers || !resume;
+        uint64_t position = first;
+        while (!failed && position < last && written < capacity)
+        {
+            #pragma omp parallel for schedule(dynamic, 1) num_threads(problem->threads)
+            for (int c = 0; c < chunks; c++)
+            {
+                uint64_t begin = position + c * chunk;
+                buffers[c].size = 0;
+                buffers[c].limit = capacity - written;
+                buffers[c].growable = 1;
+                resume[c] = begin < last ? enumerate_range(&enumerator, begin, last - begin > chunk ? begin + chunk : last, &buffers[c]) : last;
+            }
+            //the chunks are concatenated in order until the output is full
+            for (int c = 0; c < chunks && position < last; c++)
+            {
+                uint64_t end = last - position > chunk ? position + chunk : last;
+                long long count = buffers[c].size < capacity - written ? buffers[c].size : capacity - written;
+                if (buffers[c].failed) { failed = 1; }
+                memcpy(solutions + written, buffers[c].data, (size_t)count * sizeof(uint64_t));
+                written += count;
+                if (failed || count < buffers[c].size || resume[c] < end){
+                    position = count < buffers[c].size ? buffers[c].data[count] : resume[c];
+                    break;
+                }
+                position = end;
+            }
+        }
+        *next = position;
+        for (int c = 0; buffers && c < chunks; c++)
+        {
+            free(buffers[c].data);
+        }
+        free(buffers);
+        free(resume);
+    }
+    else
+#endif
+    {
+        solution_buffer out = {solutions, 0, capacity, capacity, 0, 0};
+        *next = enumerate_range(&enumerator, first, last, &out);
+        written = out.size;
+        failed = out.failed;
+    }
+    enumerator_free(&enumerator);
+    return failed ? -1 : written;
+}
+
+//Solution clusters
+//Two solutions are neighbours if they differ in one variable, a cluster is a connected component of
+//that graph. The solutions are put in an open addressing hash table, every single bit flip of every
+//solution is looked up (O(S*N)) and the neighbours are merged with union-find.
+
+static int find_root(int parent[], int i){
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+//Clusters S distinct solutions of N variables (bit masks as from sat_problem_enumerate). cluster[s] is
+//set to the cluster of solution s, the clusters being numbered in the order of their first solution,
+//and sizes[c] (S entries at most) to the number of solutions in cluster c. Returns the number of
+//clusters, -1 on failure.
+int sat_solution_clusters(int S, int N, const uint64_t solutions[], int cluster[], int sizes[]){
+    if (S < 0 || N < 0 || N > 64) { return -1; }
+    size_t capacity = 2;
+    while (capacity < 2 * (size_t)S)
+    {
+        capacity *= 2;
+    }
+    int *table = malloc(capacity * sizeof(int));    //solution index or -1
+    int *parent = malloc((S > 0 ? S : 1) * sizeof(int));
+    if (!table || !parent){
+        free(table);
+        free(parent);
+        return -1;
+    }
+    for (size_t slot = 0; slot < capacity; slot++)
+    {
+        table[slot] = -1;
+    }
+    for (int s = 0; s < S; s++)
+    {
+        size_t slot = mix64(solutions[s]) & (capacity - 1);
+        while (table[slot] >= 0)
+        {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = s;
+        parent[s] = s;
+        sizes[s] = 1;   //size of the tree rooted at s while merging
+    }
+    for (int s = 0; s < S; s++)
+    {
+        for (int bit = 0; bit < N; bit++)
+        {
+            uint64_t neighbour = solutions[s] ^ ((uint64_t)1 << bit);
+            size_t slot = mix64(neighbour) & (capacity - 1);
+            while (table[slot] >= 0 && solutions[table[slot]] != neighbour)
+            {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (table[slot] < 0) { continue; }
+            int root = find_root(parent, s);
+            int other = find_root(parent, table[slot]);
+            if (root == other) { continue; }
+            if (sizes[root] < sizes[other]){
+                int swap = root;
+                root = other;
+                other = swap;
+            }
+            parent[other] = root;
+            sizes[root] += sizes[other];
+        }
+    }
+    //numbering in the order of the first solution of every cluster, table is reused for the root numbers
+    for (int s = 0; s < S; s++)
+    {
+        table[s] = -1;
+    }
+    int clusters = 0;
+    for (int s = 0; s < S; s++)
+    {
+        int root = find_root(parent, s);
+        if (table[root] < 0) { table[root] = clusters++; }
+        cluster[s] = table[root];
+    }
+    for (int c = 0; c < clusters; c++)
+    {
+        sizes[c] = 0;
+    }
+    for (int s = 0; s < S; s++)
+    {
+        sizes[cluster[s]]++;
+    }
+    free(table);
+    free(parent);
+    return clusters;
+}
+
+//Lyapunov spectrum
+//Benettin's method: the state and the leading p tangent vectors w_r (dw_r/dt = J(y) w_r) are
+//integrated together with fixed step RK4, the tangent products use the matrix-free jvp kernel.
+//Every qr_interval steps the tangent vectors are re-orthonormalised (modified Gram-Schmidt),
+//the logarithms of the norms are accumulated and divided by the elapsed time to give the running
+//estimates of the p largest exponents. Memory is O(p*(N+M)).
+
+typedef struct sat_lyapunov_options {
+    int rhs_type;
+    int exit_type;          //as in sat_solve_options, anything else runs until t_max
+    int exponents;          //number p of tangent vectors (leading exponents)
+    int qr_interval;        //steps between re-orthonormalisations (<= 0: every step)
+    double t_max;
+    double h;               //RK4 step size
+    int max_records;        //rows of the history buffer, the first max_records estimates are kept
+} sat_lyapunov_options;
+
+typedef struct sat_lyapunov_stats {
+    int status;             //SOLVE_* constant
+    double t;
+    long long steps;
+    long long rhs_evaluations;
+    long long jvp_products; //tangent vector products J v
+    int orthonormalisations;
+    int records;            //rows written into the history buffer
+} sat_lyapunov_stats;
+
+//Orthonormalises the p vectors of length n stored one after the other and adds log |r_ii| to sums,
+//returns 0 if none of them vanished
+static int orthonormalise(int n, int p, double W[], double sums[]){
+    int degenerate = 0;
+    for (int r = 0; r < p; r++)
+    {
+        double *w = W + (size_t)r*n;
+        for (int q = 0; q < r; q++)
+        {
+            const double *u = W + (size_t)q*n;
+            double dot = 0.0;
+            for (int i = 0; i < n; i++)
+            {
+                dot += w[i] * u[i];
+            }
+            for (int i = 0; i < n; i++)
+            {
+                w[i] -= dot * u[i];
+            }
+        }
+        double norm = 0.0;
+        for (int i = 0; i < n; i++)
+        {
+            norm += w[i] * w[i];
+        }
+        norm = sqrt(norm);
+        if (!(norm > 0.0) || !isfinite(norm)){
+            degenerate = 1;
+            continue;
+        }
+        sums[r] += log(norm);
+        for (int i = 0; i < n; i++)
+        {
+            w[i] /= norm;
+        }
+    }
+    return degenerate;
+}
+
+//Integrates y (N+M doubles, overwritten by the final state) and p = options->exponents tangent
+//vectors from t = 0 until t_max or the exit condition. tangent holds the p initial vectors one
+//after the other (NULL: the first p unit vectors) and receives the final orthonormal ones,
+//exponents receives the p estimates and history (NULL or max_records*(p+1) doubles) the rows
+//t, lambda_1 ... lambda_p after every re-orthonormalisation. Returns the final status,
+//SOLVE_INVALID_ARGUMENT unless 1 <= p <= N+M and h > 0.
+int sat_lyapunov(sat_problem *problem, const sat_lyapunov_options *options, double y[], double tangent[], double exponents[], double history[], sat_lyapunov_stats *stats){
+    int N = problem->N;
+    int n = N + problem->M;
+    int p = options->exponents;
+    size_t pn = (size_t)p * n;
+    int interval = options->qr_interval > 0 ? options->qr_interval : 1;
+    memset(stats, 0, sizeof(sat_lyapunov_stats));
+    if (p < 1 || p > n || !(options->h > 0.0)){
+        stats->status = SOLVE_INVALID_ARGUMENT;
+        return stats->status;
+    }
+    sat_workspace ws;
+    double *buffer = malloc((6 * pn + p > 0 ? 6 * pn + p : 1) * sizeof(double));
+    orthant_tracker tracker;
+    tracker.positive = malloc(N > 0 ? N : 1);
+    tracker.true_literals = malloc((problem->M > 0 ? problem->M : 1) * sizeof(int));
+    tracker.flips = 0;
+    if (!buffer || !tracker.positive || !tracker.true_literals || workspace_alloc(&ws, n)){
+        free(buffer);
+        free(tracker.positive);
+        free(tracker.true_literals);
+        stats->status = SOLVE_NO_MEMORY;
+        return stats->status;
+    }
+    double *W = buffer;                 //tangent vectors
+    double *dW[4] = {W + pn, W + 2*pn, W + 3*pn, W + 4*pn};
+    double *W_stage = W + 5*pn;
+    double *sums = W + 6*pn;
+    if (tangent) { memcpy(W, tangent, pn * sizeof(double)); }
+    else {
+        memset(W, 0, pn * sizeof(double));
+        for (int r = 0; r < p; r++)
+        {
+            W[(size_t)r*n + r] = 1.0;
+        }
+    }
+    memset(sums, 0, p * sizeof(double));
+    for (int r = 0; r < p; r++)
+    {
+        exponents[r] = 0.0;
+    }
+    orthonormalise(n, p, W, sums);
+    memset(sums, 0, p * sizeof(double));
+
+    stats->status = SOLVE_RUNNING;
+    orthant_init(problem, &tracker, y);
+    if (exit_reached(problem, options->rhs_type, options->exit_type, &tracker, y)) { stats->status = SOLVE_EXIT; }
+    static const double stage[3] = {0.5, 0.5, 1.0};
+    while (stats->status == SOLVE_RUNNING)
+    {
+        int last = options->h * (1 + 1e-10) >= options->t_max - stats->t;
+        double h = last ? options->t_max - stats->t : options->h;
+        //stage 1 at (y, W), stages 2 to 4 at y + c h k_(s-1), W + c h dW_(s-1)
+        sat_problem_rhs(problem, options->rhs_type, y, ws.k[0]);
+        sat_problem_jvp_batch(problem, options->rhs_type, y, p, W, dW[0]);
+        for (int s = 1; s < 4; s++)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                ws.y_stage[i] = y[i] + stage[s-1] * h * ws.k[s-1][i];
+            }
+            for (size_t e = 0; e < pn; e++)
+            {
+                W_stage[e] = W[e] + stage[s-1] * h * dW[s-1][e];
+            }
+            sat_problem_rhs(problem, options->rhs_type, ws.y_stage, ws.k[s]);
+            sat_problem_jvp_batch(problem, options->rhs_type, ws.y_stage, p, W_stage, dW[s]);
+        }
+        for (int i = 0; i < n; i++)
+        {
+            y[i] += h * (ws.k[0][i] + 2*ws.k[1][i] + 2*ws.k[2][i] + ws.k[3][i]) / 6.0;
+        }
+        for (size_t e = 0; e < pn; e++)
+        {
+            W[e] += h * (dW[0][e] + 2*dW[1][e] + 2*dW[2][e] + dW[3][e]) / 6.0;
+        }
+        stats->t = last ? options->t_max : stats->t + h;
+        stats->steps++;
+        stats->rhs_evaluations += 4;
+        stats->jvp_products += 4 * (long long)p;
+        if (!all_finite(n, y) || !all_finite((int)pn, W)) { stats->status = SOLVE_NOT_FINITE; }
+        else {
+            orthant_update(problem, &tracker, y);
+            if (exit_reached(problem, options->rhs_type, options->exit_type, &tracker, y)) { stats->status = SOLVE_EXIT; }
+            else if (stats->t >= options->t_max) { stats->status = SOLVE_T_MAX; }
+        }
+        if (stats->status == SOLVE_NOT_FINITE) { break; }
+        if (stats->steps % interval == 0 || stats->status != SOLVE_RUNNING){
+            if (orthonormalise(n, p, W, sums)) { stats->status = SOLVE_NOT_FINITE; }
+            stats->orthonormalisations++;
+            for (int r = 0; r < p; r++)
+            {
+                exponents[r] = sums[r] / stats->t;
+            }
+            if (history && stats->records < options->max_records){
+                double *row = history + (size_t)stats->records * (p+1);
+                row[0] = stats->t;
+                memcpy(row + 1, exponents, p * sizeof(double));
+                stats->records++;
+            }
+        }
+    }
+    if (tangent) { memcpy(tangent, W, pn * sizeof(double)); }
+    workspace_free(&ws);
+    free(buffer);
+    free(tracker.positive);
+    free(tracker.true_literals);
+    return stats->status;
+}
@@ -0,0 +1,914 @@
+/*                                                *
+ *      GPU backend of the CTDS library           *
+ *                                                *
+ *  batched rhs evaluation and integration with   *
+ *  the clause structure and all trajectory       *
+ *  states resident on the device                 *
+ *                                                *
+ *  to compile (CUDA, sm_60 or newer) use:        *
+ *  nvcc -O3 -arch=sm_60 -Xcompiler -fPIC         *
+ *     -c cSAT_cuda.cu                            *
+ *  cc -std=c99 -O2 -fPIC -c cSAT.c               *
+ *  nvcc -shared -o cSAT_cuda.so cSAT.o           *
+ *     cSAT_cuda.o                                *
+ *  (HIP: hipcc -O3 -fPIC -x hip -c cSAT_cuda.cu, *
+ *  then link with hipcc -shared)                 *
+ *                                                *
+ *  cSAT_cuda.so contains the whole cSAT.c        *
+ *  library as well, so it can be loaded by SAT   *
+ *  in place of cSAT.so                           */
+
+#ifdef __HIP_PLATFORM_AMD__
+#include <hip/hip_runtime.h>
+#define cudaError_t hipError_t
+#define cudaSuccess hipSuccess
+#define cudaGetDeviceCount hipGetDeviceCount
+#define cudaSetDevice hipSetDevice
+#define cudaMalloc hipMalloc
+#define cudaFree hipFree
+#define cudaMemcpy hipMemcpy
+#define cudaMemcpyHostToDevice hipMemcpyHostToDevice
+#define cudaMemcpyDeviceToHost hipMemcpyDeviceToHost
+#define cudaMemset hipMemset
+#define cudaGetLastError hipGetLastError
+#define cudaDeviceSynchronize hipDeviceSynchronize
+#define __shfl_down_sync(mask, value, offset) __shfl_down(value, offset)
+#else
+#include <cuda_runtime.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//Mirror of the constants and structures of cSAT.c shared by the two halves of the library
+#define RHS_TYPE_TWO 2
+#define RHS_TYPE_THREE 3
+#define RHS_TYPE_FOUR 4
+#define RHS_TYPE_FIVE 5
+#define RHS_LOG_AUX 16
+#define RHS_MIXED_PRECISION 32
+#define RHS_FLAGS (RHS_LOG_AUX | RHS_MIXED_PRECISION)
+
+#define ORTANT 0
+#define CONVERGENCE_RADIUS -1
+#define NEGATIVE_AUX -2
+
+#define SOLVER_EULER 0
+#define SOLVER_RK4 1
+#define SOLVER_CASH_KARP 2
+#define SOLVER_DORMAND_PRINCE 3
+
+#define SOLVE_RUNNING 2
+#define SOLVE_EXIT 1
+#define SOLVE_T_MAX 0
+#define SOLVE_STEP_UNDERFLOW -1
+#define SOLVE_MAX_STEPS -2
+#define SOLVE_NO_MEMORY -3
+#define SOLVE_NOT_FINITE -4
+#define SOLVE_CANCELLED -5
+#define SOLVE_DEVICE_ERROR -6   //no usable device, or a failed kernel launch or transfer
+#define SOLVE_INVALID_ARGUMENT -9
+
+#define GPU_BLOCK 256           //threads per block, a multiple of the warp size
+#define GPU_MAX_BATCH 65535     //trajectories of one call (second grid dimension)
+#define GPU_POLL_INTERVAL 16    //steps between two reads of the number of running trajectories
+
+extern "C" {
+
+typedef struct sat_problem sat_problem;
+
+int sat_problem_variables(sat_problem *problem);
+int sat_problem_clauses(sat_problem *problem);
+int sat_problem_literals(sat_problem *problem);
+void sat_problem_export(sat_problem *problem, int clause_offsets[], int literal_variables[], int literal_signs[]);
+
+typedef int (*sat_output_callback)(void *data, double t, const double row[], int width);
+
+typedef struct sat_solve_options {
+    int rhs_type;
+    int method;
+    int exit_type;
+    double t_max;
+    double h;
+    double atol;
+    double rtol;
+    double h_min;
+    long long max_steps;
+    double aux_limit;
+    int timing;             //the instrumentation of the CPU solver is not available here, the
+    int trace_interval;     //cycle counts and flips stay zero and no trace is written
+    const char *trace_path;
+    int output_interval;    //trajectory output is only recorded by sat_solve, the batches ignore it
+    int output_mode;
+    int output_spins;
+    long long output_capacity;
+    double *output;
+    const char *output_path;
+    sat_output_callback output_callback;
+    void *output_data;
+    double checkpoint_interval; //checkpoints are only written and resumed by sat_solve
+    const char *checkpoint_path;
+    const char *resume_path;
+    unsigned long long seed;
+    int finish_threshold;   //the local search finishing stage only runs on the CPU
+    long long finish_flips;
+    double finish_noise;
+} sat_solve_options;
+
+typedef struct sat_solve_stats {
+    int status;
+    double t;
+    long long accepted_steps;
+    long long rejected_steps;
+    long long rhs_evaluations;
+    double h_min;
+    double h_max;
+    double h_last;
+    long long renormalisations;
+    long long flips;
+    long long rhs_cycles;
+    long long exit_cycles;
+    long long cycles;
+    long long output_rows;
+    long long output_first;
+    long long output_stride;
+    long long checkpoints;
+    long long searches;
+    long long search_flips;
+    int search_unsatisfied;
+    int search_solved;
+} sat_solve_stats;
+
+int sat_solve_check(const sat_solve_options *options);
+
+}
+
+
+//Device copy of the clause structure: the clause arrays of cSAT.c and, for the segmented reduction
+//of ds, the literal slots of every variable (ascending, so the sums run in the order of the CPU kernels)
+typedef struct gpu_clauses {
+    int N;
+    int M;
+    int L;
+    int *clause_offsets;        //M+1 entries
+    int *literal_variables;     //L entries
+    int *literal_signs;         //L entries
+    int *occurrence_offsets;    //N+1 entries
+    int *occurrence_literals;   //L entries
+} gpu_clauses;
+
+typedef struct sat_gpu_problem {
+    int device;
+    gpu_clauses clauses;
+} sat_gpu_problem;
+
+//Per trajectory state of the device integrator, only the stats are copied back
+typedef struct gpu_trajectory {
+    sat_solve_stats stats;
+    double h;               //proposed step size
+    double h_step;          //step size of the current attempt
+    double err_prev;
+    double err_sum;         //sum of the squared scaled errors of the current attempt
+    double d[3];            //squared norms of the initial step selection
+    double norm_squared;    //of the spins after the step
+    double largest_aux;
+    int unsatisfied;
+    int negative_aux;
+    int not_finite;
+    int accepted;           //the current attempt was accepted (or the initial state is being checked)
+    int h_rejected;
+    int f_valid;
+} gpu_trajectory;
+
+//Butcher tableau passed by value, so concurrent solves do not share constant memory
+typedef struct gpu_tableau {
+    int stages;
+    int adaptive;
+    int fsal;               //the last stage is the rhs at the new solution (Dormand-Prince)
+    double a[7][6];
+    double b[7];
+    double e[7];
+} gpu_tableau;
+
+typedef struct gpu_stages {
+    double *k[7];           //k[0] is the rhs at the current state
+} gpu_stages;
+
+//Device buffers of one batch (cudaFree ignores the ones that were never allocated)
+typedef struct gpu_batch {
+    double *y;
+    double *stage;
+    double *y_new;
+    double *terms;          //per literal contributions to ds, B*L
+    double *a_sums;         //sum of the aux variables of every trajectory (sin bias)
+    gpu_stages k;
+    gpu_trajectory *trajectories;
+    int *counters;          //running trajectories of the last poll, trajectories that reached the exit condition
+    unsigned char *assignments;
+} gpu_batch;
+
+
+//Warp reductions, the lane 0 result is the total of the warp
+__device__ static double warp_sum(double value){
+    for (int offset = warpSize / 2; offset > 0; offset /= 2)
+    {
+        value += __shfl_down_sync(0xffffffff, value, offset);
+    }
+    return value;
+}
+
+__device__ static double warp_max(double value){
+    for (int offset = warpSize / 2; offset > 0; offset /= 2)
+    {
+        value = fmax(value, __shfl_down_sync(0xffffffff, value, offset));
+    }
+    return value;
+}
+
+//Adds the values of all threads of the warp to *total, every thread of the warp has to call it
+__device__ static void accumulate(double *total, double value){
+    value = warp_sum(value);
+    if (threadIdx.x % warpSize == 0) { atomicAdd(total, value); }
+}
+
+__device__ static void accumulate_max(double *total, double value){
+    value = warp_max(value);
+    if (threadIdx.x % warpSize == 0){
+        unsigned long long *address = (unsigned long long *)total;
+        unsigned long long old = *address;
+        while (__longlong_as_double(old) < value)
+        {
+            unsigned long long assumed = old;
+            old = atomicCAS(address, assumed, __double_as_longlong(value));
+            if (old == assumed) { break; }
+        }
+    }
+}
+
+//Whole blocks belong to one trajectory (blockIdx.y), so the early returns never split a warp
+__device__ static int skipped(const gpu_trajectory *trajectories, int b, int invalid_only){
+    if (!trajectories) { return 0; }
+    return trajectories[b].stats.status != SOLVE_RUNNING || (invalid_only && trajectories[b].f_valid);
+}
+
+__device__ static int has_sin_bias(int rhs_type){
+    rhs_type &= ~RHS_FLAGS;
+    return rhs_type == RHS_TYPE_THREE || rhs_type == RHS_TYPE_FOUR || rhs_type == RHS_TYPE_FIVE;
+}
+
+//K_m / 2^-k_m of clause m and the contribution of every literal to ds (prefix products are kept in
+//the term slots, so the products without one factor need no division). The factors are of type real,
+//float for RHS_MIXED_PRECISION, which matters most on devices with few double units
+template <typename real>
+__device__ static real clause_terms(const gpu_clauses &c, const double *s, int m, double a, double *term){
+    int first = c.clause_offsets[m];
+    int end = c.clause_offsets[m+1];
+    double weight = ldexp(1.0, first - end);
+    real product = 1;
+    for (int l = first; l < end; l++)
+    {
+        term[l] = product;
+        product *= (real)1 - (real)c.literal_signs[l] * (real)s[c.literal_variables[l]];
+    }
+    real suffix = 1;
+    for (int l = end - 1; l >= first; l--)
+    {
+        real sign = c.literal_signs[l];
+        real factor = (real)1 - sign * (real)s[c.literal_variables[l]];
+        double k = weight * term[l] * suffix;
+        term[l] = 2.0 * a * sign * factor * k * k;
+        suffix *= factor;
+    }
+    return product;
+}
+
+//One thread per clause: K_m and the aux part of the rhs, the literal contributions
+//and the sums of the aux variables for the sin bias
+__global__ static void clause_kernel(gpu_clauses c, int rhs_type, const double *y, double *result, double *terms, double *a_sums,
+                                     const gpu_trajectory *trajectories, int invalid_only){
+    int b = blockIdx.y;
+    if (skipped(trajectories, b, invalid_only)) { return; }
+    int m = blockIdx.x * blockDim.x + threadIdx.x;
+    size_t row = (size_t)b * (c.N + c.M);
+    int log_aux = rhs_type & RHS_LOG_AUX;
+    int type = rhs_type & ~RHS_FLAGS;
+    const double *s = y + row;
+    double a = 0.0;
+    if (m < c.M){
+        double *term = terms + (size_t)b * c.L;
+        a = log_aux ? exp(s[c.N+m]) : s[c.N+m];
+        double product = rhs_type & RHS_MIXED_PRECISION ? clause_terms<float>(c, s, m, a, term) : clause_terms<double>(c, s, m, a, term);
+        double K = ldexp(product, c.clause_offsets[m] - c.clause_offsets[m+1]);
+        double rate = type == RHS_TYPE_TWO || type == RHS_TYPE_THREE ? K * K : K;
+        if (!log_aux) { rate *= a; }
+        result[row + c.N + m] = type == RHS_TYPE_FIVE ? -rate : rate;
+    }
+    if (has_sin_bias(rhs_type)) { accumulate(a_sums + b, a); }
+}
+
+//One thread per variable: segmented reduction of the literal contributions, plus the sin bias
+__global__ static void variable_kernel(gpu_clauses c, int rhs_type, const double *y, double *result, const double *terms, const double *a_sums,
+                                       const gpu_trajectory *trajectories, int invalid_only){
+    int b = blockIdx.y;
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (skipped(trajectories, b, invalid_only) || i >= c.N) { return; }
+    size_t row = (size_t)b * (c.N + c.M);
+    const double *term = terms + (size_t)b * c.L;
+    double ds = 0.0;
+    for (int o = c.occurrence_offsets[i]; o < c.occurrence_offsets[i+1]; o++)
+    {
+        ds += term[c.occurrence_literals[o]];
+    }
+    if (has_sin_bias(rhs_type) && c.M > 0){
+        double constant = 0.5*M_PI*0.0725*((double)c.M/c.N)*(a_sums[b]/c.M);
+        ds += constant*sin(M_PI*y[row+i]);
+    }
+    result[row+i] = (rhs_type & ~RHS_FLAGS) == RHS_TYPE_FIVE ? -ds : ds;
+}
+
+static dim3 grid(int count, int B){
+    return dim3((count + GPU_BLOCK - 1) / GPU_BLOCK > 0 ? (count + GPU_BLOCK - 1) / GPU_BLOCK : 1, B);
+}
+
+//rhs of the B states y into result, only for the running trajectories (all of them without trajectories)
+static void gpu_rhs(const sat_gpu_problem *problem, int rhs_type, int B, const double *y, double *result, gpu_batch *batch,
+                    const gpu_trajectory *trajectories, int invalid_only){
+    const gpu_clauses *c = &problem->clauses;
+    cudaMemset(batch->a_sums, 0, B * sizeof(double));
+    clause_kernel<<<grid(c->M, B), GPU_BLOCK>>>(*c, rhs_type, y, result, batch->terms, batch->a_sums, trajectories, invalid_only);
+    variable_kernel<<<grid(c->N, B), GPU_BLOCK>>>(*c, rhs_type, y, result, batch->terms, batch->a_sums, trajectories, invalid_only);
+}
+
+
+//Integrator kernels, one thread per state entry (blockIdx.y is the trajectory) or one per trajectory
+
+__global__ static void init_kernel(int B, sat_solve_options options, gpu_trajectory *trajectories){
+    int b = blockIdx.x * blockDim.x + threadIdx.x;
+    if (b >= B) { return; }
+    gpu_trajectory *trajectory = trajectories + b;
+    memset(trajectory, 0, sizeof(gpu_trajectory));
+    trajectory->stats.status = SOLVE_RUNNING;
+    trajectory->stats.h_min = INFINITY;
+    trajectory->h = options.h;
+    trajectory->err_prev = 1e-4;
+    trajectory->accepted = 1;
+}
+
+//Squared scaled norms of the initial step selection: d[0] of y, d[1] of f, d[2] of k - f
+__global__ static void initial_norms_kernel(int n, int which, sat_solve_options options, const double *y, const double *f, const double *k,
+                                            gpu_trajectory *trajectories){
+    int b = blockIdx.y;
+    if (trajectories[b].stats.status != SOLVE_RUNNING) { return; }
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    double value = 0.0;
+    if (i < n){
+        size_t e = (size_t)b*n + i;
+        double scale = options.atol + options.rtol * fabs(y[e]);
+        double v = which == 0 ? y[e] : which == 1 ? f[e] : k[e] - f[e];
+        value = (v/scale) * (v/scale);
+    }
+    accumulate(&trajectories[b].d[which], value);
+}
+
+//Initial step size (Hairer, Norsett & Wanner, as in scipy and the CPU integrator), proposal first, then the final one
+__global__ static void initial_step_kernel(int B, int n, int final, gpu_trajectory *trajectories){
+    int b = blockIdx.x * blockDim.x + threadIdx.x;
+    if (b >= B || trajectories[b].stats.status != SOLVE_RUNNING) { return; }
+    gpu_trajectory *trajectory = trajectories + b;
+    double d0 = n > 0 ? sqrt(trajectory->d[0] / n) : 0.0;
+    double d1 = n > 0 ? sqrt(trajectory->d[1] / n) : 0.0;
+    double h0 = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+    if (!final){
+        trajectory->h_step = h0;
+        trajectory->f_valid = 1;
+        trajectory->stats.rhs_evaluations += 2;
+        return;
+    }
+    double d2 = (n > 0 ? sqrt(trajectory->d[2] / n) : 0.0) / h0;
+    double h1 = (d1 <= 1e-15 && d2 <= 1e-15) ? fmax(1e-6, h0 * 1e-3) : pow(0.01 / fmax(d1, d2), 0.2);
+    trajectory->h = fmin(100 * h0, h1);
+}
+
+__global__ static void begin_kernel(int B, sat_solve_options options, gpu_tableau tableau, gpu_trajectory *trajectories){
+    int b = blockIdx.x * blockDim.x + threadIdx.x;
+    if (b >= B || trajectories[b].stats.status != SOLVE_RUNNING) { return; }
+    gpu_trajectory *trajectory = trajectories + b;
+    int last = trajectory->h * (1 + 1e-10) >= options.t_max - trajectory->stats.t;
+    trajectory->h_step = last ? options.t_max - trajectory->stats.t : trajectory->h;
+    trajectory->stats.rhs_evaluations += tableau.stages - (tableau.adaptive && trajectory->f_valid);
+    trajectory->f_valid = 1;
+    trajectory->err_sum = 0.0;
+    trajectory->accepted = 0;
+    trajectory->norm_squared = 0.0;
+    trajectory->largest_aux = -INFINITY;
+    trajectory->unsatisfied = 0;
+    trajectory->negative_aux = 0;
+    trajectory->not_finite = 0;
+}
+
+//y_stage = y + h sum_j a[stage][j] k_j
+__global__ static void stage_kernel(int n, int stage, gpu_tableau tableau, const double *y, gpu_stages k, double *y_stage,
+                                    const gpu_trajectory *trajectories){
+    int b = blockIdx.y;
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (trajectories[b].stats.status != SOLVE_RUNNING || i >= n) { return; }
+    size_t e = (size_t)b*n + i;
+    double increment = 0.0;
+    for (int j = 0; j < stage; j++)
+    {
+        increment += tableau.a[stage][j] * k.k[j][e];
+    }
+    y_stage[e] = y[e] + trajectories[b].h_step * increment;
+}
+
+//New solution (taken from the last stage with first same as last) and the scaled error of the step
+__global__ static void combine_kernel(int n, gpu_tableau tableau, sat_solve_options options, const double *y, gpu_stages k, double *y_new,
+                                      gpu_trajectory *trajectories){
+    int b = blockIdx.y;
+    if (trajectories[b].stats.status != SOLVE_RUNNING) { return; }
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    double h = trajectories[b].h_step;
+    double value = 0.0;
+    if (i < n){
+        size_t e = (size_t)b*n + i;
+        if (!tableau.fsal){
+            double increment = 0.0;
+            for (int j = 0; j < tableau.stages; j++)
+            {
+                increment += tableau.b[j] * k.k[j][e];
+            }
+            y_new[e] = y[e] + h * increment;
+        }
+        if (tableau.adaptive){
+            double error = 0.0;
+            for (int j = 0; j < tableau.stages; j++)
+            {
+                error += tableau.e[j] * k.k[j][e];
+            }
+            double scale = options.atol + options.rtol * fmax(fabs(y[e]), fabs(y_new[e]));
+            value = (h * error / scale) * (h * error / scale);
+        }
+    }
+    if (tableau.adaptive) { accumulate(&trajectories[b].err_sum, value); }
+}
+
+//Step acceptance and the PI step size controller of the CPU integrator
+__global__ static void control_kernel(int B, int n, sat_solve_options options, gpu_tableau tableau, gpu_trajectory *trajectories){
+    int b = blockIdx.x * blockDim.x + threadIdx.x;
+    if (b >= B || trajectories[b].stats.status != SOLVE_RUNNING) { return; }
+    gpu_trajectory *trajectory = trajectories + b;
+    double h = trajectory->h_step;
+    int last = h == options.t_max - trajectory->stats.t;
+    double err = n > 0 ? sqrt(trajectory->err_sum / n) : 0.0;
+    double safety = 0.9, min_factor = 0.2, max_factor = 10.0;
+    if (!tableau.adaptive){
+        trajectory->accepted = 1;
+    }
+    else if (!isfinite(err)){
+        trajectory->h = h * min_factor;
+        trajectory->h_rejected = 1;
+        trajectory->stats.rejected_steps++;
+    }
+    else if (err <= 1.0){
+        double factor = err == 0.0 ? max_factor : safety * pow(err, -0.7/5) * pow(trajectory->err_prev, 0.4/5);
+        factor = fmin(max_factor, fmax(min_factor, factor));
+        if (trajectory->h_rejected){
+            factor = fmin(1.0, factor);
+        }
+        trajectory->accepted = 1;
+        trajectory->err_prev = fmax(err, 1e-4);
+        trajectory->h = h * factor;
+        trajectory->h_rejected = 0;
+    }
+    else {
+        trajectory->h = h * fmax(min_factor, safety * pow(err, -0.2));
+        trajectory->h_rejected = 1;
+        trajectory->stats.rejected_steps++;
+    }
+    if (trajectory->accepted){
+        trajectory->stats.t = last ? options.t_max : trajectory->stats.t + h;
+        trajectory->stats.accepted_steps++;
+        trajectory->stats.h_min = fmin(trajectory->stats.h_min, h);
+        trajectory->stats.h_max = fmax(trajectory->stats.h_max, h);
+        trajectory->f_valid = tableau.fsal;
+    }
+    trajectory->stats.h_last = trajectory->h;
+    if (trajectory->h_rejected && trajectory->h < options.h_min){
+        trajectory->stats.status = SOLVE_STEP_UNDERFLOW;
+    }
+}
+
+//Takes the accepted steps (y = y_new, f = last stage) and finds the largest aux variable
+__global__ static void accept_kernel(int N, int M, gpu_tableau tableau, double *y, const double *y_new, double *f, const double *k_last,
+                                     gpu_trajectory *trajectories){
+    int b = blockIdx.y;
+    if (trajectories[b].stats.status != SOLVE_RUNNING || !trajectories[b].accepted) { return; }
+    int n = N + M;
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    double value = -INFINITY;
+    if (i < n){
+        size_t e = (size_t)b*n + i;
+        if (y_new) { y[e] = y_new[e]; }
+        if (tableau.fsal) { f[e] = k_last[e]; }
+        if (i >= N) { value = y[e]; }
+    }
+    accumulate_max(&trajectories[b].largest_aux, value);
+}
+
+//Global renormalisation of the aux variables (aux_limit), as in the CPU integrator
+__global__ static void renormalise_kernel(int N, int M, sat_solve_options options, double *y, const gpu_trajectory *trajectories){
+    int b = blockIdx.y;
+    int m = blockIdx.x * blockDim.x + threadIdx.x;
+    const gpu_trajectory *trajectory = trajectories + b;
+    if (trajectory->stats.status != SOLVE_RUNNING || !trajectory->accepted || m >= M) { return; }
+    int log_aux = options.rhs_type & RHS_LOG_AUX;
+    double largest = trajectory->largest_aux;
+    if (!(largest > (log_aux ? log(options.aux_limit) : options.aux_limit))) { return; }
+    size_t e = (size_t)b*(N+M) + N + m;
+    if (log_aux) { y[e] -= largest; }
+    else { y[e] /= largest; }
+}
+
+//Norm of the spins, aux variables below one and non finite entries of the new state
+__global__ static void state_kernel(int N, int M, sat_solve_options options, const double *y, gpu_trajectory *trajectories){
+    int b = blockIdx.y;
+    gpu_trajectory *trajectory = trajectories + b;
+    if (trajectory->stats.status != SOLVE_RUNNING || !trajectory->accepted) { return; }
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    double value = 0.0;
+    if (i < N + M){
+        double entry = y[(size_t)b*(N+M) + i];
+        if (!isfinite(entry)) { trajectory->not_finite = 1; }
+        if (i < N) { value = entry * entry; }
+        else if (entry < (options.rhs_type & RHS_LOG_AUX ? 0.0 : 1.0)) { trajectory->negative_aux = 1; }
+    }
+    accumulate(&trajectory->norm_squared, value);
+}
+
+//One thread per clause: clauses without a true literal for the signs of the spins
+__global__ static void unsatisfied_kernel(gpu_clauses c, const double *y, gpu_trajectory *trajectories){
+    int b = blockIdx.y;
+    int m = blockIdx.x * blockDim.x + threadIdx.x;
+    gpu_trajectory *trajectory = trajectories + b;
+    if (trajectory->stats.status != SOLVE_RUNNING || !trajectory->accepted || m >= c.M) { return; }
+    const double *s = y + (size_t)b*(c.N + c.M);
+    for (int l = c.clause_offsets[m]; l < c.clause_offsets[m+1]; l++)
+    {
+        if ((s[c.literal_variables[l]] > 0) == (c.literal_signs[l] > 0)) { return; }
+    }
+    atomicAdd(&trajectory->unsatisfied, 1);
+}
+
+//Status after an accepted step (or of the initial state), counts the running and the finished trajectories
+__global__ static void finish_kernel(int B, int N, sat_solve_options options, gpu_tableau tableau, int initial, gpu_trajectory *trajectories, int *counters){
+    int b = blockIdx.x * blockDim.x + threadIdx.x;
+    if (b >= B || trajectories[b].stats.status != SOLVE_RUNNING) { return; }
+    gpu_trajectory *trajectory = trajectories + b;
+    if (trajectory->accepted){
+        int exit = 0;
+        if (options.exit_type == ORTANT){
+            exit = trajectory->unsatisfied == 0;
+        }
+        else if (options.exit_type == CONVERGENCE_RADIUS){
+            double sigma = 0.5;
+            exit = trajectory->unsatisfied == 0 && trajectory->norm_squared >= N - 1 + sigma*sigma;
+        }
+        else if (options.exit_type == NEGATIVE_AUX){
+            exit = trajectory->negative_aux;
+        }
+        int renormalised = !initial && options.aux_limit > 0.0 &&
+                           trajectory->largest_aux > (options.rhs_type & RHS_LOG_AUX ? log(options.aux_limit) : options.aux_limit);
+        if (!initial && !tableau.adaptive && trajectory->not_finite){
+            trajectory->stats.status = SOLVE_NOT_FINITE;
+            return;
+        }
+        if (renormalised){
+            trajectory->f_valid = 0;
+            trajectory->stats.renormalisations++;
+        }
+        if (exit){
+            trajectory->stats.status = SOLVE_EXIT;
+            atomicAdd(&counters[1], 1);
+            return;
+        }
+        else if (!initial && trajectory->stats.t >= options.t_max){
+            trajectory->stats.status = SOLVE_T_MAX;
+            return;
+        }
+        else if (!initial && options.max_steps > 0 && trajectory->stats.accepted_steps >= options.max_steps){
+            trajectory->stats.status = SOLVE_MAX_STEPS;
+            return;
+        }
+    }
+    atomicAdd(&counters[0], 1);
+}
+
+__global__ static void cancel_kernel(int B, gpu_trajectory *trajectories){
+    int b = blockIdx.x * blockDim.x + threadIdx.x;
+    if (b < B && trajectories[b].stats.status == SOLVE_RUNNING) { trajectories[b].stats.status = SOLVE_CANCELLED; }
+}
+
+__global__ static void assignment_kernel(int N, int M, const double *y, unsigned char *assignments){
+    int b = blockIdx.y;
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i < N) { assignments[(size_t)b*N + i] = y[(size_t)b*(N+M) + i] > 0; }
+}
+
+
+static gpu_tableau tableau_of(int method){
+    gpu_tableau tableau;
+    memset(&tableau, 0, sizeof(gpu_tableau));
+    if (method == SOLVER_EULER){
+        tableau.stages = 1;
+        tableau.b[0] = 1.0;
+    }
+    else if (method == SOLVER_RK4){
+        tableau.stages = 4;
+        tableau.a[1][0] = 0.5;
+        tableau.a[2][1] = 0.5;
+        tableau.a[3][2] = 1.0;
+        double b[4] = {1.0/6, 1.0/3, 1.0/3, 1.0/6};
+        memcpy(tableau.b, b, sizeof(b));
+    }
+    else if (method == SOLVER_CASH_KARP){
+        static const double a[6][5] = {
+            {0},
+            {1.0/5},
+            {3.0/40, 9.0/40},
+            {3.0/10, -9.0/10, 6.0/5},
+            {-11.0/54, 5.0/2, -70.0/27, 35.0/27},
+            {1631.0/55296, 175.0/512, 575.0/13824, 44275.0/110592, 253.0/4096}
+        };
+        static const double b[6] = {37.0/378, 0.0, 250.0/621, 125.0/594, 0.0, 512.0/1771};
+        static const double e[6] = {37.0/378 - 2825.0/27648, 0.0, 250.0/621 - 18575.0/48384, 125.0/594 - 13525.0/55296, -277.0/14336, 512.0/1771 - 1.0/4};
+        tableau.stages = 6;
+        tableau.adaptive = 1;
+        for (int i = 0; i < 6; i++)
+        {
+            memcpy(tableau.a[i], a[i], sizeof(a[i]));
+        }
+        memcpy(tableau.b, b, sizeof(b));
+        memcpy(tableau.e, e, sizeof(e));
+    }
+    else {
+        static const double a[7][6] = {
+            {0},
+            {1.0/5},
+            {3.0/40, 9.0/40},
+            {44.0/45, -56.0/15, 32.0/9},
+            {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+            {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+            {35.0/384, 0.0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}
+        };
+        static const double e[7] = {71.0/57600, 0.0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525, -1.0/40};
+        tableau.stages = 7;
+        tableau.adaptive = 1;
+        tableau.fsal = 1;
+        memcpy(tableau.a, a, sizeof(a));
+        memcpy(tableau.e, e, sizeof(e));
+    }
+    return tableau;
+}
+
+static void batch_free(gpu_batch *batch){
+    cudaFree(batch->y);
+    cudaFree(batch->stage);
+    cudaFree(batch->y_new);
+    cudaFree(batch->terms);
+    cudaFree(batch->a_sums);
+    for (int j = 0; j < 7; j++)
+    {
+        cudaFree(batch->k.k[j]);
+    }
+    cudaFree(batch->trajectories);
+    cudaFree(batch->counters);
+    cudaFree(batch->assignments);
+}
+
+//Allocates the device buffers of B trajectories (stages: number of rhs buffers), returns 0 on success
+static int batch_alloc(const sat_gpu_problem *problem, int B, int stages, gpu_batch *batch){
+    size_t n = (size_t)problem->clauses.N + problem->clauses.M;
+    size_t states = (size_t)B * (n > 0 ? n : 1) * sizeof(double);
+    memset(batch, 0, sizeof(gpu_batch));
+    int failed = cudaMalloc((void **)&batch->y, states) != cudaSuccess;
+    failed |= cudaMalloc((void **)&batch->terms, (size_t)B * (problem->clauses.L > 0 ? problem->clauses.L : 1) * sizeof(double)) != cudaSuccess;
+    failed |= cudaMalloc((void **)&batch->a_sums, B * sizeof(double)) != cudaSuccess;
+    for (int j = 0; j < stages; j++)
+    {
+        failed |= cudaMalloc((void **)&batch->k.k[j], states) != cudaSuccess;
+    }
+    if (stages > 1){
+        failed |= cudaMalloc((void **)&batch->stage, states) != cudaSuccess;
+        failed |= cudaMalloc((void **)&batch->y_new, states) != cudaSuccess;
+        failed |= cudaMalloc((void **)&batch->trajectories, B * sizeof(gpu_trajectory)) != cudaSuccess;
+        failed |= cudaMalloc((void **)&batch->counters, 2 * sizeof(int)) != cudaSuccess;
+        failed |= cudaMalloc((void **)&batch->assignments, (size_t)B * (problem->clauses.N > 0 ? problem->clauses.N : 1)) != cudaSuccess;
+    }
+    if (failed) { batch_free(batch); }
+    return failed;
+}
+
+
+extern "C" {
+
+//To be called from python
+
+//Number of usable devices, 0 if there is none (or no driver)
+int sat_gpu_devices(void){
+    int count = 0;
+    if (cudaGetDeviceCount(&count) != cudaSuccess) { return 0; }
+    return count;
+}
+
+void sat_gpu_problem_destroy(sat_gpu_problem *problem){
+    if (!problem) { return; }
+    cudaSetDevice(problem->device);
+    cudaFree(problem->clauses.clause_offsets);
+    cudaFree(problem->clauses.literal_variables);
+    cudaFree(problem->clauses.literal_signs);
+    cudaFree(problem->clauses.occurrence_offsets);
+    cudaFree(problem->clauses.occurrence_literals);
+    free(problem);
+}
+
+//Uploads the clause structure of a problem handle to the given device, NULL if there is no such
+//device or not enough memory. The copy does not follow later edits of the handle.
+sat_gpu_problem *sat_gpu_problem_create(sat_problem *source, int device){
+    if (device < 0 || device >= sat_gpu_devices() || cudaSetDevice(device) != cudaSuccess) { return NULL; }
+    int N = sat_problem_variables(source);
+    int M = sat_problem_clauses(source);
+    int L = sat_problem_literals(source);
+    sat_gpu_problem *problem = (sat_gpu_problem *)calloc(1, sizeof(sat_gpu_problem));
+    int *host = (int *)malloc(((size_t)M + 1 + 3 * (size_t)L + (size_t)N + 1) * sizeof(int));
+    if (!problem || !host){
+        free(problem);
+        free(host);
+        return NULL;
+    }
+    int *clause_offsets = host;
+    int *literal_variables = clause_offsets + M + 1;
+    int *literal_signs = literal_variables + L;
+    int *occurrence_offsets = literal_signs + L;
+    int *occurrence_literals = occurrence_offsets + N + 1;
+    sat_problem_export(source, clause_offsets, literal_variables, literal_signs);
+    memset(occurrence_offsets, 0, ((size_t)N + 1) * sizeof(int));
+    for (int l = 0; l < L; l++)
+    {
+        occurrence_offsets[literal_variables[l] + 1]++;
+    }
+    for (int i = 0; i < N; i++)
+    {
+        occurrence_offsets[i+1] += occurrence_offsets[i];
+    }
+    for (int l = 0; l < L; l++)
+    {
+        occurrence_literals[occurrence_offsets[literal_variables[l]]++] = l;
+    }
+    for (int i = N; i > 0; i--)
+    {
+        occurrence_offsets[i] = occurrence_offsets[i-1];
+    }
+    occurrence_offsets[0] = 0;
+
+    problem->device = device;
+    gpu_clauses *c = &problem->clauses;
+    c->N = N;
+    c->M = M;
+    c->L = L;
+    int *const sources[5] = {clause_offsets, literal_variables, literal_signs, occurrence_offsets, occurrence_literals};
+    int **const targets[5] = {&c->clause_offsets, &c->literal_variables, &c->literal_signs, &c->occurrence_offsets, &c->occurrence_literals};
+    const size_t sizes[5] = {(size_t)M + 1, (size_t)L, (size_t)L, (size_t)N + 1, (size_t)L};
+    int failed = 0;
+    for (int j = 0; j < 5 && !failed; j++)
+    {
+        size_t bytes = (sizes[j] > 0 ? sizes[j] : 1) * sizeof(int);
+        failed = cudaMalloc((void **)targets[j], bytes) != cudaSuccess ||
+                 cudaMemcpy(*targets[j], sources[j], sizes[j] * sizeof(int), cudaMemcpyHostToDevice) != cudaSuccess;
+    }
+    free(host);
+    if (failed){
+        sat_gpu_problem_destroy(problem);
+        return NULL;
+    }
+    return problem;
+}
+
+//rhs of B states (B x (N+M), row major) on the device, both directions cross the bus, so this is meant for
+//checking the kernels and for callers that keep few states. Returns 0, SOLVE_NO_MEMORY or SOLVE_DEVICE_ERROR.
+int sat_gpu_rhs_batch(sat_gpu_problem *problem, int rhs_type, int B, const double y[], double result[]){
+    size_t bytes = (size_t)B * (problem->clauses.N + problem->clauses.M) * sizeof(double);
+    gpu_batch batch;
+    if (B <= 0) { return 0; }
+    if (B > GPU_MAX_BATCH || cudaSetDevice(problem->device) != cudaSuccess) { return SOLVE_DEVICE_ERROR; }
+    if (batch_alloc(problem, B, 1, &batch)) { return SOLVE_NO_MEMORY; }
+    int status = cudaMemcpy(batch.y, y, bytes, cudaMemcpyHostToDevice) == cudaSuccess ? 0 : SOLVE_DEVICE_ERROR;
+    if (!status){
+        gpu_rhs(problem, rhs_type, B, batch.y, batch.k.k[0], &batch, NULL, 0);
+        if (cudaGetLastError() != cudaSuccess || cudaMemcpy(result, batch.k.k[0], bytes, cudaMemcpyDeviceToHost) != cudaSuccess){
+            status = SOLVE_DEVICE_ERROR;
+        }
+    }
+    batch_free(&batch);
+    return status;
+}
+
+//Device version of sat_solve_batch: integrates B trajectories from the initial states y (B x (N+M), not
+//modified) with the integrator loop running on the device. Every trajectory has its own step size and
+//status and all of them advance in lockstep, so with stop_after = k > 0 the batch stops soon after k
+//trajectories reached the exit condition (counted every GPU_POLL_INTERVAL steps, the steps of the
+//last interval can add a few more), the others are SOLVE_CANCELLED. Only the final assignments
+//(B x N bytes, s_i > 0), the stats and, if final_states is not NULL, the final states are copied back.
+//Returns the number of trajectories that reached the exit condition, SOLVE_NO_MEMORY, SOLVE_DEVICE_ERROR
+//or SOLVE_INVALID_ARGUMENT (sat_solve_check).
+int sat_gpu_solve_batch(sat_gpu_problem *problem, const sat_solve_options *options, int B, const double y[], int stop_after,
+                        unsigned char assignments[], double final_states[], sat_solve_stats stats[]){
+    int N = problem->clauses.N;
+    int M = problem->clauses.M;
+    int n = N + M;
+    size_t bytes = (size_t)B * n * sizeof(double);
+    gpu_tableau tableau = tableau_of(options->method);
+    gpu_batch batch;
+    if (sat_solve_check(options)) { return SOLVE_INVALID_ARGUMENT; }
+    if (B <= 0) { return 0; }
+    if (B > GPU_MAX_BATCH || cudaSetDevice(problem->device) != cudaSuccess) { return SOLVE_DEVICE_ERROR; }
+    //every method needs the stage buffers, the fixed step ones only fewer rhs buffers
+    if (batch_alloc(problem, B, tableau.stages > 1 ? tableau.stages : 2, &batch)) { return SOLVE_NO_MEMORY; }
+    int failed = cudaMemcpy(batch.y, y, bytes, cudaMemcpyHostToDevice) != cudaSuccess;
+    failed |= cudaMemset(batch.counters, 0, 2 * sizeof(int)) != cudaSuccess;
+    sat_solve_options o = *options;
+    gpu_trajectory *trajectories = batch.trajectories;
+    dim3 per_trajectory((B + GPU_BLOCK - 1) / GPU_BLOCK);
+    int counters[2] = {B, 0};
+
+    init_kernel<<<per_trajectory, GPU_BLOCK>>>(B, o, trajectories);
+    state_kernel<<<grid(n, B), GPU_BLOCK>>>(N, M, o, batch.y, trajectories);
+    unsatisfied_kernel<<<grid(M, B), GPU_BLOCK>>>(problem->clauses, batch.y, trajectories);
+    finish_kernel<<<per_trajectory, GPU_BLOCK>>>(B, N, o, tableau, 1, trajectories, batch.counters);
+    if (tableau.adaptive && o.h <= 0.0){
+        gpu_rhs(problem, o.rhs_type, B, batch.y, batch.k.k[0], &batch, trajectories, 0);
+        initial_norms_kernel<<<grid(n, B), GPU_BLOCK>>>(n, 0, o, batch.y, batch.k.k[0], NULL, trajectories);
+        initial_norms_kernel<<<grid(n, B), GPU_BLOCK>>>(n, 1, o, batch.y, batch.k.k[0], NULL, trajectories);
+        initial_step_kernel<<<per_trajectory, GPU_BLOCK>>>(B, n, 0, trajectories);
+        //explicit Euler probe y + h0 f, stage 1 of a one stage tableau
+        gpu_tableau probe = tableau_of(SOLVER_EULER);
+        probe.a[1][0] = 1.0;
+        stage_kernel<<<grid(n, B), GPU_BLOCK>>>(n, 1, probe, batch.y, batch.k, batch.stage, trajectories);
+        gpu_rhs(problem, o.rhs_type, B, batch.stage, batch.k.k[1], &batch, trajectories, 0);
+        initial_norms_kernel<<<grid(n, B), GPU_BLOCK>>>(n, 2, o, batch.y, batch.k.k[0], batch.k.k[1], trajectories);
+        initial_step_kernel<<<per_trajectory, GPU_BLOCK>>>(B, n, 1, trajectories);
+    }
+
+    for (long long iteration = 1; !failed; iteration++)
+    {
+        gpu_rhs(problem, o.rhs_type, B, batch.y, batch.k.k[0], &batch, trajectories, tableau.adaptive);
+        begin_kernel<<<per_trajectory, GPU_BLOCK>>>(B, o, tableau, trajectories);
+        for (int stage = 1; stage < tableau.stages; stage++)
+        {
+            stage_kernel<<<grid(n, B), GPU_BLOCK>>>(n, stage, tableau, batch.y, batch.k, batch.stage, trajectories);
+            gpu_rhs(problem, o.rhs_type, B, batch.stage, batch.k.k[stage], &batch, trajectories, 0);
+        }
+        double *y_new = tableau.fsal ? batch.stage : batch.y_new;
+        combine_kernel<<<grid(n, B), GPU_BLOCK>>>(n, tableau, o, batch.y, batch.k, y_new, trajectories);
+        control_kernel<<<per_trajectory, GPU_BLOCK>>>(B, n, o, tableau, trajectories);
+        accept_kernel<<<grid(n, B), GPU_BLOCK>>>(N, M, tableau, batch.y, y_new, batch.k.k[0], batch.k.k[tableau.stages - 1], trajectories);
+        if (o.aux_limit > 0.0){
+            renormalise_kernel<<<grid(M, B), GPU_BLOCK>>>(N, M, o, batch.y, trajectories);
+        }
+        state_kernel<<<grid(n, B), GPU_BLOCK>>>(N, M, o, batch.y, trajectories);
+        unsatisfied_kernel<<<grid(M, B), GPU_BLOCK>>>(problem->clauses, batch.y, trajectories);
+        int poll = iteration % GPU_POLL_INTERVAL == 0;
+        if (poll) { failed |= cudaMemset(batch.counters, 0, sizeof(int)) != cudaSuccess; }
+        finish_kernel<<<per_trajectory, GPU_BLOCK>>>(B, N, o, tableau, 0, trajectories, batch.counters);
+        if (!poll) { continue; }
+        failed |= cudaGetLastError() != cudaSuccess || cudaMemcpy(counters, batch.counters, 2 * sizeof(int), cudaMemcpyDeviceToHost) != cudaSuccess;
+        if (counters[0] == 0) { break; }
+        if (stop_after > 0 && counters[1] >= stop_after){
+            cancel_kernel<<<per_trajectory, GPU_BLOCK>>>(B, trajectories);
+            break;
+        }
+    }
+
+    if (!failed){
+        assignment_kernel<<<grid(N, B), GPU_BLOCK>>>(N, M, batch.y, batch.assignments);
+        gpu_trajectory *host = (gpu_trajectory *)malloc(B * sizeof(gpu_trajectory));
+        failed = !host || cudaGetLastError() != cudaSuccess ||
+                 cudaMemcpy(host, trajectories, B * sizeof(gpu_trajectory), cudaMemcpyDeviceToHost) != cudaSuccess ||
+                 cudaMemcpy(assignments, batch.assignments, (size_t)B * N, cudaMemcpyDeviceToHost) != cudaSuccess ||
+                 cudaMemcpy(counters, batch.counters, 2 * sizeof(int), cudaMemcpyDeviceToHost) != cudaSuccess ||
+                 (final_states && cudaMemcpy(final_states, batch.y, bytes, cudaMemcpyDeviceToHost) != cudaSuccess);
+        for (int b = 0; b < B && !failed; b++)
+        {
+            stats[b] = host[b].stats;
+        }
+        free(host);
+    }
+    batch_free(&batch);
+    return failed ? SOLVE_DEVICE_ERROR : counters[1];
+}
+
+}
@@ -37,7 +37,7 @@ def plot_aux(sol, number_of_variables, hide_legends = False):
     plt.show()
 
 
-so_file_name = 'c_libs/cSat.so'
+so_file_name = 'c_libs/cSAT.so'
 myProblem = SAT("SAT_problems\\random3SATn15a4.266666666666667.cnf", so_file_name, rhs_type=RHS_TYPE_THREE)
 N, M = myProblem.number_of_variables, myProblem.number_of_clauses
 init_s =  2*np.random.rand(N) - np.ones(N)
@@ -46,3 +46,9 @@ solver = CTD(myProblem, initial_s=init_s, random_aux=False)
 solver.fast_solve(t_max=50, solver_type='RK45', exit_type=ORTANT)
 plot_traj(solver.sol, myProblem.number_of_variables, True)
 plot_aux(solver.sol, N, True)
+
+#The native solver keeps a bounded, decimated record of the trajectory instead of every step
+solver = CTD(myProblem, initial_s=init_s, random_aux=False)
+solver.native_solve(t_max=50, exit_type=ORTANT, record_every=1, record_rows=500)
+plot_traj(solver.sol, N, True)
+plot_aux(solver.sol, N, True)
@@ -14,20 +14,208 @@ from math import sqrt, pi, sin
 from xmlrpc.client import Boolean
 import numpy as np
 from abc import abstractclassmethod
-from random import sample, randint, random
+from random import random, getrandbits, Random
 from scipy.integrate import solve_ivp
-from ctypes import CDLL, POINTER, c_double, c_int
+from scipy.sparse import csr_matrix
+from os import fsencode
+from copy import copy
+from time import perf_counter
+from json import dump, load
+from ctypes import CDLL, CFUNCTYPE, POINTER, Structure, byref, c_char_p, c_double, c_int, c_longlong, c_ubyte, c_uint64, c_ulonglong, c_void_p
 
 #Constants
 
 ORTANT = 0
 CONVERGENCE_RADIUS = -1
 NEGATIVE_AUX = -2
+NO_EXIT = 1 #native solvers run until t_max
+
+#First bytes of the binary instance cache written by SAT.write_problem_to_cache
+CACHE_MAGIC = b'CTDSSAT\0'
+#scipy solvers that are given the analytic (sparse) jacobian of the native library
+IMPLICIT_SOLVERS = ('BDF', 'Radau')
 RHS_TYPE_ONE = 1
 RHS_TYPE_TWO = 2
 RHS_TYPE_THREE = 3
 RHS_TYPE_FOUR = 4
 RHS_TYPE_FIVE = 5
+#Added to an rhs type: the aux part of the state holds ln a_m instead of a_m (the aux variables grow exponentially)
+RHS_LOG_AUX = 16
+#Added to an rhs type: the native kernels evaluate the spins and clause factors in single precision (aux variables and sums stay double)
+RHS_MIXED_PRECISION = 32
+
+#SIMD level of the native clause kernels (capped by what the cpu supports)
+SIMD_SCALAR = 0
+SIMD_AVX2 = 1
+SIMD_AVX512 = 2
+
+#Native solvers (integration loop running in the c library), selected by solver_type in CTD.fast_solve
+SOLVER_EULER = 0
+SOLVER_RK4 = 1
+SOLVER_CASH_KARP = 2
+SOLVER_DORMAND_PRINCE = 3
+NATIVE_SOLVERS = {'native_Euler': SOLVER_EULER, 'native_RK4': SOLVER_RK4, 'native_RKCK': SOLVER_CASH_KARP, 'native_RK45': SOLVER_DORMAND_PRINCE}
+
+#Configurations probed by CTD.auto_tune (tolerances of the adaptive native solvers, step size of the fixed step ones)
+TUNING_CANDIDATES = [{'solver_type': 'native_RK45', 'atol': 0.000001, 'rtol': 0.001},
+                     {'solver_type': 'native_RK45', 'atol': 0.00001, 'rtol': 0.01},
+                     {'solver_type': 'native_RK45', 'atol': 0.0001, 'rtol': 0.01},
+                     {'solver_type': 'native_RKCK', 'atol': 0.000001, 'rtol': 0.001},
+                     {'solver_type': 'native_RKCK', 'atol': 0.00001, 'rtol': 0.01},
+                     {'solver_type': 'native_RKCK', 'atol': 0.0001, 'rtol': 0.01},
+                     {'solver_type': 'native_RK4', 'h': 0.0025},
+                     {'solver_type': 'native_RK4', 'h': 0.01},
+                     {'solver_type': 'native_RK4', 'h': 0.04},
+                     {'solver_type': 'native_Euler', 'h': 0.0025},
+                     {'solver_type': 'native_Euler', 'h': 0.01}]
+
+#Status of a native solve (non-negative values agree with scipy's solve_ivp)
+SOLVE_EXIT = 1
+SOLVE_T_MAX = 0
+SOLVE_STEP_UNDERFLOW = -1
+SOLVE_MAX_STEPS = -2
+SOLVE_NO_MEMORY = -3
+SOLVE_NOT_FINITE = -4
+SOLVE_CANCELLED = -5
+SOLVE_DEVICE_ERROR = -6 #GPU backend only
+SOLVE_TRACE_ERROR = -7 #the trace or the output file could not be opened, or the output file not written
+SOLVE_CHECKPOINT_ERROR = -8 #a checkpoint could not be written, or the one to resume could not be read or belongs to another problem
+SOLVE_INVALID_ARGUMENT = -9 #the options cannot be run, e.g. a fixed step method without a positive step size or aux_limit with NEGATIVE_AUX
+
+#What a full trajectory output buffer of the native solver drops (CTD.native_solve with record_every)
+OUTPUT_DECIMATE = 0 #every other row, the stride doubles and the rows keep spanning the whole trajectory
+OUTPUT_RING = 1 #the oldest row, the rows hold the end of the trajectory
+
+#Status of the native preprocessing (SAT.preprocess)
+PREPROCESS_DONE = 0
+PREPROCESS_UNSATISFIABLE = 1
+PREPROCESS_NO_MEMORY = -3
+
+#sat_output_callback in cSAT.c: (data, t, recorded state, width), a nonzero return value cancels the solve
+OutputCallback = CFUNCTYPE(c_int, c_void_p, c_double, POINTER(c_double), c_int)
+
+class SolveOptions(Structure):
+    """Mirror of sat_solve_options in cSAT.c"""
+    _fields_ = [('rhs_type', c_int),
+                ('method', c_int),
+                ('exit_type', c_int),
+                ('t_max', c_double),
+                ('h', c_double),
+                ('atol', c_double),
+                ('rtol', c_double),
+                ('h_min', c_double),
+                ('max_steps', c_longlong),
+                ('aux_limit', c_double),
+                ('timing', c_int),
+                ('trace_interval', c_int),
+                ('trace_path', c_char_p),
+                ('output_interval', c_int),
+                ('output_mode', c_int),
+                ('output_spins', c_int),
+                ('output_capacity', c_longlong),
+                ('output', POINTER(c_double)),
+                ('output_path', c_char_p),
+                ('output_callback', OutputCallback),
+                ('output_data', c_void_p),
+                ('checkpoint_interval', c_double),
+                ('checkpoint_path', c_char_p),
+                ('resume_path', c_char_p),
+                ('seed', c_ulonglong),
+                ('finish_threshold', c_int),
+                ('finish_flips', c_longlong),
+                ('finish_noise', c_double)]
+
+class SolveStats(Structure):
+    """Mirror of sat_solve_stats in cSAT.c"""
+    _fields_ = [('status', c_int),
+                ('t', c_double),
+                ('accepted_steps', c_longlong),
+                ('rejected_steps', c_longlong),
+                ('rhs_evaluations', c_longlong),
+                ('h_min', c_double),
+                ('h_max', c_double),
+                ('h_last', c_double),
+                ('renormalisations', c_longlong),
+                ('flips', c_longlong),
+                ('rhs_cycles', c_longlong),
+                ('exit_cycles', c_longlong),
+                ('cycles', c_longlong),
+                ('output_rows', c_longlong),
+                ('output_first', c_longlong),
+                ('output_stride', c_longlong),
+                ('checkpoints', c_longlong),
+                ('searches', c_longlong),
+                ('search_flips', c_longlong),
+                ('search_unsatisfied', c_int),
+                ('search_solved', c_int)]
+
+class Tuning(Structure):
+    """Mirror of sat_tuning in cSAT.c"""
+    _fields_ = [('tuned', c_int),
+                ('method', c_int),
+                ('rhs_type', c_int),
+                ('probes', c_int),
+                ('h', c_double),
+                ('atol', c_double),
+                ('rtol', c_double),
+                ('progress', c_double),
+                ('aux_limit', c_double)]
+
+class LyapunovOptions(Structure):
+    """Mirror of sat_lyapunov_options in cSAT.c"""
+    _fields_ = [('rhs_type', c_int),
+                ('exit_type', c_int),
+                ('exponents', c_int),
+                ('qr_interval', c_int),
+                ('t_max', c_double),
+                ('h', c_double),
+                ('max_records', c_int)]
+
+class LyapunovStats(Structure):
+    """Mirror of sat_lyapunov_stats in cSAT.c"""
+    _fields_ = [('status', c_int),
+                ('t', c_double),
+                ('steps', c_longlong),
+                ('rhs_evaluations', c_longlong),
+                ('jvp_products', c_longlong),
+                ('orthonormalisations', c_int),
+                ('records', c_int)]
+
+class PreprocessOptions(Structure):
+    """Mirror of sat_preprocess_options in cSAT.c"""
+    _fields_ = [('unit_propagation', c_int),
+                ('pure_literals', c_int),
+                ('subsumption', c_int),
+                ('elimination', c_int),
+                ('max_occurrences', c_int),
+                ('max_resolvent_length', c_int),
+                ('max_rounds', c_int)]
+
+class PreprocessStats(Structure):
+    """Mirror of sat_preprocess_stats in cSAT.c"""
+    _fields_ = [('status', c_int),
+                ('variables', c_int),
+                ('clauses', c_int),
+                ('units', c_int),
+                ('pure_literals', c_int),
+                ('subsumed', c_int),
+                ('eliminated', c_int),
+                ('resolvents', c_int),
+                ('rounds', c_int)]
+
+class NativeSolution:
+    """Result of a native solve, provides the fields of scipy's OdeResult used in this module"""
+    def __init__(self, y0, y, stats, records = None, t0 = 0.0) -> None:
+        if records is None:
+            self.t = np.array([t0, stats.t])
+            self.y = np.stack([y0, y], axis=1)
+        else:
+            self.t = records[:, 0]
+            self.y = records[:, 1:].T
+        self.status = stats.status
+        self.success = stats.status >= 0
+        self.nfev = stats.rhs_evaluations
+        self.stats = stats
 
 #Numerical integrator(s)
 
@@ -40,11 +228,16 @@ class RK5( Integrator ):
     def __init__(self, Nmax = 10000, h = 0.0025) -> None:
         Integrator.__init__(self, Nmax, h)
 
-    def step(self, y, f, df):
+    def step(self, y, f, df, jvp = None):
+        """
+        @param df: jacobian of f, only used if jvp is not given
+        @param jvp: optional, function (y, v) -> J(y) v, avoids forming the jacobian (e.g. SAT.jvp)
+        """
         k1 = self.h * f(y)
-        k2 = self.h * f(y + k1*1/3 + self.h * np.dot(df(y), k1))
-        k3 = self.h * f(y + k1*152/125 + k2*252/125 - self.h * 44/125 * np.dot(df(y), k1))
-        k4 = self.h * f(y + k1*19/2 - k2*72/7 + k3*25/14 + self.h * 5/2 * np.dot(df(y), k1))
+        Jk1 = jvp(y, k1) if jvp else np.dot(df(y), k1)
+        k2 = self.h * f(y + k1*1/3 + self.h * Jk1)
+        k3 = self.h * f(y + k1*152/125 + k2*252/125 - self.h * 44/125 * Jk1)
+        k4 = self.h * f(y + k1*19/2 - k2*72/7 + k3*25/14 + self.h * 5/2 * Jk1)
         return y + 5/48*k1 + 27/56*k2 + 125/336*k3 + 1/24*k4
 
 class RK4( Integrator ):
@@ -117,71 +310,384 @@ class Lorenz(Problem):
 
 class SAT(Problem):
     """Class representation of the continuous dynamical system version of a boolean satisfiability ptoblem"""
-    def __init__(self, cnf_file_name, so_file_name, n = 15, alpha = 4.264, literal_number = 3, rhs_type = RHS_TYPE_ONE):
+    def __init__(self, cnf_file_name, so_file_name, n = 15, alpha = 4.264, literal_number = 3, rhs_type = RHS_TYPE_ONE, seed = None, planted = False):
         """
         Constructor
-        @param cnf_file_name: cnf-file defining the problem, if set to None, generates a random problem
+        @param cnf_file_name: cnf-file defining the problem (or a cache written by write_problem_to_cache, needs so_file_name), if set to None, generates a random problem
         @param so_file_name: c/c++ library containing (hopefully fast) implementation of rhs and jakobian matrices
         @param n: optional, number of variables in randomly generated problem
         @param alpha: optional, ration of clauses (w.r.t n) in randomly generated problem
         @param literal_number: optional, defines the length of clauses (default is 3)
-        @param rhs_type: optional, selects type of rhs (RHS_TYPE_ONE = 1) (RHS_TYPE_TWO = 2)
+        @param rhs_type: optional, selects type of rhs (RHS_TYPE_ONE = 1) (RHS_TYPE_TWO = 2), add RHS_LOG_AUX to evolve ln a_m,
+                         RHS_MIXED_PRECISION for the single precision native kernels
+        @param seed: optional, seed of the randomly generated problem (reproducible, the native generator is used if so_file_name is set)
+        @param planted: optional, the randomly generated problem is satisfied by a hidden assignment (stored in planted_solution)
         """
         #Misc. init
         self.valid_solutions = None
+        self.solution_masks = None
         self.rhs_type = rhs_type
         self.alpha = None
-        
+        self._clauses = None
+        self._c = None
+        self.reconstruction = None
+        self.planted_solution = None
+        self.gpu_problem_handle = None
+        self.gpu_device = None
+        self._cycles_per_second = None
+        self.cache_file_name = None #binary cache the problem was read from
 
+        #Loading c_functions
+        if not so_file_name:
+            self.cSAT_functions = None
+        else:
+            self.cSAT_functions = CDLL(so_file_name)
+            self.cSAT_functions.rhs1.restype = None
+            self.cSAT_functions.rhs2.restype = None
+            self.cSAT_functions.rhs1_sparse.restype = None
+            self.cSAT_functions.rhs2_sparse.restype = None
+            self.cSAT_functions.rhs3_sparse.restype = None
+            self.cSAT_functions.rhs4_sparse.restype = None
+            self.cSAT_functions.rhs5_sparse.restype = None
+            self.cSAT_functions.rhs3.restype = None
+            self.cSAT_functions.rhs4.restype = None
+            self.cSAT_functions.rhs5.restype = None
+            self.cSAT_functions.jacobian1.restype = None
+            self.cSAT_functions.jacobian2.restype = None
+            self.cSAT_functions.sat_problem_create.restype = c_void_p
+            self.cSAT_functions.sat_problem_create.argtypes = [c_int, c_int, POINTER(c_int), POINTER(c_int), POINTER(c_int)]
+            self.cSAT_functions.sat_problem_destroy.restype = None
+            self.cSAT_functions.sat_problem_destroy.argtypes = [c_void_p]
+            self.cSAT_functions.sat_problem_rhs.restype = None
+            self.cSAT_functions.sat_problem_rhs.argtypes = [c_void_p, c_int, POINTER(c_double), POINTER(c_double)]
+            self.cSAT_functions.sat_problem_jacobian.restype = c_int
+            self.cSAT_functions.sat_problem_jacobian.argtypes = [c_void_p, c_int, POINTER(c_double), POINTER(c_double)]
+            self.cSAT_functions.sat_problem_jacobian_nnz.restype = c_int
+            self.cSAT_functions.sat_problem_jacobian_nnz.argtypes = [c_void_p]
+            self.cSAT_functions.sat_problem_jacobian_pattern.restype = c_int
+            self.cSAT_functions.sat_problem_jacobian_pattern.argtypes = [c_void_p, POINTER(c_int), POINTER(c_int)]
+            self.cSAT_functions.sat_problem_jacobian_sparse.restype = c_int
+            self.cSAT_functions.sat_problem_jacobian_sparse.argtypes = [c_void_p, c_int, POINTER(c_double), POINTER(c_double)]
+            self.cSAT_functions.sat_problem_jvp.restype = None
+            self.cSAT_functions.sat_problem_jvp.argtypes = [c_void_p, c_int, POINTER(c_double), POINTER(c_double), POINTER(c_double)]
+            self.cSAT_functions.sat_problem_jvp_batch.restype = None
+            self.cSAT_functions.sat_problem_jvp_batch.argtypes = [c_void_p, c_int, POINTER(c_double), c_int, POINTER(c_double), POINTER(c_double)]
+            self.cSAT_functions.sat_solve.restype = c_int
+            self.cSAT_functions.sat_solve.argtypes = [c_void_p, POINTER(SolveOptions), POINTER(c_double), POINTER(SolveStats)]
+            self.cSAT_functions.sat_checkpoint_info.restype = c_int
+            self.cSAT_functions.sat_checkpoint_info.argtypes = [c_void_p, c_char_p, POINTER(c_ulonglong), POINTER(SolveStats)]
+            self.cSAT_functions.sat_checkpoint_state.restype = c_int
+            self.cSAT_functions.sat_checkpoint_state.argtypes = [c_void_p, c_char_p, POINTER(c_double)]
+            self.cSAT_functions.sat_solve_portfolio.restype = c_int
+            self.cSAT_functions.sat_solve_portfolio.argtypes = [c_void_p, c_int, POINTER(SolveOptions), POINTER(c_double), POINTER(SolveStats)]
+            self.cSAT_functions.sat_solve_batch.restype = c_int
+            self.cSAT_functions.sat_solve_batch.argtypes = [c_void_p, POINTER(SolveOptions), c_int, POINTER(c_double), c_int, POINTER(SolveStats)]
+            self.cSAT_functions.sat_cycles_per_second.restype = c_double
+            self.cSAT_functions.sat_cycles_per_second.argtypes = []
+            self.cSAT_functions.sat_problem_set_threads.restype = c_int
+            self.cSAT_functions.sat_problem_set_threads.argtypes = [c_void_p, c_int]
+            self.cSAT_functions.sat_problem_set_simd.restype = c_int
+            self.cSAT_functions.sat_problem_set_simd.argtypes = [c_void_p, c_int]
+            self.cSAT_functions.sat_lyapunov.restype = c_int
+            self.cSAT_functions.sat_lyapunov.argtypes = [c_void_p, POINTER(LyapunovOptions), POINTER(c_double), c_void_p, POINTER(c_double), c_void_p, POINTER(LyapunovStats)]
+            self.cSAT_functions.sat_problem_unsatisfied.restype = c_int
+            self.cSAT_functions.sat_problem_unsatisfied.argtypes = [c_void_p, POINTER(c_double)]
+            self.cSAT_functions.sat_problem_read_dimacs.restype = c_void_p
+            self.cSAT_functions.sat_problem_read_dimacs.argtypes = [c_char_p]
+            self.cSAT_functions.sat_problem_variables.restype = c_int
+            self.cSAT_functions.sat_problem_variables.argtypes = [c_void_p]
+            self.cSAT_functions.sat_problem_clauses.restype = c_int
+            self.cSAT_functions.sat_problem_clauses.argtypes = [c_void_p]
+            self.cSAT_functions.sat_problem_literals.restype = c_int
+            self.cSAT_functions.sat_problem_literals.argtypes = [c_void_p]
+            self.cSAT_functions.sat_problem_export.restype = None
+            self.cSAT_functions.sat_problem_export.argtypes = [c_void_p, POINTER(c_int), POINTER(c_int), POINTER(c_int)]
+            self.cSAT_functions.sat_problem_read_cache.restype = c_void_p
+            self.cSAT_functions.sat_problem_read_cache.argtypes = [c_char_p]
+            self.cSAT_functions.sat_problem_write_cache.restype = c_int
+            self.cSAT_functions.sat_problem_write_cache.argtypes = [c_void_p, c_char_p, c_int]
+            self.cSAT_functions.sat_problem_get_tuning.restype = c_int
+            self.cSAT_functions.sat_problem_get_tuning.argtypes = [c_void_p, POINTER(Tuning)]
+            self.cSAT_functions.sat_problem_set_tuning.restype = None
+            self.cSAT_functions.sat_problem_set_tuning.argtypes = [c_void_p, POINTER(Tuning)]
+            self.cSAT_functions.sat_problem_remove_variable.restype = c_int
+            self.cSAT_functions.sat_problem_remove_variable.argtypes = [c_void_p, c_int]
+            self.cSAT_functions.sat_problem_remove_clause.restype = c_int
+            self.cSAT_functions.sat_problem_remove_clause.argtypes = [c_void_p, c_int]
+            self.cSAT_functions.sat_problem_add_clause.restype = c_int
+            self.cSAT_functions.sat_problem_add_clause.argtypes = [c_void_p, c_int, POINTER(c_int), POINTER(c_int)]
+            self.cSAT_functions.sat_problem_occurrences.restype = c_int
+            self.cSAT_functions.sat_problem_occurrences.argtypes = [c_void_p, c_int]
+            self.cSAT_functions.sat_problem_occurrence_list.restype = None
+            self.cSAT_functions.sat_problem_occurrence_list.argtypes = [c_void_p, c_int, POINTER(c_int), POINTER(c_int)]
+            self.cSAT_functions.sat_problem_smallest_variable.restype = c_int
+            self.cSAT_functions.sat_problem_smallest_variable.argtypes = [c_void_p]
+            self.cSAT_functions.sat_problem_preprocess.restype = c_void_p
+            self.cSAT_functions.sat_problem_preprocess.argtypes = [c_void_p, POINTER(PreprocessOptions), POINTER(c_void_p), POINTER(PreprocessStats)]
+            self.cSAT_functions.sat_reconstruction_destroy.restype = None
+            self.cSAT_functions.sat_reconstruction_destroy.argtypes = [c_void_p]
+            self.cSAT_functions.sat_reconstruction_variables.restype = c_int
+            self.cSAT_functions.sat_reconstruction_variables.argtypes = [c_void_p]
+            self.cSAT_functions.sat_reconstruct.restype = None
+            self.cSAT_functions.sat_reconstruct.argtypes = [c_void_p, POINTER(c_double), POINTER(c_double)]
+            self.cSAT_functions.sat_problem_check_packed.restype = c_longlong
+            self.cSAT_functions.sat_problem_check_packed.argtypes = [c_void_p, c_longlong, POINTER(c_uint64), POINTER(c_uint64)]
+            self.cSAT_functions.sat_problem_enumerate.restype = c_longlong
+            self.cSAT_functions.sat_problem_enumerate.argtypes = [c_void_p, c_uint64, c_uint64, POINTER(c_uint64), c_longlong, POINTER(c_uint64)]
+            self.cSAT_functions.sat_solution_clusters.restype = c_int
+            self.cSAT_functions.sat_solution_clusters.argtypes = [c_int, c_int, POINTER(c_uint64), POINTER(c_int), POINTER(c_int)]
+            self.cSAT_functions.sat_problem_random.restype = c_void_p
+            self.cSAT_functions.sat_problem_random.argtypes = [c_int, c_int, c_int, c_uint64, c_int, POINTER(c_int)]
+            if hasattr(self.cSAT_functions, 'sat_gpu_solve_batch'): #GPU backend (cSAT_cuda.so built from cSAT_cuda.cu)
+                self.cSAT_functions.sat_gpu_devices.restype = c_int
+                self.cSAT_functions.sat_gpu_devices.argtypes = []
+                self.cSAT_functions.sat_gpu_problem_create.restype = c_void_p
+                self.cSAT_functions.sat_gpu_problem_create.argtypes = [c_void_p, c_int]
+                self.cSAT_functions.sat_gpu_problem_destroy.restype = None
+                self.cSAT_functions.sat_gpu_problem_destroy.argtypes = [c_void_p]
+                self.cSAT_functions.sat_gpu_rhs_batch.restype = c_int
+                self.cSAT_functions.sat_gpu_rhs_batch.argtypes = [c_void_p, c_int, c_int, POINTER(c_double), POINTER(c_double)]
+                self.cSAT_functions.sat_gpu_solve_batch.restype = c_int
+                self.cSAT_functions.sat_gpu_solve_batch.argtypes = [c_void_p, POINTER(SolveOptions), c_int, POINTER(c_double), c_int,
+                                                                    POINTER(c_ubyte), POINTER(c_double), POINTER(SolveStats)]
         #Loading/generating problem
-        if cnf_file_name:
-            with open(cnf_file_name) as cnf_file:
-                lines = cnf_file.readlines()
-                super().__init__(int(lines[0].split(' ')[2]))
-                self.number_of_clauses = int(lines[0].split(' ')[3])
-                self.number_of_literals = []
-                #(v)^(v)#
-                clause_and = []
-                for i in range(self.number_of_clauses + 1):
-                    literal_number = 0
-                    if i > 0:
-                        clause_or = []
-                        for variable_str in lines[i].split(' '):
-                            variable = int(variable_str)
-                            if variable != 0:
-                                clause_or.append(variable)
-                                literal_number += 1
-                        clause_and.append(clause_or)
-                        self.number_of_literals.append(literal_number)
-                self.clauses = clause_and
+        self.problem_handle = None
+        if cnf_file_name and self.cSAT_functions:
+            self.read_cnf_native(cnf_file_name)
+        elif cnf_file_name:
+            self.read_cnf(cnf_file_name)
 
         #Randomly generating a sat problem
+        elif self.cSAT_functions:
+            super().__init__(n) #number_of_variables
+            planted_solution = np.empty(n, dtype=np.int32)
+            self.problem_handle = self.cSAT_functions.sat_problem_random(n, int(n*alpha)+1, literal_number, getrandbits(64) if seed is None else seed,
+                                int(planted), planted_solution.ctypes.data_as(POINTER(c_int)))
+            if not self.problem_handle:
+                raise ValueError('could not generate a problem with ' + str(literal_number) + ' literals per clause out of ' + str(n) + ' variables')
+            self.export_problem_handle()
+            if planted:
+                self.planted_solution = planted_solution
         else:
             super().__init__(n) #number_of_variables
+            generator = Random(seed)
+            if planted:
+                self.planted_solution = np.array([1 if generator.getrandbits(1) else -1 for i in range(n)])
             self.clauses = []
             self.number_of_literals = []
             self.number_of_clauses = int(n*alpha)+1
             for i in range(self.number_of_clauses):
-                clause = [elem if randint(0,1) else -elem for elem in sample(range(1, n+1), literal_number)]
+                variables = generator.sample(range(1, n+1), literal_number)
+                clause = [elem if generator.randint(0,1) else -elem for elem in variables]
+                while planted and not any((elem > 0) == (self.planted_solution[abs(elem)-1] > 0) for elem in clause):
+                    clause = [elem if generator.randint(0,1) else -elem for elem in variables]
                 self.number_of_literals.append(literal_number)
                 self.clauses.append(clause)
 
-        #Generating the clause matrix
-        self.c = np.array([[1 if (j+1) in clause else -1 if -(j+1) in clause else 0 for j in range(self.number_of_variables) ] for clause in self.clauses])
+        #Generating the clause arrays (the native reader fills them directly)
+        if self.problem_handle is None:
+            self.generate_clause_arrays()
+            self.create_problem_handle()
         self.alpha = self.get_alpha()
 
-        #Loading c_functions
-        if not so_file_name:
-            self.cSAT_functions = None
+
+    def __del__(self):
+        self.destroy_problem_handle()
+        if getattr(self, 'reconstruction', None):
+            self.cSAT_functions.sat_reconstruction_destroy(self.reconstruction)
+            self.reconstruction = None
+
+    def create_problem_handle(self):
+        """Hands the sparse clause arrays over to the c library, which keeps its own copy (and scratch buffers) until the handle is destroyed"""
+        self.destroy_problem_handle()
+        self.jacobian_pattern = None
+        if self.cSAT_functions:
+            self.problem_handle = self.cSAT_functions.sat_problem_create(self.number_of_variables, self.number_of_clauses,
+                                self.clause_offsets.ctypes.data_as(POINTER(c_int)),
+                                self.literal_variables.ctypes.data_as(POINTER(c_int)),
+                                self.literal_signs.ctypes.data_as(POINTER(c_int)))
+            if not self.problem_handle:
+                raise MemoryError
+
+    def gpu_problem(self, device = 0):
+        """
+        Device copy of the clause structure for the GPU backend (a library built from cSAT_cuda.cu), uploaded on first use and dropped when the problem changes
+        @return: the handle, None if the library has no GPU backend or there is no such device
+        """
+        if not self.cSAT_functions or not hasattr(self.cSAT_functions, 'sat_gpu_solve_batch'):
+            return None
+        if not self.gpu_problem_handle or self.gpu_device != device:
+            self.release_gpu_problem()
+            self.gpu_problem_handle = self.cSAT_functions.sat_gpu_problem_create(self.problem_handle, device)
+            self.gpu_device = device
+        return self.gpu_problem_handle
+
+    def release_gpu_problem(self):
+        if getattr(self, 'gpu_problem_handle', None):
+            self.cSAT_functions.sat_gpu_problem_destroy(self.gpu_problem_handle)
+            self.gpu_problem_handle = None
+
+    def set_threads(self, threads = 0):
+        """
+        Sets the number of threads of the native rhs kernels and of CTD.batch_solve (needs a library compiled with -fopenmp),
+        the rhs kernels use one thread per 4096 clauses at most, so small instances evaluate it serially
+        @param threads: number of threads, 0 uses the OpenMP default
+        @return: the number of threads actually used
+        """
+        if not self.cSAT_functions:
+            return 1
+        return self.cSAT_functions.sat_problem_set_threads(self.problem_handle, threads)
+
+    def set_simd(self, simd = SIMD_AVX512):
+        """
+        Selects the SIMD level of the native 3-SAT clause kernel (the best one available is used by default)
+        @param simd: SIMD_SCALAR, SIMD_AVX2 or SIMD_AVX512
+        @return: the level actually used
+        """
+        if not self.cSAT_functions:
+            return SIMD_SCALAR
+        return self.cSAT_functions.sat_problem_set_simd(self.problem_handle, simd)
+
+    def get_tuning(self):
+        """
+        Solver settings chosen by CTD.auto_tune for this instance (kept in its binary cache), None if it was not tuned or the
+        tuning names a method this version does not know (e.g. a cache written by another version), so it is tuned again
+        """
+        tuning = Tuning()
+        if not self.cSAT_functions or not self.cSAT_functions.sat_problem_get_tuning(self.problem_handle, byref(tuning)):
+            return None
+        solver_types = [name for name, method in NATIVE_SOLVERS.items() if method == tuning.method]
+        if not solver_types:
+            return None
+        solver_type = solver_types[0]
+        return {'solver_type': solver_type, 'atol': tuning.atol, 'rtol': tuning.rtol, 'h': tuning.h, 'progress': tuning.progress,
+                'probes': tuning.probes, 'rhs_type': tuning.rhs_type, 'aux_limit': tuning.aux_limit}
+
+    def set_tuning(self, tuning):
+        """Keeps the solver settings (a dict as returned by get_tuning) with the problem handle, write_problem_to_cache stores them"""
+        self.cSAT_functions.sat_problem_set_tuning(self.problem_handle, byref(Tuning(1, NATIVE_SOLVERS[tuning['solver_type']], tuning['rhs_type'],
+                                                   tuning['probes'], tuning['h'], tuning['atol'], tuning['rtol'], tuning['progress'],
+                                                   tuning.get('aux_limit', 0.0))))
+
+    def cycles_per_second(self):
+        """Rate of the cycle counts in the native solve statistics (calibrated once)"""
+        if self._cycles_per_second is None:
+            self._cycles_per_second = self.cSAT_functions.sat_cycles_per_second()
+        return self._cycles_per_second
+
+    def destroy_problem_handle(self):
+        self.release_gpu_problem()
+        if getattr(self, 'problem_handle', None):
+            self.cSAT_functions.sat_problem_destroy(self.problem_handle)
+            self.problem_handle = None
+
+    def read_cnf(self, cnf_file_name):
+        """
+        Reads a DIMACS cnf file (same rules as the native reader): comment lines are skipped, the header is optional, clauses are
+        terminated by 0 and may span lines, % ends the formula. Files without any terminating 0 are read with one clause per line.
+        """
+        header_variables = 0
+        lines = []
+        with open(cnf_file_name) as cnf_file:
+            for line in cnf_file:
+                tokens = line.split()
+                if not tokens or tokens[0].startswith('c'):
+                    continue
+                if tokens[0].startswith('%'):
+                    break
+                if tokens[0] == 'p':
+                    header_variables = int(tokens[2])
+                    continue
+                lines.append([int(token) for token in tokens])
+        clauses = []
+        if any(0 in line for line in lines):
+            clause = []
+            for literal in (literal for line in lines for literal in line):
+                if literal == 0:
+                    clauses.append(clause)
+                    clause = []
+                else:
+                    clause.append(literal)
+            if clause:
+                clauses.append(clause)
         else:
-            self.cSAT_functions = CDLL(so_file_name)
-            self.cSAT_functions.rhs1.restype = None
-            self.cSAT_functions.rhs2.restype = None
-            self.cSAT_functions.rhs3.restype = None
-            self.cSAT_functions.rhs4.restype = None
-            self.cSAT_functions.rhs5.restype = None
-            self.cSAT_functions.jacobian1.restype = None
-            self.cSAT_functions.jacobian2.restype = None
+            clauses = lines
+        super().__init__(max([header_variables] + [abs(literal) for clause in clauses for literal in clause]))
+        self.number_of_clauses = len(clauses)
+        self.number_of_literals = [len(clause) for clause in clauses]
+        self.clauses = clauses
+
+    def read_cnf_native(self, cnf_file_name):
+        """
+        Reads a DIMACS cnf file with the memory mapped reader of the c library, which builds the problem handle and the clause arrays directly.
+        Binary caches written by write_problem_to_cache are recognised and mapped without parsing.
+        """
+        with open(cnf_file_name, 'rb') as cnf_file:
+            cached = cnf_file.read(len(CACHE_MAGIC)) == CACHE_MAGIC
+        if cached:
+            handle = self.cSAT_functions.sat_problem_read_cache(fsencode(cnf_file_name))
+        else:
+            handle = self.cSAT_functions.sat_problem_read_dimacs(fsencode(cnf_file_name))
+        if not handle:
+            raise ValueError('could not read cnf file ' + str(cnf_file_name))
+        super().__init__(self.cSAT_functions.sat_problem_variables(handle))
+        self.problem_handle = handle
+        self.cache_file_name = cnf_file_name if cached else None
+        self.export_problem_handle()
+
+    def export_problem_handle(self):
+        """Copies the clause arrays of the problem handle back (after reading or editing it natively), the clause list and the dense matrix are rebuilt when needed"""
+        handle = self.problem_handle
+        self.release_gpu_problem()
+        self.number_of_variables = self.cSAT_functions.sat_problem_variables(handle)
+        self.number_of_clauses = self.cSAT_functions.sat_problem_clauses(handle)
+        number_of_literals = self.cSAT_functions.sat_problem_literals(handle)
+        self.clause_offsets = np.empty(self.number_of_clauses + 1, dtype=np.int32)
+        self.literal_variables = np.empty(number_of_literals, dtype=np.int32)
+        self.literal_signs = np.empty(number_of_literals, dtype=np.int32)
+        self.cSAT_functions.sat_problem_export(handle, self.clause_offsets.ctypes.data_as(POINTER(c_int)),
+                                self.literal_variables.ctypes.data_as(POINTER(c_int)), self.literal_signs.ctypes.data_as(POINTER(c_int)))
+        self.number_of_literals = np.diff(self.clause_offsets).tolist()
+        self.clauses = None
+        self.jacobian_pattern = None
+        self.valid_solutions = None
+        self.solution_masks = None
+
+    @property
+    def clauses(self):
+        """List of clauses (lists of signed 1-based variable indices), built from the clause arrays on first use"""
+        if self._clauses is None:
+            literals = (self.literal_variables + 1) * self.literal_signs
+            self._clauses = [clause.tolist() for clause in np.split(literals, self.clause_offsets[1:-1])] if self.number_of_clauses else []
+        return self._clauses
+
+    @clauses.setter
+    def clauses(self, clauses):
+        self._clauses = clauses
+        self._c = None
+
+    @property
+    def c(self):
+        """Dense clause matrix (c[m, i] = +-1 if variable i appears in clause m), built from the clause arrays on first use"""
+        if self._c is None:
+            c = np.zeros((self.number_of_clauses, self.number_of_variables), dtype=int)
+            rows = np.repeat(np.arange(self.number_of_clauses), np.diff(self.clause_offsets))
+            negative = self.literal_signs < 0
+            c[rows[negative], self.literal_variables[negative]] = -1
+            c[rows[~negative], self.literal_variables[~negative]] = 1
+            self._c = c
+        return self._c
+
+    def generate_clause_arrays(self):
+        """Generates the sparse (compressed row) clause arrays from the list of clauses, the dense clause matrix is built when needed"""
+        self._c = None
+        self.valid_solutions = None
+        self.solution_masks = None
+        #Literals of clause m are stored from clause_offsets[m] to clause_offsets[m+1]
+        self.clause_offsets = np.zeros(self.number_of_clauses + 1, dtype=np.int32)
+        self.clause_offsets[1:] = np.cumsum([len(clause) for clause in self.clauses])
+        self.literal_variables = np.array([abs(elem) - 1 for clause in self.clauses for elem in clause], dtype=np.int32)
+        self.literal_signs = np.array([1 if elem > 0 else -1 for clause in self.clauses for elem in clause], dtype=np.int32)
 
     def Jakobian(self, y):
         """Jakobian matrix of the CTDS"""
@@ -190,85 +696,141 @@ class SAT(Problem):
         
         if not self.cSAT_functions:
             s = y[:N_]
-            a = y[N_:M_]
-            if self.rhs_type == RHS_TYPE_ONE:
+            a = y[N_:]
+            rhs_type = self.rhs_type & ~RHS_MIXED_PRECISION
+            if rhs_type == RHS_TYPE_ONE or rhs_type & RHS_LOG_AUX:
                 raise NotImplementedError
-            elif self.rhs_type == RHS_TYPE_TWO:
+            elif rhs_type == RHS_TYPE_TWO:
                 return np.array([[self.Jakobian_il(i, l, s, a) for l in range(N_)] for i in range(N_)])
         else:
-            clause_matrix = self.c.flatten().astype(np.int32) # c
-            clause_matrix_pointer = clause_matrix.ctypes.data_as(POINTER(c_int))
+            state = np.ascontiguousarray(y, dtype=np.double) # s & a
+            result = np.empty((N_+M_, N_+M_), dtype=np.double) # (s + a)**2
+            if self.cSAT_functions.sat_problem_jacobian(self.problem_handle, self.rhs_type, state.ctypes.data_as(POINTER(c_double)), result.ctypes.data_as(POINTER(c_double))):
+                raise MemoryError
+            return result
 
-            state = y.astype(np.double) # s & a
-            state_pointer = state.ctypes.data_as(POINTER(c_double))
+    def Jakobian_sparsity(self):
+        """
+        Sparsity pattern of the jacobian (variables sharing a clause and the clause/aux couplings) as a scipy csr matrix of ones,
+        the mean field coupling of the sin bias of rhs types three to five is not part of it
+        """
+        if not self.cSAT_functions:
+            raise NotImplementedError
+        if self.jacobian_pattern is None:
+            n = self.number_of_variables + self.number_of_clauses
+            nnz = self.cSAT_functions.sat_problem_jacobian_nnz(self.problem_handle)
+            if nnz < 0:
+                raise MemoryError
+            row_offsets = np.empty(n + 1, dtype=np.int32)
+            columns = np.empty(nnz, dtype=np.int32)
+            self.cSAT_functions.sat_problem_jacobian_pattern(self.problem_handle, row_offsets.ctypes.data_as(POINTER(c_int)), columns.ctypes.data_as(POINTER(c_int)))
+            self.jacobian_pattern = (row_offsets, columns)
+        row_offsets, columns = self.jacobian_pattern
+        n = len(row_offsets) - 1
+        return csr_matrix((np.ones(len(columns)), columns, row_offsets), shape=(n, n))
 
-            result = np.empty((self.number_of_variables + self.number_of_clauses)**2)
-            result = result.astype(np.double) # (s + a)**2
-            result_pointer = result.ctypes.data_as(POINTER(c_double))
-        
-            if self.rhs_type == RHS_TYPE_ONE:
-                self.cSAT_functions.jacobian1(self.number_of_variables, self.number_of_clauses, clause_matrix_pointer, state_pointer, result_pointer)
-            elif self.rhs_type == RHS_TYPE_TWO:
-                raise NotImplementedError
-                #self.cSAT_functions.jacobian2(self.number_of_variables, self.number_of_clauses, clause_matrix_pointer, state_pointer, result_pointer)
-            return result.reshape([N_+M_, N_+M_])
+    def Jakobian_sparse(self, t, y):
+        """Jakobian matrix of the CTDS as a scipy csr matrix with the pattern of Jakobian_sparsity (signature of the jac argument of solve_ivp)"""
+        if not self.cSAT_functions:
+            raise NotImplementedError
+        if self.jacobian_pattern is None:
+            self.Jakobian_sparsity()
+        row_offsets, columns = self.jacobian_pattern
+        n = len(row_offsets) - 1
+        state = np.ascontiguousarray(y, dtype=np.double) # s & a
+        values = np.empty(len(columns), dtype=np.double)
+        if self.cSAT_functions.sat_problem_jacobian_sparse(self.problem_handle, self.rhs_type, state.ctypes.data_as(POINTER(c_double)), values.ctypes.data_as(POINTER(c_double))):
+            raise MemoryError
+        return csr_matrix((values, columns, row_offsets), shape=(n, n))
+
+    def jvp(self, y, v):
+        """Jakobian vector product J(y) v of the CTDS, computed from the clauses without forming J"""
+        if not self.cSAT_functions:
+            #the python Jakobian only covers the spin block of RHS_TYPE_TWO, there is no full (N+M) fallback
+            raise NotImplementedError("jacobian-vector products need the c library (so_file_name)")
+        state = np.ascontiguousarray(y, dtype=np.double) # s & a
+        vector = np.ascontiguousarray(v, dtype=np.double)
+        result = np.empty(self.number_of_variables + self.number_of_clauses, dtype=np.double)
+        self.cSAT_functions.sat_problem_jvp(self.problem_handle, self.rhs_type, state.ctypes.data_as(POINTER(c_double)),
+                                            vector.ctypes.data_as(POINTER(c_double)), result.ctypes.data_as(POINTER(c_double)))
+        return result
+
+    def jvp_batch(self, y, V):
+        """
+        Jakobian products J(y) V for the columns of V (size N+M x P), the clause products are shared by all columns
+        @return: J(y) V of size N+M x P
+        """
+        if not self.cSAT_functions:
+            raise NotImplementedError("jacobian-vector products need the c library (so_file_name)")
+        state = np.ascontiguousarray(y, dtype=np.double) # s & a
+        vectors = np.ascontiguousarray(np.transpose(V), dtype=np.double) # one vector per row
+        result = np.empty_like(vectors)
+        self.cSAT_functions.sat_problem_jvp_batch(self.problem_handle, self.rhs_type, state.ctypes.data_as(POINTER(c_double)), vectors.shape[0],
+                                                  vectors.ctypes.data_as(POINTER(c_double)), result.ctypes.data_as(POINTER(c_double)))
+        return result.T
+
+    def rhs_batch(self, Y, device = 0):
+        """
+        Right-hand side of every row of Y (size B x N+M), evaluated on the GPU when the library has a GPU backend and a device
+        @return: array of size B x N+M
+        """
+        states = np.ascontiguousarray(Y, dtype=np.double)
+        handle = self.gpu_problem(device)
+        if not handle:
+            return np.array([self.rhs(0, elem) for elem in states])
+        result = np.empty_like(states)
+        status = self.cSAT_functions.sat_gpu_rhs_batch(handle, self.rhs_type, states.shape[0], states.ctypes.data_as(POINTER(c_double)), result.ctypes.data_as(POINTER(c_double)))
+        if status == SOLVE_NO_MEMORY:
+            raise MemoryError
+        if status == SOLVE_DEVICE_ERROR:
+            raise RuntimeError('GPU rhs evaluation failed')
+        return result
 
-    def rhs(self, t, y):
-        """Right-hand side of the differential equation defining the system"""
+    def rhs(self, t, y, out = None):
+        """
+        Right-hand side of the differential equation defining the system
+        @param out: optional, contiguous double array of size N+M the (native) result is written into.
+                    By default a new array is returned, since scipy solvers keep earlier rhs values around
+        """
         N_ = self.number_of_variables
         if not self.cSAT_functions: #This condition should be moved outside of solver
             s = y[:N_]
-            a = y[N_:]
-            if self.rhs_type == RHS_TYPE_ONE:
+            rhs_type = self.rhs_type & ~(RHS_LOG_AUX | RHS_MIXED_PRECISION)
+            a = np.exp(y[N_:]) if self.rhs_type & RHS_LOG_AUX else y[N_:]
+            if rhs_type == RHS_TYPE_ONE:
                 ds = np.array([sum(2*[a[m]*self.c[m, i]* (1-self.c[m, i]*s[i]) *(self.k(m, i, s)**2) for m in range(self.number_of_clauses)]) for i in range(self.number_of_variables) ])
                 da = np.array([a[m]*self.K(m, s) for m in range(self.number_of_clauses)])
-                return np.concatenate((ds, da), axis=None)
-            elif self.rhs_type == RHS_TYPE_TWO:
+            elif rhs_type == RHS_TYPE_TWO:
                 ds = np.array([sum(2*[a[m]*self.c[m, i]* (1-self.c[m, i]*s[i]) *(self.k(m, i, s)**2) for m in range(self.number_of_clauses)]) for i in range(self.number_of_variables) ])
                 da = np.array([a[m]*(self.K(m, s)**2) for m in range(self.number_of_clauses)])
-                return np.concatenate((ds, da), axis=None)
-            elif self.rhs_type == RHS_TYPE_THREE:
+            elif rhs_type == RHS_TYPE_THREE:
                 b = 0.0725
                 a_ = sum(a)/self.number_of_clauses
                 constant = 0.5*pi*b*self.alpha * a_
                 ds = np.array([sum(2*[a[m]*self.c[m, i]* (1-self.c[m, i]*s[i]) *(self.k(m, i, s)**2) for m in range(self.number_of_clauses)]) + constant*sin(pi*s[i])  for i in range(self.number_of_variables) ])
                 da = np.array([a[m]*(self.K(m, s)**2) for m in range(self.number_of_clauses)])
-                return np.concatenate((ds, da), axis=None)
-            elif self.rhs_type == RHS_TYPE_FOUR or self.rhs_type == RHS_TYPE_FIVE:
+            elif rhs_type == RHS_TYPE_FOUR:
                 b = 0.0725
                 a_ = sum(a)/len(a)
                 constant = 0.5*pi*b*self.alpha * a_
                 ds = np.array([sum(2*[a[m]*self.c[m, i]* (1-self.c[m, i]*s[i]) *(self.k(m, i, s)**2) for m in range(self.number_of_clauses)]) + constant*sin(pi*s[i])  for i in range(self.number_of_variables) ])
                 da = np.array([a[m]*(self.K(m, s)) for m in range(self.number_of_clauses)])
-                return np.concatenate((ds, da), axis=None)
-            elif self.rhs_type == RHS_TYPE_FIVE:
+            elif rhs_type == RHS_TYPE_FIVE:
                 b = 0.0725
                 a_ = sum(a)/len(a)
                 constant = 0.5*pi*b*self.alpha * a_
                 ds = (-1)*np.array([sum(2*[a[m]*self.c[m, i]* (1-self.c[m, i]*s[i]) *(self.k(m, i, s)**2) for m in range(self.number_of_clauses)]) + constant*sin(pi*s[i])  for i in range(self.number_of_variables) ])
                 da = (-1)*np.array([a[m]*(self.K(m, s)) for m in range(self.number_of_clauses)])
-                return np.concatenate((ds, da), axis=None)
+            if self.rhs_type & RHS_LOG_AUX:
+                da = da/a # d ln a/dt
+            return np.concatenate((ds, da), axis=None)
         else:
-            clause_matrix = self.c.flatten().astype(np.int32) # c
-            clause_matrix_pointer = clause_matrix.ctypes.data_as(POINTER(c_int))
-
-            state = y.astype(np.double) # s & a
-            state_pointer = state.ctypes.data_as(POINTER(c_double))
-
-            result = np.empty(self.number_of_variables + self.number_of_clauses)
-            result = result.astype(np.double) # s & a
-            result_pointer = result.ctypes.data_as(POINTER(c_double))
-            
-            if self.rhs_type == RHS_TYPE_ONE:
-                self.cSAT_functions.rhs1(self.number_of_variables, self.number_of_clauses, clause_matrix_pointer, state_pointer, result_pointer)
-            elif self.rhs_type == RHS_TYPE_TWO:
-                self.cSAT_functions.rhs2(self.number_of_variables, self.number_of_clauses, clause_matrix_pointer, state_pointer, result_pointer)
-            elif self.rhs_type == RHS_TYPE_THREE:
-                self.cSAT_functions.rhs3(self.number_of_variables, self.number_of_clauses, clause_matrix_pointer, state_pointer, result_pointer)
-            elif self.rhs_type == RHS_TYPE_FOUR:
-                self.cSAT_functions.rhs4(self.number_of_variables, self.number_of_clauses, clause_matrix_pointer, state_pointer, result_pointer)
-            elif self.rhs_type == RHS_TYPE_FIVE:
-                self.cSAT_functions.rhs5(self.number_of_variables, self.number_of_clauses, clause_matrix_pointer, state_pointer, result_pointer)
+            state = np.ascontiguousarray(y, dtype=np.double) # s & a
+            if out is None:
+                result = np.empty(self.number_of_variables + self.number_of_clauses, dtype=np.double) # s & a
+            else:
+                result = out
+            self.cSAT_functions.sat_problem_rhs(self.problem_handle, self.rhs_type, state.ctypes.data_as(POINTER(c_double)), result.ctypes.data_as(POINTER(c_double)))
             return result
     
     def K(self, m, s):
@@ -284,6 +846,12 @@ class SAT(Problem):
         Removes a variable and all the clauses the variable appeared in.
         @param variable: index of the variable to be removed
         """
+        if self.problem_handle:
+            #edits the handle and its occurrence index in place
+            if self.cSAT_functions.sat_problem_remove_variable(self.problem_handle, variable - 1):
+                raise ValueError('could not remove variable ' + str(variable))
+            self.export_problem_handle()
+            return
         new_clauses = []
         new_literals = []
         for i, clause in enumerate(self.clauses):
@@ -305,9 +873,109 @@ class SAT(Problem):
         self.number_of_variables -= 1
         self.number_of_clauses = len(new_clauses)
         self.number_of_literals = new_literals
+        self.generate_clause_arrays()
+        self.create_problem_handle()
+
+    def add_clause(self, clause):
+        """
+        Appends a clause to the problem.
+        @param clause: list of signed 1-based variable indices, the variables must already exist
+        """
+        if self.problem_handle:
+            variables = np.array([abs(elem) - 1 for elem in clause], dtype=np.int32)
+            signs = np.array([1 if elem > 0 else -1 for elem in clause], dtype=np.int32)
+            if self.cSAT_functions.sat_problem_add_clause(self.problem_handle, len(clause),
+                                variables.ctypes.data_as(POINTER(c_int)), signs.ctypes.data_as(POINTER(c_int))) < 0:
+                raise ValueError('could not add clause ' + str(clause))
+            self.export_problem_handle()
+        else:
+            self.clauses = self.clauses + [list(clause)]
+            self.number_of_clauses += 1
+            self.number_of_literals = list(self.number_of_literals) + [len(clause)]
+            self.generate_clause_arrays()
+
+    def remove_clause(self, clause_index):
+        """
+        Removes a clause, the clauses after it move down by one.
+        @param clause_index: 0-based index of the clause
+        """
+        if self.problem_handle:
+            if self.cSAT_functions.sat_problem_remove_clause(self.problem_handle, clause_index):
+                raise ValueError('could not remove clause ' + str(clause_index))
+            self.export_problem_handle()
+        else:
+            self.clauses = self.clauses[:clause_index] + self.clauses[clause_index+1:]
+            self.number_of_clauses -= 1
+            self.number_of_literals = list(self.number_of_literals[:clause_index]) + list(self.number_of_literals[clause_index+1:])
+            self.generate_clause_arrays()
+
+    def occurrences(self, variable):
+        """
+        Clauses a variable appears in, read from the occurrence index of the problem handle.
+        @param variable: 1-based index of the variable
+        @return: (ascending 0-based clause indices, signs of the variable in those clauses)
+        """
+        if not self.problem_handle:
+            rows = np.repeat(np.arange(self.number_of_clauses), np.diff(self.clause_offsets))
+            where = self.literal_variables == variable - 1
+            return rows[where], self.literal_signs[where]
+        count = self.cSAT_functions.sat_problem_occurrences(self.problem_handle, variable - 1)
+        clauses = np.empty(count, dtype=np.int32)
+        signs = np.empty(count, dtype=np.int32)
+        self.cSAT_functions.sat_problem_occurrence_list(self.problem_handle, variable - 1,
+                                clauses.ctypes.data_as(POINTER(c_int)), signs.ctypes.data_as(POINTER(c_int)))
+        return clauses, signs
+
+    def preprocess(self, unit_propagation = True, pure_literals = True, subsumption = True, elimination = True,
+                   max_occurrences = 16, max_resolvent_length = 16, max_rounds = 0):
+        """
+        Simplifies the problem natively (unit propagation, pure literals, subsumption, bounded variable elimination), clauses that
+        only get shorter are kept. The problem itself is left unchanged, the statistics are stored in self.preprocess_stats.
+        @param unit_propagation: False keeps the unit clauses (also the unit resolvents of the elimination) instead of assigning them
+        @param max_occurrences: variables with more occurrences are not eliminated
+        @param max_resolvent_length: no elimination producing a longer clause (0: unlimited)
+        @param max_rounds: 0 repeats the simplifications until nothing changes
+        @return: the simplified problem (a SAT object, see reconstruct), None if the problem was found unsatisfiable
+        """
+        if not self.problem_handle:
+            raise NotImplementedError
+        options = PreprocessOptions(int(unit_propagation), int(pure_literals), int(subsumption), int(elimination),
+                                    max_occurrences, max_resolvent_length, max_rounds)
+        self.preprocess_stats = PreprocessStats()
+        reconstruction = c_void_p()
+        handle = self.cSAT_functions.sat_problem_preprocess(self.problem_handle, byref(options), byref(reconstruction), byref(self.preprocess_stats))
+        if self.preprocess_stats.status == PREPROCESS_NO_MEMORY:
+            raise MemoryError
+        if not handle:
+            return None
+        simplified = copy(self)
+        simplified.problem_handle = handle
+        simplified.gpu_problem_handle = None
+        simplified.reconstruction = reconstruction.value
+        simplified.valid_solutions = None
+        simplified.solution_masks = None
+        simplified.alpha = None
+        simplified.export_problem_handle()
+        simplified.alpha = simplified.get_alpha() if simplified.number_of_variables else 0.0
+        return simplified
+
+    def reconstruct(self, s):
+        """
+        Extends a solution of a problem returned by preprocess to the original problem
+        @param s: spins (or any values whose signs give the assignment) of the simplified problem
+        @return: +-1 for every variable of the original problem
+        """
+        if not self.reconstruction:
+            raise ValueError('not a preprocessed problem')
+        state = np.ascontiguousarray(s[:self.number_of_variables], dtype=np.double)
+        full = np.empty(self.cSAT_functions.sat_reconstruction_variables(self.reconstruction), dtype=np.double)
+        self.cSAT_functions.sat_reconstruct(self.reconstruction, state.ctypes.data_as(POINTER(c_double)), full.ctypes.data_as(POINTER(c_double)))
+        return full
 
     def smallest_variable(self):
         """Returns the index of the varibale that appears in the smallest number of clauses"""
+        if self.problem_handle:
+            return self.cSAT_functions.sat_problem_smallest_variable(self.problem_handle) + 1
         used_in = [0*1 for i in range(self.number_of_variables)]
         for clause in self.clauses:
             for elem in clause:
@@ -329,6 +997,17 @@ class SAT(Problem):
         with open(file_name, 'w') as mFile:
             mFile.writelines(lines)
 
+    def write_problem_to_cache(self, name, occurrences = True):
+        """
+        Writes the problem into the binary instance cache name.ctds, which SAT loads (memory mapped) instead of parsing a cnf file
+        @param occurrences: optional, also store the variable to clause occurrence index, so it is not rebuilt on loading
+        """
+        if not self.cSAT_functions:
+            raise NotImplementedError
+        file_name = name + ".ctds"
+        if self.cSAT_functions.sat_problem_write_cache(self.problem_handle, fsencode(file_name), 1 if occurrences else 0):
+            raise OSError('could not write ' + file_name)
+
     def get_alpha(self):
         if not self.alpha:
             self.alpha = self.number_of_clauses/self.number_of_variables
@@ -341,6 +1020,8 @@ class SAT(Problem):
         """
         if len(solution) != self.number_of_variables:
             raise ValueError
+        if self.problem_handle:
+            return bool(self.check_solutions([solution])[0])
 
         def check_row(row, solution):
             for elem in row:
@@ -367,8 +1048,58 @@ class SAT(Problem):
             #self.solution = "".join(['1' if elem else '0' for elem in test_solution])
             return True #Solutions solves the problem
 
+    def count_unsatisfied(self, s):
+        """Returns the number of clauses not satisfied by the signs of the spin variables s (s_i > 0 is true)"""
+        if self.cSAT_functions:
+            spins = np.ascontiguousarray(s, dtype=np.double)
+            return self.cSAT_functions.sat_problem_unsatisfied(self.problem_handle, spins.ctypes.data_as(POINTER(c_double)))
+        positive = np.asarray(s) > 0
+        return sum(1 for clause in self.clauses if not any(positive[abs(elem)-1] == (elem > 0) for elem in clause))
+
+    def check_solutions(self, solutions):
+        """
+        Checks many assignments at once with the bit-parallel native checker (64 assignments per word)
+        @param solutions: array like of shape (count, number_of_variables), truthy values are true
+        @return: boolean array, true where the assignment satisfies every clause
+        """
+        solutions = np.asarray(solutions, dtype=bool).reshape(-1, self.number_of_variables)
+        if not self.problem_handle:
+            return np.array([self.check_solution(list(solution)) for solution in solutions], dtype=bool)
+        count = solutions.shape[0]
+        words = (count + 63) // 64
+        #bit-sliced, row i holds variable i of all assignments
+        padded = np.zeros((self.number_of_variables, 64*words), dtype=bool)
+        padded[:, :count] = solutions.T
+        packed = np.ascontiguousarray(np.packbits(padded, axis=1, bitorder='little').view('<u8'), dtype=np.uint64)
+        satisfied = np.empty(words, dtype=np.uint64)
+        self.cSAT_functions.sat_problem_check_packed(self.problem_handle, count, packed.ctypes.data_as(POINTER(c_uint64)), satisfied.ctypes.data_as(POINTER(c_uint64)))
+        return np.unpackbits(satisfied.astype('<u8').view(np.uint8), bitorder='little')[:count].astype(bool)
+
+    def all_solution_masks(self, chunk = 1 << 20):
+        """
+        Enumerates all solutions natively, as integers whose binary digits are the solution strings of all_solutions
+        (the first variable is the most significant bit). Cached, only use for small problems (N <= 62).
+        @param chunk: number of solutions fetched from the library per call
+        @return: ascending uint64 array
+        """
+        if self.solution_masks is None:
+            chunks = []
+            last = 1 << self.number_of_variables
+            position = c_uint64(0)
+            buffer = np.empty(chunk, dtype=np.uint64)
+            while position.value < last:
+                found = self.cSAT_functions.sat_problem_enumerate(self.problem_handle, position.value, last,
+                                buffer.ctypes.data_as(POINTER(c_uint64)), chunk, byref(position))
+                if found < 0:
+                    raise MemoryError
+                chunks.append(buffer[:found].copy())
+            self.solution_masks = np.concatenate(chunks) if chunks else np.empty(0, dtype=np.uint64)
+        return self.solution_masks
+
     def all_solutions(self):
         """Returns a list of all solutions in a list. This uses gready algorithm, do not use for big problems"""
+        if self.valid_solutions is None and self.problem_handle and self.number_of_variables <= 62:
+            self.valid_solutions = [format(int(mask), '0' + str(self.number_of_variables) + 'b') for mask in self.all_solution_masks()]
         if self.valid_solutions is None:
             all_sols = [bin(x)[2:].rjust(self.number_of_variables, '0') for x in range(2**self.number_of_variables)]
             valid_sols = []
@@ -382,6 +1113,12 @@ class SAT(Problem):
 
     def get_solution_index(self, solution):
         """Returns the index of a solution given in a binary string (zeroes and ones as a string)"""
+        if self.problem_handle and self.number_of_variables <= 62:
+            masks = self.all_solution_masks()
+            index = int(np.searchsorted(masks, np.uint64(int(solution, 2))))
+            if index == len(masks) or int(masks[index]) != int(solution, 2):
+                raise ValueError(solution + ' is not a solution')
+            return index
         return self.all_solutions().index( solution )
 
     def Hamming_distance(self, sol1, sol2):
@@ -394,68 +1131,136 @@ class SAT(Problem):
                     distance += 1
             return distance
 
-    def get_clusters(self):
-        """Generates dictionary of solution clusters, only use for small problems"""
-        def in_dict_list(elem, dict):
-            for val in dict.values():
-                if elem in val:
-                    return True
-            return False
-        
-        def get_sol_key(solution, clusters):
-            for key, val in clusters.items():
-                for sol in val:
-                    if sol == solution:
-                        return key
-            
-            return None
+    def solution_clusters(self):
+        """
+        Clusters of the solutions (connected by single variable flips), found natively with a hash set of the solutions and union-find
+        @return: (cluster of every solution in the order of all_solutions, number of solutions in every cluster),
+                 clusters are numbered in the order of their first solution
+        """
+        masks = np.ascontiguousarray(self.all_solution_masks(), dtype=np.uint64)
+        cluster = np.empty(len(masks), dtype=np.int32)
+        sizes = np.empty(max(len(masks), 1), dtype=np.int32)
+        clusters = self.cSAT_functions.sat_solution_clusters(len(masks), self.number_of_variables, masks.ctypes.data_as(POINTER(c_uint64)),
+                                cluster.ctypes.data_as(POINTER(c_int)), sizes.ctypes.data_as(POINTER(c_int)))
+        if clusters < 0:
+            raise MemoryError
+        return cluster, sizes[:clusters]
 
+    def get_clusters(self):
+        """Generates dictionary of solution clusters (keyed by the index of their first solution), only use for small problems"""
         solutions = self.all_solutions()
-        clusters = {}
+        if self.problem_handle and self.number_of_variables <= 62:
+            cluster, sizes = self.solution_clusters()
+            firsts = {}
+            clusters = {}
+            for index, (sol, cluster_id) in enumerate(zip(solutions, cluster)):
+                key = firsts.setdefault(int(cluster_id), index)
+                clusters.setdefault(key, []).append(sol)
+            return clusters
 
+        #breadth first search over single bit flips
+        positions = {sol: index for index, sol in enumerate(solutions)}
+        flip = {'0': '1', '1': '0'}
+        clusters = {}
+        seen = set()
         for cluster_idx, sol in enumerate(solutions):
-            if not in_dict_list(sol, clusters):
-                clusters[cluster_idx] = [sol]
-            for sol2 in solutions:
-                if sol2 != sol and not in_dict_list(sol2, clusters) and self.Hamming_distance(sol, sol2) == 1:
-                        clusters[get_sol_key(sol, clusters)].append(sol2)
-        
+            if sol in seen:
+                continue
+            seen.add(sol)
+            members = [sol]
+            queue = [sol]
+            while queue:
+                current = queue.pop()
+                for i in range(len(current)):
+                    neighbour = current[:i] + flip[current[i]] + current[i+1:]
+                    if neighbour in positions and neighbour not in seen:
+                        seen.add(neighbour)
+                        members.append(neighbour)
+                        queue.append(neighbour)
+            clusters[cluster_idx] = sorted(members, key=positions.get)
         return clusters
 
+def generate_random_caches(so_file_name, prefix, count, n, alpha = 4.264, literal_number = 3, seed = 0, planted = False, threads = 0, occurrences = True):
+    """
+    Generates random k-SAT instances natively (in parallel per instance) straight into binary caches, which SAT reads mapped
+    @param prefix: instance b is written to prefix + str(b) + '.ctds', it is the problem of SAT(None, so_file_name, n, alpha, literal_number, seed = seed + b)
+    @param threads: number of threads (0: OpenMP default)
+    @return: list of the file names
+    """
+    cSAT_functions = CDLL(so_file_name)
+    cSAT_functions.sat_write_random_caches.restype = c_int
+    cSAT_functions.sat_write_random_caches.argtypes = [c_int, c_int, c_int, c_int, c_uint64, c_int, c_int, c_char_p, c_int]
+    written = cSAT_functions.sat_write_random_caches(count, n, int(n*alpha)+1, literal_number, seed, int(planted), threads, fsencode(prefix), int(occurrences))
+    if written != count:
+        raise OSError('could only write ' + str(written) + ' of ' + str(count) + ' instances')
+    return [prefix + str(b) + '.ctds' for b in range(count)]
+
+def portfolio_configurations(rhs_types = (RHS_TYPE_ONE, RHS_TYPE_THREE, RHS_TYPE_FOUR), solver_types = ('native_RK45',), tolerances = ((0.000001, 0.001),),
+                             seeds = (0,)):
+    """Every combination of the rhs types, native solvers, (atol, rtol) pairs and initial state seeds, as configurations of CTD.portfolio_solve"""
+    return [{'rhs_type': rhs_type, 'solver_type': solver_type, 'atol': atol, 'rtol': rtol, 'seed': seed}
+            for rhs_type in rhs_types for solver_type in solver_types for atol, rtol in tolerances for seed in seeds]
+
 #Numerical solver definition(s)
 
 class CTD:
-    def __init__(self, problem, integrator = None, initial_s = None, random_aux = False) -> None:
+    def __init__(self, problem, integrator = None, initial_s = None, random_aux = False, seed = None) -> None:
+        """
+        @param seed: optional, seed of the random initial state (drawn if None), kept in self.seed and in the checkpoints of native_solve
+        """
         self.problem = problem
+        self.integrator = integrator
         self.state = np.empty(problem.number_of_variables + problem.number_of_clauses)
+        self.seed = getrandbits(64) if seed is None else seed
+        generator = Random(self.seed)
 
         #Dynamical variables
         if initial_s is None:
-            self.state[0:problem.number_of_variables] = np.array([2*random() -1 for i in range(problem.number_of_variables)])
+            self.state[0:problem.number_of_variables] = np.array([2*generator.random() -1 for i in range(problem.number_of_variables)])
         else:
             self.state[0:problem.number_of_variables] = initial_s
         if random_aux == True:
-            self.state[problem.number_of_variables:] = np.array( [random()*15 for i in range(self.problem.number_of_clauses)] )
+            #(1 - random()) lies in (0, 1], so no aux variable starts at 0 (-inf in the log domain)
+            self.state[problem.number_of_variables:] = np.array( [(1 - generator.random())*15 for i in range(self.problem.number_of_clauses)] )
         else:
             self.state[problem.number_of_variables:] = np.ones(self.problem.number_of_clauses)
+        if problem.rhs_type & RHS_LOG_AUX:
+            self.state[problem.number_of_variables:] = np.log(self.state[problem.number_of_variables:])
         self.time = 0
 
         #Records
         self.aux = []
         self.solutions = []
         self.solution_time = None
+        self.stats = None   #statistics of the last solve (solve_statistics)
 
-    def fast_solve(self, t_max, exit_type = ORTANT, solver_type = 'BDF', atol=0.000001, rtol=0.001) -> None :
+    def fast_solve(self, t_max, exit_type = ORTANT, solver_type = 'BDF', atol=0.000001, rtol=0.001, h = None, jacobian = True) -> None :
         """
         Solver function, using predefined integrator (default is scipy)
         @param t_max: maximum analog time
         @param exit_type: defines the exit condition (ORTANT = 0) (CONVERGENCE_RADIUS = -1)
-        @param solver_type: predefined solver parameter (in scipy or otherwise)
+        @param solver_type: predefined solver parameter (in scipy or otherwise), the keys of NATIVE_SOLVERS run the whole integration in the c library,
+                            'auto' runs a native solver with the settings of auto_tune (atol, rtol and h are ignored then)
         @param atol, rtol: absolute and relative tolerances
+        @param h: optional, step size of the fixed step native solvers (initial step of the adaptive ones), defaults to the step of the integrator
+        @param jacobian: optional, the implicit scipy solvers (IMPLICIT_SOLVERS) get the analytic sparse jacobian of the native library,
+                         if False they finite difference the rhs using its sparsity pattern
         """
+        if solver_type in NATIVE_SOLVERS:
+            return self.native_solve(t_max, exit_type, NATIVE_SOLVERS[solver_type], atol, rtol, h)
+        if solver_type == 'auto':
+            tuning = self.auto_tune()
+            return self.native_solve(t_max, exit_type, NATIVE_SOLVERS[tuning['solver_type']], tuning['atol'], tuning['rtol'], tuning['h'])
+
+        jacobian_options = {}
+        if solver_type in IMPLICIT_SOLVERS and self.problem.cSAT_functions:
+            if jacobian:
+                jacobian_options['jac'] = self.problem.Jakobian_sparse
+            else:
+                jacobian_options['jac_sparsity'] = self.problem.Jakobian_sparsity()
+
         def exit_ortant(t, y) -> float:
-            boolean_sol = [True if elem > 0 else False for elem in y[0:self.problem.number_of_variables]]
-            if self.problem.check_solution(boolean_sol):
+            if self.problem.count_unsatisfied(y[0:self.problem.number_of_variables]) == 0:
                 #self.solutions.append(boolean_sol)
                 #if self.solution_time is None:
                 #    self.solution_time = t
@@ -466,8 +1271,7 @@ class CTD:
         def exit_long(t, y):
             N = self.problem.number_of_variables
             s = y[0:N]
-            boolean_sol = [True if elem > 0 else False for elem in s]
-            if self.problem.check_solution(boolean_sol):
+            if self.problem.count_unsatisfied(s) == 0:
                 sigma = 0.5
                 R = sqrt(N-1+sigma**2)
                 sabs = np.linalg.norm(s)
@@ -476,13 +1280,15 @@ class CTD:
             return -1.0
         exit_long.terminal = True
 
+        one = 0.0 if self.problem.rhs_type & RHS_LOG_AUX else 1.0 # a_m < 1
         def exit_negative_aux(t, y) ->float:
-            if any([elem < 1 for elem in y[self.problem.number_of_variables:]]):
+            if any([elem < one for elem in y[self.problem.number_of_variables:]]):
                 return 0.0
             else:
                 return -1.0
         exit_negative_aux.terminal = True
 
+        start = perf_counter()
         if exit_type == ORTANT:
             self.sol = solve_ivp(fun=self.problem.rhs,
                             t_span=(0, t_max),
@@ -492,7 +1298,8 @@ class CTD:
                             dense_output=False,
                             events=exit_ortant,
                             atol=atol,
-                            rtol=rtol)
+                            rtol=rtol,
+                            **jacobian_options)
         elif exit_type == CONVERGENCE_RADIUS:
             self.sol = solve_ivp(fun=self.problem.rhs,
                             t_span=(0, t_max),
@@ -502,7 +1309,8 @@ class CTD:
                             dense_output=False,
                             events=exit_long,
                             atol=atol,
-                            rtol=rtol)
+                            rtol=rtol,
+                            **jacobian_options)
         elif exit_type == NEGATIVE_AUX:
             self.sol = solve_ivp(fun=self.problem.rhs,
                             t_span=(0, t_max),
@@ -512,7 +1320,8 @@ class CTD:
                             dense_output=False,
                             events=exit_negative_aux,
                             atol=atol,
-                            rtol=rtol)                    
+                            rtol=rtol,
+                            **jacobian_options)                    
         else:
             self.sol = solve_ivp(fun=self.problem.rhs,
                             t_span=(0, t_max),
@@ -521,8 +1330,350 @@ class CTD:
                             t_eval=None,
                             dense_output=False,
                             atol=atol,
-                            rtol=rtol)
-        
+                            rtol=rtol,
+                            **jacobian_options)
+        self.stats = {'solver': solver_type, 'status': self.sol.status, 't': self.sol.t[-1], 'rhs_evaluations': self.sol.nfev,
+                      'jacobian_evaluations': self.sol.njev, 'lu_decompositions': self.sol.nlu, 'solve_seconds': perf_counter() - start}
+
+    def native_solve(self, t_max, exit_type = ORTANT, method = SOLVER_DORMAND_PRINCE, atol=0.000001, rtol=0.001, h = None, max_steps = 0, aux_limit = 0.0, mixed_precision = False,
+                     timing = False, trace_file = None, trace_interval = 100, record_every = 0, record_rows = 1000, record_mode = OUTPUT_DECIMATE,
+                     spins_only = False, output = None, output_file = None, callback = None, checkpoint_file = None, checkpoint_interval = 600.0,
+                     resume_file = None, finish_threshold = 0, finish_flips = 0, finish_noise = 0.5) -> None :
+        """
+        Runs the whole trajectory in the c library with a single foreign call
+        @param t_max: maximum analog time
+        @param exit_type: defines the exit condition (ORTANT = 0) (CONVERGENCE_RADIUS = -1) (NEGATIVE_AUX = -2), other values run until t_max
+        @param method: SOLVER_EULER, SOLVER_RK4 (fixed step), SOLVER_CASH_KARP or SOLVER_DORMAND_PRINCE (adaptive)
+        @param atol, rtol: absolute and relative tolerances of the adaptive methods
+        @param h: optional, fixed step size (initial step size of the adaptive methods, chosen automatically if None)
+        @param max_steps: optional, maximum number of accepted steps (0 means unlimited)
+        @param aux_limit: optional, if positive all aux variables are divided by the largest one whenever it exceeds aux_limit,
+                          this keeps their ratios but rescales the speed of the spin dynamics (0 turns it off). It cannot be
+                          combined with the NEGATIVE_AUX exit, which compares the aux variables with their unscaled initial value
+        @param mixed_precision: optional, evaluate the rhs with the single precision spin kernels (same as adding RHS_MIXED_PRECISION
+                                to the rhs type of the problem), the state and the step size control stay double
+        @param timing: optional, count the cycles spent in the rhs evaluations, the exit checks and the whole solve (small overhead)
+        @param trace_file: optional, file receiving one line (trajectory, step, t, h, unsatisfied clauses, flips, rhs evaluations,
+                           rejected steps, largest aux variable) every trace_interval accepted steps
+        @param record_every: optional, if positive the state is recorded at t = 0, every record_every accepted steps and at the end,
+                             self.sol.t and self.sol.y then hold the recorded rows (otherwise only the initial and the final state)
+        @param record_rows: optional, rows kept by the native solver, the memory stays bounded however long the trajectory is
+        @param record_mode: optional, OUTPUT_DECIMATE halves the rows and doubles the stride whenever they are full (a coarse view of
+                            the whole trajectory), OUTPUT_RING overwrites the oldest row (the last record_rows records)
+        @param spins_only: optional, record only the spin variables, without the aux block
+        @param output: optional, preallocated C-contiguous float64 array of rows (t, recorded state) used instead of allocating record_rows
+        @param output_file: optional, file receiving every recorded row as raw float64 (read it with np.fromfile(...).reshape(-1, 1+width))
+        @param callback: optional, callback(t, row) called with every recorded row (row is only valid during the call), returning True
+                         cancels the solve (status SOLVE_CANCELLED)
+        @param checkpoint_file: optional, the integrator state (state, step size controller, stats and self.seed) is saved to this
+                                binary file every checkpoint_interval seconds of wall clock time, and at the end if the solve stopped at
+                                t_max, max_steps or by the callback. The file is replaced atomically, see resume
+        @param resume_file: optional, continue the solve saved in this checkpoint instead of starting from self.state (see resume)
+        @param finish_threshold: optional, if positive a WalkSAT local search (finish_flips flips, 0 means 20 N, random walk probability
+                                 finish_noise) starts from the signs of the spins whenever at most this many clauses are unsatisfied,
+                                 the solve returns as soon as it finds a satisfying assignment (stats 'search_solved'). After a failed
+                                 search it only searches again below that number of unsatisfied clauses or once it exceeded the threshold.
+                                 Only used with the ORTANT exit, the other exit types ignore it
+        The statistics of the solve are kept in self.stats (see solve_statistics)
+        """
+        options = self.native_options(t_max, exit_type, method, atol, rtol, h, max_steps, aux_limit, mixed_precision, timing, trace_file, trace_interval,
+                                      finish_threshold, finish_flips, finish_noise)
+        width = self.problem.number_of_variables if spins_only else len(self.state)
+        if record_every > 0:
+            if output is None:
+                output = np.empty((record_rows, 1 + width), dtype=np.double)
+            elif output.dtype != np.double or output.ndim != 2 or output.shape[1] != 1 + width or not output.flags['C_CONTIGUOUS']:
+                raise ValueError("output has to be a C-contiguous float64 array with " + str(1 + width) + " columns")
+            options.output_interval = record_every
+            options.output_mode = record_mode
+            options.output_spins = int(spins_only)
+            options.output_capacity = output.shape[0]
+            options.output = output.ctypes.data_as(POINTER(c_double))
+            options.output_path = fsencode(output_file) if output_file is not None else None
+            if callback is not None:
+                options.output_callback = OutputCallback(lambda data, t, row, n: int(bool(callback(t, np.ctypeslib.as_array(row, shape=(n,))))))
+        if checkpoint_file is not None:
+            options.checkpoint_interval = checkpoint_interval
+            options.checkpoint_path = fsencode(checkpoint_file)
+        y0, t0 = self.state, 0.0
+        if resume_file is not None:
+            options.resume_path = fsencode(resume_file)
+            #the solution starts where the checkpoint resumes (a failed read fails the solve below)
+            y0, start, seed = np.empty(len(self.state), dtype=np.double), SolveStats(), c_ulonglong()
+            if not self.problem.cSAT_functions.sat_checkpoint_info(self.problem.problem_handle, options.resume_path, byref(seed), byref(start)) and \
+               not self.problem.cSAT_functions.sat_checkpoint_state(self.problem.problem_handle, options.resume_path, y0.ctypes.data_as(POINTER(c_double))):
+                t0 = start.t
+        stats = SolveStats()
+        y = np.array(self.state, dtype=np.double)
+        self.problem.cSAT_functions.sat_solve(self.problem.problem_handle, byref(options), y.ctypes.data_as(POINTER(c_double)), byref(stats))
+        if stats.status == SOLVE_NO_MEMORY:
+            raise MemoryError
+        if stats.status == SOLVE_INVALID_ARGUMENT:
+            raise ValueError('invalid solver options, the fixed step solvers need a positive step size h and aux_limit does not work with NEGATIVE_AUX')
+        if stats.status == SOLVE_TRACE_ERROR:
+            raise IOError('could not open the trace file ' + str(trace_file) + ' or write the output file ' + str(output_file))
+        if stats.status == SOLVE_CHECKPOINT_ERROR:
+            raise IOError('could not write the checkpoint ' + str(checkpoint_file) + ' or resume from ' + str(resume_file) +
+                          ' (it has to be of the same problem, rhs type, method and number of rhs threads)')
+        records = None
+        if record_every > 0:
+            records = np.roll(output[:stats.output_rows], -stats.output_first, axis=0) if stats.output_first else output[:stats.output_rows]
+        self.sol = NativeSolution(y0, y, stats, records, t0)
+        self.stats = self.solve_statistics(stats, timing)
+        if stats.status == SOLVE_EXIT:
+            self.solution_time = stats.t
+
+    def auto_tune(self, probe_steps = 200, candidates = None, table_file = None, store = True, force = False, aux_limit = 0.0,
+                  mixed_precision = False):
+        """
+        Picks the native solver and tolerances (or step size) that advance the most analog time per second of wall clock on this
+        instance. The tuning of the problem (e.g. read from its binary cache) is used if it was made for the current rhs type (with
+        RHS_MIXED_PRECISION for mixed_precision) and aux_limit, then
+        the entry of table_file, otherwise every candidate is probed for probe_steps accepted steps from self.state (diverging or
+        failing probes are discarded)
+        @param candidates: optional, list of dicts with solver_type (a key of NATIVE_SOLVERS), atol, rtol and h, defaults to TUNING_CANDIDATES
+        @param table_file: optional, JSON table of earlier results keyed by N, alpha (2 decimals), the longest clause, the rhs type
+                           (with RHS_MIXED_PRECISION) and aux_limit, probed results are added to it
+        @param store: optional, keep a new result (probed or from table_file) with the problem and rewrite the binary cache it was read
+                      from (SAT.cache_file_name), unless the problem already has the same tuning
+        @param force: optional, probe even if a tuning is known
+        @param aux_limit, mixed_precision: optional, as in native_solve, the probes run with the settings of the later solve
+        @return: dict with solver_type, atol, rtol, h, progress (analog time per second in the probes), probes, rhs_type and aux_limit,
+                 RuntimeError if no probe ran its probe_steps steps (nothing is stored then)
+        """
+        problem = self.problem
+        N = problem.number_of_variables
+        rhs_type = problem.rhs_type | (RHS_MIXED_PRECISION if mixed_precision else 0)
+        key = '%d %.2f %d %d %r' % (N, problem.number_of_clauses / N if N else 0.0, max(problem.number_of_literals, default=0), rhs_type,
+                                    float(aux_limit))
+        def matches(tuning):
+            return tuning is not None and tuning.get('rhs_type') == rhs_type and tuning.get('aux_limit', 0.0) == aux_limit
+        table = {}
+        if table_file is not None:
+            try:
+                with open(table_file) as table_stream:
+                    table = load(table_stream)
+            except (OSError, ValueError):
+                table = {}
+        tuning = None if force else problem.get_tuning()
+        if not matches(tuning):
+            tuning = None
+        known = tuning is not None
+        if tuning is None and not force:
+            tuning = table.get(key)
+            if not matches(tuning):
+                tuning = None
+        if tuning is None:
+            candidates = TUNING_CANDIDATES if candidates is None else candidates
+            for candidate in candidates:
+                options = self.native_options(float('inf'), NO_EXIT, NATIVE_SOLVERS[candidate['solver_type']], candidate.get('atol', 0.000001),
+                                              candidate.get('rtol', 0.001), candidate.get('h'), probe_steps, aux_limit, mixed_precision)
+                y = np.array(self.state, dtype=np.double)
+                stats = SolveStats()
+                start = perf_counter()
+                self.problem.cSAT_functions.sat_solve(self.problem.problem_handle, byref(options), y.ctypes.data_as(POINTER(c_double)), byref(stats))
+                wall = perf_counter() - start
+                if stats.status != SOLVE_MAX_STEPS or not wall > 0 or not stats.t > 0:
+                    continue
+                progress = stats.t / wall
+                if tuning is None or progress > tuning['progress']:
+                    tuning = {'solver_type': candidate['solver_type'], 'atol': options.atol, 'rtol': options.rtol, 'h': options.h, 'progress': progress}
+            if tuning is None:
+                raise RuntimeError('every auto_tune probe failed (diverged, stopped early or made no progress), nothing was tuned')
+            tuning.update(probes=len(candidates), rhs_type=rhs_type, aux_limit=float(aux_limit))
+            if table_file is not None:
+                table[key] = tuning
+                with open(table_file, 'w') as table_stream:
+                    dump(table, table_stream, indent=1)
+        #a tuning read from the problem (its cache) is not written back, jobs sharing the cache would keep replacing it
+        if store and not known and tuning != problem.get_tuning():
+            problem.set_tuning(tuning)
+            if problem.cache_file_name is not None:
+                if problem.cSAT_functions.sat_problem_write_cache(problem.problem_handle, fsencode(problem.cache_file_name), 1):
+                    raise OSError('could not write ' + str(problem.cache_file_name))
+        return tuning
+
+    def checkpoint_info(self, checkpoint_file):
+        """Seed and statistics (see solve_statistics) saved in a checkpoint of native_solve, None if it is not a checkpoint of this problem"""
+        seed = c_ulonglong()
+        stats = SolveStats()
+        if self.problem.cSAT_functions.sat_checkpoint_info(self.problem.problem_handle, fsencode(checkpoint_file), byref(seed), byref(stats)):
+            return None
+        return dict(self.solve_statistics(stats), seed=seed.value)
+
+    def resume(self, checkpoint_file, t_max, exit_type = ORTANT, method = SOLVER_DORMAND_PRINCE, **options) -> None :
+        """
+        Continues a native_solve from its checkpoint (e.g. after the job was preempted), the trajectory is the same bit for bit as
+        without the interruption if the tolerances and the other settings are the same. The rhs type, the method and the number of
+        rhs threads (SAT.set_threads, which changes the summation order of the rhs) have to match the checkpoint, t_max, exit_type and max_steps may differ (a larger t_max extends a solve that stopped there). The checkpoints
+        keep going to checkpoint_file unless options sets another one, self.seed is restored from the checkpoint.
+        @param options: the other parameters of native_solve
+        """
+        info = self.checkpoint_info(checkpoint_file)
+        if info is None:
+            raise IOError('no checkpoint of this problem in ' + str(checkpoint_file))
+        self.seed = info['seed']
+        options.setdefault('checkpoint_file', checkpoint_file)
+        self.native_solve(t_max, exit_type, method, resume_file=checkpoint_file, **options)
+
+    def portfolio_solve(self, configurations, t_max, exit_type = ORTANT, max_steps = 0):
+        """
+        Races differently configured native solves of the problem on the threads of the problem (SAT.set_threads) and stops all of
+        them as soon as the first one reaches the exit condition
+        @param configurations: list of dicts (see portfolio_configurations) with the optional keys rhs_type (default: the one of the
+                               problem), solver_type (a key of NATIVE_SOLVERS, default native_RK45), atol, rtol, h, aux_limit,
+                               mixed_precision, finish_threshold, finish_flips, finish_noise (as in native_solve) and seed (the initial state of CTD(problem, seed=seed), None or
+                               missing starts from self.state)
+        @param t_max, exit_type, max_steps: as in native_solve, the same for every configuration
+        The statistics of every configuration are kept in self.portfolio_stats, self.sol holds the trajectory of the winner
+        @return: boolean array of the satisfying assignment and the winning configuration, (None, None) if no configuration solved it
+        """
+        N = self.problem.number_of_variables
+        B = len(configurations)
+        options = (SolveOptions * B)()
+        y = np.empty((B, len(self.state)), dtype=np.double)
+        for b, configuration in enumerate(configurations):
+            rhs_type = configuration.get('rhs_type', self.problem.rhs_type)
+            options[b] = self.native_options(t_max, exit_type, NATIVE_SOLVERS[configuration.get('solver_type', 'native_RK45')],
+                                             configuration.get('atol', 0.000001), configuration.get('rtol', 0.001), configuration.get('h'),
+                                             max_steps, configuration.get('aux_limit', 0.0), finish_threshold = configuration.get('finish_threshold', 0),
+                                             finish_flips = configuration.get('finish_flips', 0), finish_noise = configuration.get('finish_noise', 0.5))
+            options[b].rhs_type = rhs_type | (RHS_MIXED_PRECISION if configuration.get('mixed_precision', False) else 0)
+            if configuration.get('seed') is None:
+                y[b] = self.state
+                y[b, N:] = np.exp(self.state[N:]) if self.problem.rhs_type & RHS_LOG_AUX else self.state[N:]
+            else:
+                generator = Random(configuration['seed'])
+                y[b, :N] = [2*generator.random() - 1 for i in range(N)]
+                y[b, N:] = 1.0
+            if rhs_type & RHS_LOG_AUX:
+                y[b, N:] = np.log(y[b, N:])
+        initial_states = y.copy()
+        stats = (SolveStats * B)()
+        winner = self.problem.cSAT_functions.sat_solve_portfolio(self.problem.problem_handle, B, options, y.ctypes.data_as(POINTER(c_double)), stats)
+        if winner == SOLVE_NO_MEMORY:
+            raise MemoryError
+        if winner == SOLVE_INVALID_ARGUMENT:
+            raise ValueError('invalid configuration, the fixed step solvers need a positive step size h and aux_limit does not work with NEGATIVE_AUX')
+        self.portfolio_stats = [self.solve_statistics(elem) for elem in stats]
+        if winner < 0:
+            return None, None
+        self.sol = NativeSolution(initial_states[winner], y[winner], stats[winner])
+        self.stats = self.portfolio_stats[winner]
+        self.solution_time = stats[winner].t
+        return y[winner, :N] > 0, configurations[winner]
+
+    def batch_solve(self, initial_states, t_max, exit_type = ORTANT, solver_type = 'native_RK45', atol=0.000001, rtol=0.001, h = None, stop_after = 0, aux_limit = 0.0,
+                    gpu = False, device = 0, mixed_precision = False, timing = False, trace_file = None, trace_interval = 100, finish_threshold = 0,
+                    finish_flips = 0, finish_noise = 0.5):
+        """
+        Integrates many trajectories of the problem with one foreign call (e.g. random restarts)
+        @param initial_states: B x (N+M) array of initial states
+        @param stop_after: optional, stop as soon as this many trajectories reached the exit condition, 0 runs all of them. With one
+                           thread they are counted in analog time order (the running trajectory with the smallest t always advances
+                           next), with several threads (SAT.set_threads) and on the GPU in the wall clock order they finish in
+        @param gpu: optional, integrate on the GPU (library built from cSAT_cuda.cu), the states stay on the device and only the
+                    assignments and solution times are copied back. All trajectories advance one step at a time there and stop_after
+                    is checked every few steps, so a few more trajectories than stop_after can finish. At most 65535 trajectories per call.
+        @param device: optional, GPU to use
+        The other parameters are the same as in fast_solve (solver_type has to be one of NATIVE_SOLVERS) and native_solve,
+        the GPU backend ignores timing, trace_file and the finishing stage. The statistics of every trajectory are kept in self.batch_stats
+        @return: array of solution times (nan where the exit condition was not reached) and the B x N boolean array of final assignments
+        """
+        options = self.native_options(t_max, exit_type, NATIVE_SOLVERS[solver_type], atol, rtol, h, 0, aux_limit, mixed_precision,
+                                      timing, trace_file, trace_interval, finish_threshold, finish_flips, finish_noise)
+        y = np.array(initial_states, dtype=np.double, order='C')
+        B = y.shape[0]
+        stats = (SolveStats * B)()
+        if gpu:
+            handle = self.problem.gpu_problem(device)
+            if not handle:
+                raise ValueError("no GPU backend (cSAT_cuda.so) or no such device")
+            assignments = np.empty((B, self.problem.number_of_variables), dtype=np.uint8)
+            solved = self.problem.cSAT_functions.sat_gpu_solve_batch(handle, byref(options), B, y.ctypes.data_as(POINTER(c_double)), stop_after,
+                                                                     assignments.ctypes.data_as(POINTER(c_ubyte)), None, stats)
+            if solved == SOLVE_NO_MEMORY:
+                raise MemoryError
+            if solved == SOLVE_INVALID_ARGUMENT:
+                raise ValueError('invalid solver options, the fixed step solvers need a positive step size h and aux_limit does not work with NEGATIVE_AUX')
+            if solved == SOLVE_DEVICE_ERROR:
+                raise RuntimeError('GPU integration failed')
+            self.batch_stats = [self.solve_statistics(elem) for elem in stats]
+            times = np.array([elem.t if elem.status == SOLVE_EXIT else nan for elem in stats])
+            return times, assignments > 0
+        solved = self.problem.cSAT_functions.sat_solve_batch(self.problem.problem_handle, byref(options), B, y.ctypes.data_as(POINTER(c_double)), stop_after, stats)
+        if solved == SOLVE_NO_MEMORY:
+            raise MemoryError
+        if solved == SOLVE_INVALID_ARGUMENT:
+            raise ValueError('invalid solver options, the fixed step solvers need a positive step size h and aux_limit does not work with NEGATIVE_AUX')
+        if solved == SOLVE_TRACE_ERROR:
+            raise IOError('could not open the trace file ' + str(trace_file))
+        self.batch_stats = [self.solve_statistics(elem, timing) for elem in stats]
+        times = np.array([elem.t if elem.status == SOLVE_EXIT else nan for elem in stats])
+        return times, y[:, :self.problem.number_of_variables] > 0
+
+    def native_lyapunov(self, t_max, exponents = 1, h = None, qr_interval = 10, exit_type = NO_EXIT, max_records = 1000):
+        """
+        Leading Lyapunov exponents along the trajectory from the current state (Benettin's method in the c library: fixed step RK4
+        for the state and the tangent vectors, re-orthonormalised every qr_interval steps), only O(exponents*(N+M)) memory is used
+        @param exponents: number of leading exponents
+        @param h: optional, step size, defaults to the step of the integrator
+        @param exit_type: optional, stop at this exit condition (ORTANT, CONVERGENCE_RADIUS, NEGATIVE_AUX), NO_EXIT runs until t_max
+        @param max_records: rows of the history of running estimates
+        @return: array of the estimated exponents, the running estimates (rows t, lambda_1 ... lambda_p) are kept in self.lyapunov_history
+        """
+        if h is None:
+            h = self.integrator.h if self.integrator else Integrator().h
+        options = LyapunovOptions(self.problem.rhs_type, exit_type, exponents, qr_interval, t_max, h, max_records)
+        stats = LyapunovStats()
+        y = np.array(self.state, dtype=np.double)
+        estimates = np.zeros(exponents, dtype=np.double)
+        history = np.zeros((max_records, exponents + 1), dtype=np.double)
+        status = self.problem.cSAT_functions.sat_lyapunov(self.problem.problem_handle, byref(options), y.ctypes.data_as(POINTER(c_double)), None,
+                                    estimates.ctypes.data_as(POINTER(c_double)), history.ctypes.data_as(c_void_p), byref(stats))
+        if status == SOLVE_NO_MEMORY:
+            raise MemoryError
+        if status == SOLVE_INVALID_ARGUMENT:
+            raise ValueError('exponents has to be between 1 and N+M and h positive')
+        self.lyapunov_stats = stats
+        self.lyapunov_history = history[:stats.records]
+        return estimates
+
+    def native_options(self, t_max, exit_type, method, atol, rtol, h, max_steps, aux_limit = 0.0, mixed_precision = False,
+                       timing = False, trace_file = None, trace_interval = 100, finish_threshold = 0, finish_flips = 0, finish_noise = 0.5):
+        """
+        Fills the option structure of the native solvers, the step size defaults to the one of the integrator for fixed step methods,
+        self.seed seeds the local searches of the finishing stage
+        """
+        if not self.problem.cSAT_functions:
+            raise ValueError("native solvers need the c library (so_file_name)")
+        if h is None:
+            if method in (SOLVER_EULER, SOLVER_RK4):
+                h = self.integrator.h if self.integrator else Integrator().h
+            else:
+                h = 0.0
+        rhs_type = self.problem.rhs_type | (RHS_MIXED_PRECISION if mixed_precision else 0)
+        trace_path = fsencode(trace_file) if trace_file is not None else None
+        options = SolveOptions(rhs_type, method, exit_type, t_max, h, atol, rtol, 1e-12, max_steps, aux_limit, int(timing), trace_interval, trace_path)
+        options.seed = self.seed
+        options.finish_threshold = finish_threshold
+        options.finish_flips = finish_flips
+        options.finish_noise = finish_noise
+        return options
+
+    def solve_statistics(self, stats, timing = False):
+        """Dictionary of a native SolveStats, with the cycle counts converted to seconds if they were measured"""
+        result = {name: getattr(stats, name) for name, _ in SolveStats._fields_ if not name.endswith('cycles')}
+        tried = stats.accepted_steps + stats.rejected_steps
+        result['rejection_rate'] = stats.rejected_steps / tried if tried else 0.0
+        if timing:
+            rate = self.problem.cycles_per_second()
+            result['rhs_seconds'] = stats.rhs_cycles / rate
+            result['exit_check_seconds'] = stats.exit_cycles / rate
+            result['solve_seconds'] = stats.cycles / rate
+            result['rhs_ns_per_evaluation'] = 1e9 * result['rhs_seconds'] / stats.rhs_evaluations if stats.rhs_evaluations else 0.0
+        return result
+
     def get_solution(self):
         if self.sol.y.any():
             str_sol = ""
@@ -564,15 +1715,12 @@ class CTD:
             return -1.0
 
         def extended_system(t, y):
-            s = y[:N]
-            a = y[N:M]
             #Size N+M square matrix for the tangential space
             U = y[N+M:N+M+(N+M)**2].reshape([N+M, N+M])
             #Size N+M vector for lyapunov exponents
             L = y[N+M+(N+M)**2:2*(N+M)+(N+M)**2]
-            f = self.problem.rhs(t, y)
-            Df = self.problem.Jakobian(y)
-            A = U.T.dot(Df.dot(U))
+            f = self.problem.rhs(t, y[:N+M])
+            A = U.T.dot(self.problem.jvp_batch(y[:N+M], U))
             dL = np.diag(A).copy()
             for i in range(N+M):
                 A[i,i] = 0